@@ -1,59 +1,243 @@
 #!/usr/bin/env python3
 
+import json
 import subprocess
 import sys
+from importlib.util import find_spec
 from pathlib import Path
-from typing import Any, Callable, Dict, List, Optional
-
+from typing import Any, Callable, Dict, List, Tuple
+
+from lang.codegen.c import CGenerator
+from lang.exceptions import AaaLoadException
+from lang.exceptions.misc import IntegerOutOfRange, StackHeightExceeded
+from lang.models import AaaModel
+from lang.runtime.benchmark import find_benchmarks, run_benchmarks
+from lang.runtime.language_server import LanguageServer
+from lang.runtime.limits import Limits
+from lang.runtime.profiler import Profiler
 from lang.runtime.program import Program
+from lang.runtime.pycompiler import PyCompiler
 from lang.runtime.simulator import Simulator
+from lang.runtime.workspace import Workspace
 
 
-def run(file_path: str, verbose_flag: Optional[str] = None) -> None:
+# Maps command line flags to the option they enable
+FLAGS: Dict[str, str] = {
+    "-v": "verbose",
+    "-O": "optimize",
+    "--profile": "profile",
+    "--no-cache": "no_cache",
+}
 
-    verbose = False
+# Allowed values of options passed like --name=value, the first one is the default
+VALUE_OPTIONS: Dict[str, List[str]] = {
+    "engine": ["simulator", "pycompile"],
+}
+
+# Options passed like --name=N, with a non-negative integer value
+INT_OPTIONS: List[str] = [
+    "warmup",
+    "repeat",
+    "jobs",
+    "max-instructions",
+    "max-call-depth",
+    "max-stack-size",
+    "max-container-items",
+]
+
+# Options passed like --name=PATH
+PATH_OPTIONS: List[str] = ["flamegraph"]
+
+
+class Options(AaaModel):
+    verbose: bool = False
+    optimize: bool = False
+    profile: bool = False
+    no_cache: bool = False
+    flamegraph: str = ""
+    engine: str = VALUE_OPTIONS["engine"][0]
+    warmup: int = 1
+    repeat: int = 5
+    jobs: int = 1
+    max_instructions: int = 0
+    max_call_depth: int = 0
+    max_stack_size: int = 0
+    max_container_items: int = 0
+
+
+def parse_flags(command_name: str, flags: Tuple[str, ...]) -> Options:
+    options = Options()
+
+    for flag in flags:
+        if flag in FLAGS:
+            setattr(options, FLAGS[flag], True)
+            continue
+
+        name, _, value = flag.removeprefix("--").partition("=")
+
+        if flag.startswith("--") and name in INT_OPTIONS and value.isdigit():
+            setattr(options, name.replace("-", "_"), int(value))
+            continue
+
+        if flag.startswith("--") and name in PATH_OPTIONS and value:
+            setattr(options, name, value)
+            continue
+
+        if not flag.startswith("--") or value not in VALUE_OPTIONS.get(name, []):
+            raise ArgParseError(f"Unexpected option {flag} for {command_name}.")
+
+        setattr(options, name, value)
+
+    return options
+
+
+def load_program(file: Path, options: Options) -> Program:
+    return Program(
+        file,
+        optimize=options.optimize,
+        use_cache=not options.no_cache,
+        jobs=options.jobs,
+    )
 
-    if verbose_flag:
-        if verbose_flag == "-v":
-            verbose = True
-        else:
-            raise ArgParseError("Unexpected option for run.")
 
-    program = Program(Path(file_path))
+def run_program(program: Program, options: Options) -> None:
     program.exit_on_error()
-    simulator = Simulator(program, verbose)
-    simulator.run()
+
+    limits = Limits(
+        max_instructions=options.max_instructions,
+        max_call_depth=options.max_call_depth,
+        max_stack_size=options.max_stack_size,
+        max_container_items=options.max_container_items,
+    )
+
+    if limits.any() and options.engine != "simulator":
+        raise ArgParseError("Limits only work with the simulator engine.")
+
+    if options.profile or options.flamegraph:
+        if options.engine != "simulator":
+            raise ArgParseError("Profiling only works with the simulator engine.")
+
+        profile_program(program, options, limits)
+    elif options.engine == "pycompile":
+        PyCompiler(program, options.verbose).run()
+    else:
+        Simulator(program, options.verbose, limits=limits).run()
 
 
-def cmd(code: str, verbose_flag: Optional[str] = None) -> None:
+def profile_program(program: Program, options: Options, limits: Limits) -> None:
+    profiler = Profiler(Simulator(program, options.verbose, limits=limits))
+
+    try:
+        profiler.run()
+    finally:
+        profiler.print_report()
+
+        if options.flamegraph:
+            with open(options.flamegraph, "w") as file:
+                profiler.write_collapsed_stacks(file)
+
+
+def run(file_path: str, *flags: str) -> None:
+    options = parse_flags("run", flags)
+    program = load_program(Path(file_path), options)
+    run_program(program, options)
+
+
+def cmd(code: str, *flags: str) -> None:
     code = "fn main {\n" + code + "\n}"
-    cmd_full(code, verbose_flag)
+    cmd_full(code, *flags)
 
 
-def cmd_full(code: str, verbose_flag: Optional[str] = None) -> None:
+def cmd_full(code: str, *flags: str) -> None:
+    options = parse_flags("cmd", flags)
+    program = Program.without_file(
+        code,
+        optimize=options.optimize,
+        use_cache=not options.no_cache,
+        jobs=options.jobs,
+    )
+    run_program(program, options)
+
 
-    verbose = False
+def compile_binary(file_path: str, *flags: str) -> None:
+    remaining_flags = list(flags)
+    output = Path(file_path).stem
 
-    if verbose_flag:
-        if verbose_flag == "-v":
-            verbose = True
-        else:
-            raise ArgParseError("Unexpected option for cmd.")
+    if "-o" in remaining_flags:
+        index = remaining_flags.index("-o")
+        if index + 1 == len(remaining_flags):
+            raise ArgParseError("Missing output file after -o for compile.")
+        output = remaining_flags[index + 1]
+        del remaining_flags[index : index + 2]
 
-    program = Program.without_file(code)
+    options = parse_flags("compile", tuple(remaining_flags))
+    program = load_program(Path(file_path), options)
     program.exit_on_error()
-    simulator = Simulator(program, verbose)
-    simulator.run()
+
+    try:
+        CGenerator(program).compile(Path(output))
+    except (IntegerOutOfRange, StackHeightExceeded) as e:
+        print(e, file=sys.stderr)
+        exit(1)
+    except subprocess.CalledProcessError:
+        print("Compiling generated C code failed.", file=sys.stderr)
+        exit(1)
+
+
+def bench(*args: str) -> None:
+    files = [Path(arg) for arg in args if not arg.startswith("-")]
+    options = parse_flags("bench", tuple(arg for arg in args if arg.startswith("-")))
+
+    if options.repeat == 0:
+        raise ArgParseError("bench needs at least one repetition.")
+
+    results = run_benchmarks(
+        files or find_benchmarks(), options.warmup, options.repeat, options.optimize
+    )
+    print(json.dumps(results, indent=2))
+
+
+def check(*file_paths: str) -> None:
+    if not file_paths:
+        raise ArgParseError("check needs at least one file.")
+
+    files = [Path(file_path) for file_path in file_paths]
+    workspace = Workspace(files[0])
+    errors: List[AaaLoadException] = []
+
+    for file in files:
+        messages = [str(error) for error in errors]
+
+        # Files imported by multiple checked files report the same errors
+        errors += [
+            error for error in workspace.check(file) if str(error) not in messages
+        ]
+
+    workspace.file_load_errors = errors
+    workspace.exit_on_error()
+
+
+def language_server(*args: str) -> None:
+    if args:
+        raise ArgParseError("lsp expects no flags or arguments.")
+
+    exit(LanguageServer(sys.stdin.buffer, sys.stdout.buffer).run())
 
 
 def runtests(*args: Any) -> None:
     if args:
         raise ArgParseError("runtests expects no flags or arguments.")
 
-    commands = [
-        "pre-commit run --all-files mypy",
-        "pytest --cov=lang --cov-report=term-missing --pdb -x --lf --nf",
-    ]
+    pytest_command = "pytest --cov=lang --cov-report=term-missing -x --lf --nf"
+
+    # Tests run on all CPU cores when pytest-xdist is installed, but then failures
+    # can't be debugged with pdb
+    if find_spec("xdist"):
+        pytest_command += " -n auto"
+    else:
+        pytest_command += " --pdb"
+
+    commands = ["pre-commit run --all-files mypy", pytest_command]
 
     for command in commands:
         proc = subprocess.run(command.split())
@@ -63,8 +247,12 @@ def runtests(*args: Any) -> None:
 
 
 COMMANDS: Dict[str, Callable[..., None]] = {
+    "bench": bench,
+    "check": check,
     "cmd": cmd,
     "cmd-full": cmd_full,
+    "compile": compile_binary,
+    "lsp": language_server,
     "run": run,
     "runtests": runtests,
 }
@@ -78,10 +266,37 @@ def show_usage(argv: List[str], error_message: str) -> None:
     message = (
         f"Argument parsing failed: {error_message}\n\n"
         + "Available commands:\n"
-        + f"{argv[0]} cmd CODE <-v>\n"
-        + f"{argv[0]} cmd-full CODE <-v>\n"
-        + f"{argv[0]} run FILE_PATH <-v>\n"
+        + f"{argv[0]} bench <FILE_PATH...> <-O> <--warmup=N> <--repeat=N>\n"
+        + f"{argv[0]} cmd CODE <-v> <-O> <--engine=ENGINE> <--profile>"
+        + " <--flamegraph=PATH> <--jobs=N> <--no-cache> <--max-...=N>\n"
+        + f"{argv[0]} cmd-full CODE <-v> <-O> <--engine=ENGINE> <--profile>"
+        + " <--flamegraph=PATH> <--jobs=N> <--no-cache> <--max-...=N>\n"
+        + f"{argv[0]} check FILE_PATH...\n"
+        + f"{argv[0]} compile FILE_PATH <-o OUTPUT> <-O> <--jobs=N> <--no-cache>\n"
+        + f"{argv[0]} lsp\n"
+        + f"{argv[0]} run FILE_PATH <-v> <-O> <--engine=ENGINE> <--profile>"
+        + " <--flamegraph=PATH> <--jobs=N> <--no-cache> <--max-...=N>\n"
         + f"{argv[0]} runtests\n"
+        + "\n"
+        + "Options:\n"
+        + "-v  print debug information while running\n"
+        + "-o  output file of compiled binary, defaults to FILE_PATH without suffix\n"
+        + "-O  run the peephole optimizer on generated instructions\n"
+        + "--engine=simulator  interpret instructions (default)\n"
+        + "--engine=pycompile  compile instructions to Python code and run that\n"
+        + "--profile  print instruction counts and time per function after running\n"
+        + "--flamegraph=PATH  profile and write collapsed stacks for flamegraphs\n"
+        + "--warmup=N  untimed runs of each benchmark before timing it (default 1)\n"
+        + "--repeat=N  timed runs of each benchmark (default 5)\n"
+        + "--jobs=N  processes used to load files, 0 uses all cores (default 1)\n"
+        + "--no-cache  don't read or write __aaacache__ directories\n"
+        + "\n"
+        + "Compiled binaries never free strings and containers, so their memory use\n"
+        + "grows with every one that is created.\n"
+        + "--max-instructions=N  stop after about N instructions, 0 is no limit\n"
+        + "--max-call-depth=N  stop when more than N functions are running\n"
+        + "--max-stack-size=N  stop when the stack holds more than N values\n"
+        + "--max-container-items=N  stop when all containers hold more than N items\n"
     )
 
     print(message, file=sys.stderr)
@@ -0,0 +1,614 @@
+import os
+import re
+import subprocess
+from pathlib import Path
+from tempfile import TemporaryDirectory
+from typing import Dict, Final, List, Optional, Set, Tuple, Type
+
+from lang.exceptions.misc import IntegerOutOfRange, StackHeightExceeded
+from lang.instructions.types import (
+    SYS_CALL_STACK_EFFECTS,
+    And,
+    Assert,
+    CallFunction,
+    Divide,
+    Drop,
+    Dup,
+    Dup2,
+    GetStructField,
+    Instruction,
+    IntEquals,
+    IntGreaterEquals,
+    IntGreaterThan,
+    IntLessEquals,
+    IntLessThan,
+    IntNotEqual,
+    IntPlus,
+    IntPlusImmediate,
+    IterNext,
+    Jump,
+    JumpIfNot,
+    JumpIfNotIntEquals,
+    JumpIfNotIntGreaterEquals,
+    JumpIfNotIntGreaterThan,
+    JumpIfNotIntLessEquals,
+    JumpIfNotIntLessThan,
+    JumpIfNotIntNotEqual,
+    MapClear,
+    MapCopy,
+    MapDrop,
+    MapEmpty,
+    MapGet,
+    MapHasKey,
+    MapItems,
+    MapIterNext,
+    MapKeys,
+    MapPop,
+    MapSet,
+    MapSize,
+    MapValues,
+    Minus,
+    Modulo,
+    Multiply,
+    Nop,
+    Not,
+    Or,
+    Over,
+    Print,
+    PushBool,
+    PushFunctionArgument,
+    PushInt,
+    PushIterator,
+    PushMap,
+    PushSet,
+    PushStrbuf,
+    PushString,
+    PushStruct,
+    PushVec,
+    Rot,
+    SetAdd,
+    SetClear,
+    SetDrop,
+    SetHas,
+    SetSize,
+    SetStructField,
+    StrConcat,
+    StrEquals,
+    StrbufAppend,
+    StrbufSize,
+    StrbufToStr,
+    Swap,
+    SysCall,
+    TailCall,
+    VecClear,
+    VecCopy,
+    VecEmpty,
+    VecExtend,
+    VecFill,
+    VecGet,
+    VecPop,
+    VecPush,
+    VecReserve,
+    VecSet,
+    VecSize,
+    VecSlice,
+)
+from lang.models.parse import Function, TypeLiteral
+from lang.runtime.program import Program
+from lang.typing.types import RootType, SignatureItem, VariableType
+
+RUNTIME_PATH = Path(__file__).parent / "runtime"
+
+# C code and stack size change of instructions without fields, or with fields that
+# don't change their C code. In the code, x is the top of the stack, y and z are
+# below it and n0, n1 and n2 are pushed on top of it.
+INSTRUCTION_TEMPLATES: Dict[Type[Instruction], Tuple[str, int]] = {
+    And: ("{y} = aaa_bool({y}.boolean && {x}.boolean);", -1),
+    Assert: ("if (!{x}.boolean) {{\n    aaa_assertion_failure();\n}}", -1),
+    Divide: ("aaa_divide(&{y}, &{x});", 0),
+    Drop: ("", -1),
+    Dup: ("{n0} = {x};", 1),
+    Dup2: ("{n0} = {y};\n{n1} = {x};", 2),
+    IntEquals: ("{y} = aaa_bool({y}.integer == {x}.integer);", -1),
+    IntGreaterEquals: ("{y} = aaa_bool({y}.integer >= {x}.integer);", -1),
+    IntGreaterThan: ("{y} = aaa_bool({y}.integer > {x}.integer);", -1),
+    IntLessEquals: ("{y} = aaa_bool({y}.integer <= {x}.integer);", -1),
+    IntLessThan: ("{y} = aaa_bool({y}.integer < {x}.integer);", -1),
+    IntNotEqual: ("{y} = aaa_bool({y}.integer != {x}.integer);", -1),
+    IntPlus: ("{y}.integer += {x}.integer;", -1),
+    Minus: ("{y}.integer -= {x}.integer;", -1),
+    Modulo: ("aaa_modulo(&{y}, &{x});", 0),
+    Multiply: ("{y}.integer *= {x}.integer;", -1),
+    Nop: ("", 0),
+    Not: ("{x}.boolean = !{x}.boolean;", 0),
+    Or: ("{y} = aaa_bool({y}.boolean || {x}.boolean);", -1),
+    Over: ("{n0} = {y};", 1),
+    Print: ("aaa_print({x});", -1),
+    Rot: ("{n0} = {z};\n{z} = {y};\n{y} = {x};\n{x} = {n0};", 0),
+    StrConcat: ("{y} = aaa_str_value(aaa_str_concat({y}.str, {x}.str));", -1),
+    StrEquals: ("{y} = aaa_bool(aaa_str_equals({y}.str, {x}.str));", -1),
+    Swap: ("{n0} = {y};\n{y} = {x};\n{x} = {n0};", 0),
+    VecClear: ("aaa_vec_clear({x}.vec);", 0),
+    VecCopy: ("{n0} = aaa_copy({x});", 1),
+    VecExtend: ("aaa_vec_extend({y}.vec, {x}.vec);", -1),
+    VecSlice: ("{y} = aaa_vec_slice({z}.vec, {y}.integer, {x}.integer);", -1),
+    VecFill: ("aaa_vec_fill({z}.vec, {y}.integer, {x});", -2),
+    VecReserve: ("aaa_vec_reserve({y}.vec, {x}.integer);", -1),
+    VecEmpty: ("{n0} = aaa_bool(aaa_vec_size({x}.vec) == 0);", 1),
+    VecGet: ("{x} = aaa_vec_get({y}.vec, {x}.integer);", 0),
+    VecPop: ("{n0} = aaa_vec_pop({x}.vec);", 1),
+    VecPush: ("aaa_vec_push({y}.vec, {x});", -1),
+    VecSet: ("aaa_vec_set({z}.vec, {y}.integer, {x});", -2),
+    VecSize: ("{n0} = aaa_int(aaa_vec_size({x}.vec));", 1),
+    MapClear: ("aaa_map_clear({x}.map);", 0),
+    MapCopy: ("{n0} = aaa_copy({x});", 1),
+    MapDrop: ("aaa_map_drop({y}.map, {x});", -1),
+    MapEmpty: ("{n0} = aaa_bool(aaa_map_size({x}.map) == 0);", 1),
+    MapGet: ("{x} = aaa_map_get({y}.map, {x});", 0),
+    MapHasKey: ("{x} = aaa_bool(aaa_map_has_key({y}.map, {x}));", 0),
+    MapKeys: ("{n0} = aaa_map_iterate({x}.map, AAA_KEYS);", 1),
+    MapPop: ("{x} = aaa_map_pop({y}.map, {x});", 0),
+    MapSet: ("aaa_map_set({z}.map, {y}, {x});", -2),
+    MapSize: ("{n0} = aaa_int(aaa_map_size({x}.map));", 1),
+    MapValues: ("{n0} = aaa_map_iterate({x}.map, AAA_VALUES);", 1),
+    MapItems: ("{n0} = aaa_map_iterate({x}.map, AAA_ITEMS);", 1),
+    PushStrbuf: ("{n0} = aaa_strbuf_new();", 1),
+    StrbufAppend: ("aaa_strbuf_append({y}.strbuf, {x}.str);", -1),
+    StrbufToStr: ("{n0} = aaa_str_value(aaa_strbuf_to_str({x}.strbuf));", 1),
+    StrbufSize: ("{n0} = aaa_int(aaa_strbuf_size({x}.strbuf));", 1),
+    SetAdd: ("aaa_set_add({y}.map, {x});", -1),
+    SetClear: ("aaa_map_clear({x}.map);", 0),
+    SetDrop: ("aaa_set_drop({y}.map, {x});", -1),
+    SetHas: ("{x} = aaa_bool(aaa_map_has_key({y}.map, {x}));", 0),
+    SetSize: ("{n0} = aaa_int(aaa_map_size({x}.map));", 1),
+}
+
+# Comparison made by conditional jumps, they jump if it is false
+CONDITIONAL_JUMPS: Dict[Type[Instruction], str] = {
+    JumpIfNot: "",
+    JumpIfNotIntEquals: "==",
+    JumpIfNotIntNotEqual: "!=",
+    JumpIfNotIntLessThan: "<",
+    JumpIfNotIntLessEquals: "<=",
+    JumpIfNotIntGreaterThan: ">",
+    JumpIfNotIntGreaterEquals: ">=",
+}
+
+# Kind of values of each type, used for struct fields and zero values
+VALUE_KINDS: Dict[RootType, str] = {
+    RootType.BOOL: "AAA_BOOL",
+    RootType.INTEGER: "AAA_INT",
+    RootType.STRING: "AAA_STR",
+    RootType.VECTOR: "AAA_VEC",
+    RootType.MAPPING: "AAA_MAP",
+    RootType.SET: "AAA_SET",
+    RootType.ITERATOR: "AAA_ITER",
+    RootType.MAP_ITERATOR: "AAA_MAP_ITER",
+    RootType.STRING_BUFFER: "AAA_STRBUF",
+    RootType.STRUCT: "AAA_STRUCT",
+}
+
+# Range of integers in compiled code
+INT64_MIN: Final = -(2**63)
+INT64_MAX: Final = 2**63 - 1
+
+# Signed overflow wraps around instead of being undefined behaviour
+C_FLAGS = ["-std=c11", "-O2", "-fwrapv"]
+
+
+class CGenerator:
+    """
+    Translates the instructions of all functions into C source code, which can be
+    compiled with the runtime library in lang/codegen/runtime into a binary.
+
+    Every Aaa function becomes a C function that gets a pointer to its arguments on
+    the caller's stack and writes its return values there. Because of type checking
+    the stack size at every instruction is known, so the stack is a local array and
+    jumps become a goto. Using more of the stack than type checking found raises
+    StackHeightExceeded, as the array would overflow.
+
+    Strings and containers are never freed, so memory use of compiled programs grows
+    with every one that is created.
+
+    Integers are 64 bits and wrap around on overflow. Integer literals that don't fit
+    in 64 bits raise IntegerOutOfRange instead of silently changing.
+    """
+
+    def __init__(self, program: Program) -> None:
+        self.program = program
+
+        # Declarations of string literals and struct types used by generated code
+        self.constants: List[str] = []
+
+        # Name of generated C function for each Aaa function
+        self.function_names: Dict[Path, Dict[str, str]] = {}
+
+        for file, functions in program.function_instructions.items():
+            self.function_names[file] = {}
+            for name in functions:
+                # Functions in different files can have the same name
+                index = sum(len(names) for names in self.function_names.values())
+                c_name = f"aaa_{index}_" + re.sub(r"\W", "_", name)
+                self.function_names[file][name] = c_name
+
+    def generate(self) -> str:
+        self.constants = []
+        prototypes: List[str] = []
+        functions: List[str] = []
+
+        for file, file_functions in self.program.function_instructions.items():
+            for name, instructions in file_functions.items():
+                c_name = self.function_names[file][name]
+                prototypes.append(f"static void {c_name}(aaa_value *sp);")
+                functions += self._generate_function(file, name, instructions)
+                functions.append("")
+
+        main = self.function_names[self.program.entry_point_file]["main"]
+        entry_point = [
+            "int main(void) {",
+            "    aaa_value sp[1];",
+            f"    {main}(sp);",
+            "    return 0;",
+            "}",
+        ]
+
+        lines = ['#include "aaa.h"', ""]
+        lines += prototypes + [""]
+        lines += self.constants + [""]
+        lines += functions + entry_point
+        return "\n".join(lines) + "\n"
+
+    def compile(self, output: Path) -> None:
+        """
+        Compiles the program into a binary using the C compiler in $CC.
+        """
+
+        compiler = os.environ.get("CC", "cc")
+
+        with TemporaryDirectory() as temp_dir:
+            source_file = Path(temp_dir) / "main.c"
+            source_file.write_text(self.generate())
+
+            command = [compiler, *C_FLAGS, f"-I{RUNTIME_PATH}", "-o", str(output)]
+            command += [str(source_file), str(RUNTIME_PATH / "aaa.c")]
+            subprocess.run(command, check=True)
+
+    def _constant(self, c_type: str, value: str, array: bool = False) -> str:
+        name = f"c{len(self.constants)}"
+        brackets = "[]" if array else ""
+        self.constants.append(f"static const {c_type} {name}{brackets} = {value};")
+        return name
+
+    def _string(self, value: str) -> str:
+        encoded = value.encode()
+        return self._constant("aaa_str", f"{{{len(encoded)}, {_c_string(encoded)}}}")
+
+    def _struct_type(self, instruction: PushStruct) -> str:
+        fields: List[str] = []
+
+        for field in instruction.type.fields:
+            assert isinstance(field.type.type, TypeLiteral)
+            root_type = RootType.from_str(field.type.type.type_name)
+            name = field.name.encode()
+            kind = VALUE_KINDS[root_type]
+            fields.append(f"{{{{{len(name)}, {_c_string(name)}}}, {kind}}}")
+
+        fields_name = self._constant(
+            "aaa_field", "{" + ", ".join(fields) + "}", array=True
+        )
+
+        struct_name = _c_string(instruction.type.name.encode())
+        return self._constant(
+            "aaa_struct_type", f"{{{struct_name}, {len(fields)}, {fields_name}}}"
+        )
+
+    def _generate_function(
+        self, file: Path, name: str, instructions: List[Instruction]
+    ) -> List[str]:
+        function = self.program.get_identifier(file, name)
+        assert isinstance(function, Function)
+
+        arg_count = len(function.arguments)
+        for instruction in instructions:
+            if isinstance(instruction, (PushInt, IntPlusImmediate)):
+                if not INT64_MIN <= instruction.value <= INT64_MAX:
+                    raise IntegerOutOfRange(
+                        file=file, function=function, value=instruction.value
+                    )
+
+        depths = self._stack_depths(instructions)
+
+        # Found by the TypeChecker, instructions never use more stack slots
+        stack_height = self.program.get_stack_height(file, name)
+        for depth in depths:
+            if depth is not None and depth > stack_height:
+                raise StackHeightExceeded(
+                    file=file,
+                    function=function,
+                    depth=depth,
+                    stack_height=stack_height,
+                )
+
+        labels: Set[int] = set()
+        for offset, instruction in enumerate(instructions):
+            if depths[offset] is None:
+                continue
+
+            if isinstance(instruction, Jump) or type(instruction) in CONDITIONAL_JUMPS:
+                labels.add(getattr(instruction, "instruction_offset"))
+            elif isinstance(instruction, TailCall):
+                labels.add(0)
+
+        if arg_count:
+            names = [_c_string(arg.name.encode()) for arg in function.arguments]
+            argument_names = self._constant(
+                "char *const", "{" + ", ".join(names) + "}", array=True
+            )
+        else:
+            argument_names = "NULL"
+
+        # Two extra items are used as temporary variables by Rot and Swap
+        body = [
+            f"aaa_value a[{max(arg_count, 1)}];",
+            f"aaa_value s[{stack_height + 2}];",
+        ]
+        body += [f"a[{i}] = sp[{i}];" for i in range(arg_count)]
+
+        if not arg_count and not function.return_types:
+            body.append("(void)sp;")
+
+        body += [
+            f"aaa_frame frame = {{{_c_string(name.encode())}, {argument_names}, a, "
+            + f"{arg_count}, aaa_call_stack}};",
+            "aaa_call_stack = &frame;",
+        ]
+
+        for offset, instruction in enumerate(instructions):
+            depth = depths[offset]
+
+            if offset in labels:
+                body.append(f"l{offset}:;")
+
+            if depth is None:
+                # Unreachable
+                continue
+
+            if isinstance(instruction, Jump):
+                body.append(f"goto l{instruction.instruction_offset};")
+            elif type(instruction) in CONDITIONAL_JUMPS:
+                condition, _ = self._condition(instruction, depth)
+                target = getattr(instruction, "instruction_offset")
+                body.append(f"if (!({condition})) goto l{target};")
+            elif isinstance(instruction, TailCall):
+                # Only the arguments are on the stack, they replace the current ones
+                first = depth - arg_count
+                body += [f"a[{i}] = s[{first + i}];" for i in range(arg_count)]
+                body.append("goto l0;")
+            else:
+                body += self._instruction(instruction, depth)[0]
+
+        if len(instructions) in labels:
+            body.append(f"l{len(instructions)}:;")
+
+        body.append("aaa_call_stack = frame.caller;")
+        body += [f"sp[{i}] = s[{i}];" for i in range(len(function.return_types))]
+
+        c_name = self.function_names[file][name]
+        return [f"static void {c_name}(aaa_value *sp) {{"] + _indent(body) + ["}"]
+
+    def _stack_depths(self, instructions: List[Instruction]) -> List[Optional[int]]:
+        """
+        Returns stack depth before each instruction, and at the end of the function.
+        Unreachable instructions get None.
+        """
+
+        depths: List[Optional[int]] = [None] * (len(instructions) + 1)
+        depths[0] = 0
+        todo = [0]
+
+        while todo:
+            offset = todo.pop()
+            depth = depths[offset]
+            assert depth is not None
+
+            if offset == len(instructions):
+                continue
+
+            instruction = instructions[offset]
+            successors = [offset + 1]
+
+            if isinstance(instruction, Jump):
+                successors = [instruction.instruction_offset]
+            elif type(instruction) in CONDITIONAL_JUMPS:
+                _, depth = self._condition(instruction, depth)
+                successors.append(getattr(instruction, "instruction_offset"))
+            else:
+                depth = self._stack_change(instruction, depth)
+
+            for successor in successors:
+                if depths[successor] is None:
+                    depths[successor] = depth
+                    todo.append(successor)
+
+        return depths
+
+    def _stack_change(self, instruction: Instruction, depth: int) -> int:
+        if isinstance(instruction, (CallFunction, TailCall)):
+            function = instruction.function
+            return depth - len(function.arguments) + len(function.return_types)
+
+        if type(instruction) in INSTRUCTION_TEMPLATES:
+            return depth + INSTRUCTION_TEMPLATES[type(instruction)][1]
+
+        if isinstance(instruction, IntPlusImmediate):
+            return depth
+
+        if isinstance(instruction, SysCall):
+            arg_count, return_count = SYS_CALL_STACK_EFFECTS[instruction.kind]
+            return depth - arg_count + return_count
+
+        if isinstance(instruction, GetStructField):
+            return depth + 1
+
+        if isinstance(instruction, SetStructField):
+            return depth - 1
+
+        if isinstance(instruction, IterNext):
+            return depth + 2
+
+        if isinstance(instruction, MapIterNext):
+            return depth + 3
+
+        # Push instructions
+        return depth + 1
+
+    def _condition(self, instruction: Instruction, depth: int) -> Tuple[str, int]:
+        """
+        Returns condition for not taking a conditional jump and stack depth after it.
+        """
+
+        operator = CONDITIONAL_JUMPS[type(instruction)]
+
+        if not operator:
+            return f"s[{depth - 1}].boolean", depth - 1
+
+        condition = f"s[{depth - 2}].integer {operator} s[{depth - 1}].integer"
+        return condition, depth - 2
+
+    def _instruction(
+        self, instruction: Instruction, depth: int
+    ) -> Tuple[List[str], int]:
+        """
+        Returns code for a non-jump instruction and stack depth after it.
+        """
+
+        slots = {
+            "x": f"s[{depth - 1}]",
+            "y": f"s[{depth - 2}]",
+            "z": f"s[{depth - 3}]",
+            "n0": f"s[{depth}]",
+            "n1": f"s[{depth + 1}]",
+            "n2": f"s[{depth + 2}]",
+        }
+
+        if isinstance(instruction, PushInt):
+            value = _c_integer(instruction.value)
+            template, change = f"{{n0}} = aaa_int({value});", 1
+
+        elif isinstance(instruction, PushBool):
+            value = "true" if instruction.value else "false"
+            template, change = f"{{n0}} = aaa_bool({value});", 1
+
+        elif isinstance(instruction, PushString):
+            string = self._string(instruction.value)
+            template, change = f"{{n0}} = aaa_str_value(&{string});", 1
+
+        elif isinstance(instruction, IntPlusImmediate):
+            value = _c_integer(instruction.value)
+            template, change = f"{{x}}.integer += {value};", 0
+
+        elif isinstance(instruction, PushFunctionArgument):
+            template, change = f"{{n0}} = a[{instruction.arg_index}];", 1
+
+        elif isinstance(instruction, PushVec):
+            template, change = "{n0} = aaa_vec_new();", 1
+
+        elif isinstance(instruction, PushMap):
+            key_kind = VALUE_KINDS[instruction.key_type.root_type]
+            value_kind = VALUE_KINDS[instruction.value_type.root_type]
+            template = f"{{n0}} = aaa_map_new({key_kind}, {value_kind});"
+            change = 1
+
+        elif isinstance(instruction, PushSet):
+            template, change = "{n0} = aaa_set_new();", 1
+
+        elif isinstance(instruction, PushIterator):
+            kind = VALUE_KINDS[instruction.type.root_type]
+            template, change = f"{{n0}} = aaa_zero({kind});", 1
+
+        elif isinstance(instruction, PushStruct):
+            struct_type = self._struct_type(instruction)
+            template, change = f"{{n0}} = aaa_struct_new(&{struct_type});", 1
+
+        elif isinstance(instruction, GetStructField):
+            template = f"{{n0}} = aaa_struct_get({{x}}.structure, {instruction.slot});"
+            change = 1
+
+        elif isinstance(instruction, SetStructField):
+            template = f"aaa_struct_set({{y}}.structure, {instruction.slot}, {{x}});"
+            change = -1
+
+        elif isinstance(instruction, IterNext):
+            kind = _item_kind(instruction.item_type, "aaa_iter_item_kind({x}.iter)")
+            template = f"{{n1}} = aaa_bool(aaa_iter_next({{x}}.iter, &{{n0}}, {kind}));"
+            change = 2
+
+        elif isinstance(instruction, MapIterNext):
+            key_kind = _item_kind(instruction.key_type, "aaa_iter_item_kind({x}.iter)")
+            value_kind = _item_kind(
+                instruction.value_type, "aaa_iter_value_kind({x}.iter)"
+            )
+            template = (
+                "{n2} = aaa_bool(aaa_map_iter_next({x}.iter, &{n0}, &{n1}, "
+                + f"{key_kind}, {value_kind}));"
+            )
+            change = 3
+
+        elif isinstance(instruction, CallFunction):
+            function = instruction.function
+            c_name = self.function_names[instruction.file][instruction.func_name]
+            first = depth - len(function.arguments)
+            return [f"{c_name}(&s[{first}]);"], first + len(function.return_types)
+
+        elif isinstance(instruction, SysCall):
+            # Implemented in the runtime, which gets the stack like Aaa functions
+            arg_count, return_count = SYS_CALL_STACK_EFFECTS[instruction.kind]
+            first = depth - arg_count
+            c_name = f"aaa_sys_{instruction.kind.name.lower()}"
+            return [f"{c_name}(&s[{first}]);"], first + return_count
+
+        else:
+            template, change = INSTRUCTION_TEMPLATES[type(instruction)]
+
+        code = template.format(**slots)
+        lines = code.split("\n") if code else []
+        return lines, depth + change
+
+
+def _indent(lines: List[str]) -> List[str]:
+    return ["    " + line for line in lines]
+
+
+def _c_string(value: bytes) -> str:
+    """
+    Returns C string literal, bytes that are not printable ASCII are escaped in octal.
+    """
+
+    escaped = ""
+
+    for byte in value:
+        char = chr(byte)
+        if char in '"\\' or not 0x20 <= byte < 0x7F:
+            escaped += f"\\{byte:03o}"
+        else:
+            escaped += char
+
+    return f'"{escaped}"'
+
+
+def _c_integer(value: int) -> str:
+    # The literal of the lowest value would be the negation of one out of range
+    if value == INT64_MIN:
+        return "INT64_MIN"
+    return f"{value}LL"
+
+
+def _item_kind(item_type: SignatureItem, runtime_kind: str) -> str:
+    """
+    Returns C expression with the kind of items of type item_type. In functions
+    with placeholder types it is only known at runtime, then runtime_kind is used.
+    """
+
+    if isinstance(item_type, VariableType):
+        return VALUE_KINDS[item_type.root_type]
+    return runtime_kind
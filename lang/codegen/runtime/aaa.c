@@ -0,0 +1,1043 @@
+// Needed for getline, fileno and mmap
+#define _POSIX_C_SOURCE 200809L
+
+#include "aaa.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+aaa_frame *aaa_call_stack = NULL;
+
+struct aaa_strbuf {
+    char *data;
+    size_t length;
+    size_t capacity;
+
+    // Number of UTF-8 encoded characters in data
+    size_t char_count;
+};
+
+struct aaa_vec {
+    aaa_value *items;
+    size_t size;
+    size_t capacity;
+};
+
+typedef struct aaa_map_entry {
+    aaa_value key;
+    aaa_value value;
+    uint64_t hash;
+    bool deleted;
+} aaa_map_entry;
+
+// Like a Python dict a map remembers the order in which keys were inserted:
+// entries are stored in insertion order and index is a hash table pointing into
+// entries. Removed entries are only marked as deleted until the next resize.
+struct aaa_map {
+    aaa_map_entry *entries;
+    size_t entry_count;
+    size_t entry_capacity;
+    size_t size;
+
+    int64_t *index;
+    size_t index_capacity;
+
+    // Set when an iterator uses entries, which then can't be changed anymore
+    bool shared;
+
+    // Maps that are zero values don't know these until an item is added
+    aaa_kind key_kind;
+    aaa_kind value_kind;
+};
+
+struct aaa_iter {
+    const aaa_map_entry *entries;
+    size_t entry_count;
+    size_t position;
+    aaa_iter_view view;
+    aaa_kind key_kind;
+    aaa_kind value_kind;
+};
+
+struct aaa_struct {
+    const aaa_struct_type *type;
+    aaa_value fields[];
+};
+
+static void aaa_error(const char *message) {
+    fflush(stdout);
+    fprintf(stderr, "%s\n", message);
+    exit(1);
+}
+
+static void *aaa_alloc(size_t size) {
+    void *allocated = malloc(size);
+
+    if (!allocated) {
+        aaa_error("Out of memory");
+    }
+
+    return allocated;
+}
+
+static void *aaa_realloc(void *old, size_t size) {
+    void *allocated = realloc(old, size);
+
+    if (!allocated) {
+        aaa_error("Out of memory");
+    }
+
+    return allocated;
+}
+
+void aaa_divide(aaa_value *y, aaa_value *x) {
+    int64_t dividend = y->integer;
+    int64_t divisor = x->integer;
+
+    if (divisor == 0) {
+        *y = aaa_int(0);
+        *x = aaa_bool(false);
+        return;
+    }
+
+    int64_t quotient = dividend / divisor;
+
+    if (dividend % divisor != 0 && ((dividend < 0) != (divisor < 0))) {
+        quotient--;
+    }
+
+    *y = aaa_int(quotient);
+    *x = aaa_bool(true);
+}
+
+void aaa_modulo(aaa_value *y, aaa_value *x) {
+    int64_t dividend = y->integer;
+    int64_t divisor = x->integer;
+
+    if (divisor == 0) {
+        *y = aaa_int(0);
+        *x = aaa_bool(false);
+        return;
+    }
+
+    int64_t remainder = dividend % divisor;
+
+    if (remainder != 0 && ((remainder < 0) != (divisor < 0))) {
+        remainder += divisor;
+    }
+
+    *y = aaa_int(remainder);
+    *x = aaa_bool(true);
+}
+
+const aaa_str *aaa_str_concat(const aaa_str *a, const aaa_str *b) {
+    size_t length = a->length + b->length;
+    aaa_str *concatenated = aaa_alloc(sizeof(aaa_str) + length);
+    char *data = (char *)(concatenated + 1);
+
+    memcpy(data, a->data, a->length);
+    memcpy(data + a->length, b->data, b->length);
+
+    concatenated->length = length;
+    concatenated->data = data;
+    return concatenated;
+}
+
+bool aaa_str_equals(const aaa_str *a, const aaa_str *b) {
+    return a->length == b->length && memcmp(a->data, b->data, a->length) == 0;
+}
+
+aaa_value aaa_strbuf_new(void) {
+    aaa_strbuf *buffer = aaa_alloc(sizeof(aaa_strbuf));
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+    buffer->char_count = 0;
+
+    aaa_value value = {.kind = AAA_STRBUF, .strbuf = buffer};
+    return value;
+}
+
+void aaa_strbuf_append(aaa_strbuf *buffer, const aaa_str *str) {
+    if (buffer->length + str->length > buffer->capacity) {
+        size_t capacity = buffer->capacity ? 2 * buffer->capacity : 64;
+        while (capacity < buffer->length + str->length) {
+            capacity *= 2;
+        }
+
+        buffer->data = aaa_realloc(buffer->data, capacity);
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->length, str->data, str->length);
+    buffer->length += str->length;
+
+    for (size_t i = 0; i < str->length; i++) {
+        // Skip UTF-8 continuation bytes
+        if (((unsigned char)str->data[i] & 0xC0) != 0x80) {
+            buffer->char_count++;
+        }
+    }
+}
+
+const aaa_str *aaa_strbuf_to_str(const aaa_strbuf *buffer) {
+    // Strings never change, so the buffer's content is copied
+    aaa_str *str = aaa_alloc(sizeof(aaa_str) + buffer->length);
+    char *data = (char *)(str + 1);
+
+    if (buffer->length) {
+        memcpy(data, buffer->data, buffer->length);
+    }
+
+    str->length = buffer->length;
+    str->data = data;
+    return str;
+}
+
+int64_t aaa_strbuf_size(const aaa_strbuf *buffer) {
+    return (int64_t)buffer->char_count;
+}
+
+static void aaa_fprint(FILE *file, aaa_value value, bool quote_str);
+
+static void aaa_fprint_vec(FILE *file, const aaa_vec *vec) {
+    fputc('[', file);
+
+    for (size_t i = 0; i < vec->size; i++) {
+        if (i > 0) {
+            fputs(", ", file);
+        }
+        aaa_fprint(file, vec->items[i], true);
+    }
+
+    fputc(']', file);
+}
+
+static void aaa_fprint_map(FILE *file, const aaa_map *map) {
+    bool first = true;
+    fputc('{', file);
+
+    for (size_t i = 0; i < map->entry_count; i++) {
+        const aaa_map_entry *entry = &map->entries[i];
+
+        if (entry->deleted) {
+            continue;
+        }
+
+        if (!first) {
+            fputs(", ", file);
+        }
+        first = false;
+
+        aaa_fprint(file, entry->key, true);
+        fputs(": ", file);
+        aaa_fprint(file, entry->value, true);
+    }
+
+    fputc('}', file);
+}
+
+static void aaa_fprint_set(FILE *file, const aaa_map *set) {
+    bool first = true;
+    fputc('{', file);
+
+    for (size_t i = 0; i < set->entry_count; i++) {
+        const aaa_map_entry *entry = &set->entries[i];
+
+        if (entry->deleted) {
+            continue;
+        }
+
+        if (!first) {
+            fputs(", ", file);
+        }
+        first = false;
+
+        aaa_fprint(file, entry->key, true);
+    }
+
+    fputc('}', file);
+}
+
+static void aaa_fprint(FILE *file, aaa_value value, bool quote_str) {
+    switch (value.kind) {
+    case AAA_INT:
+        fprintf(file, "%" PRId64, value.integer);
+        break;
+    case AAA_BOOL:
+        fputs(value.boolean ? "true" : "false", file);
+        break;
+    case AAA_STR:
+        if (quote_str) {
+            fputc('"', file);
+        }
+        fwrite(value.str->data, 1, value.str->length, file);
+        if (quote_str) {
+            fputc('"', file);
+        }
+        break;
+    case AAA_VEC:
+        aaa_fprint_vec(file, value.vec);
+        break;
+    case AAA_MAP:
+        aaa_fprint_map(file, value.map);
+        break;
+    case AAA_SET:
+        aaa_fprint_set(file, value.map);
+        break;
+    case AAA_ITER:
+        fputs("iter", file);
+        break;
+    case AAA_MAP_ITER:
+        fputs("map_iter", file);
+        break;
+    case AAA_STRBUF: {
+        const aaa_str content = {value.strbuf->length, value.strbuf->data};
+        aaa_fprint(file, aaa_str_value(&content), quote_str);
+        break;
+    }
+    case AAA_STRUCT:
+        aaa_error("Printing structs is not supported");
+        break;
+    }
+}
+
+void aaa_print(aaa_value value) { aaa_fprint(stdout, value, false); }
+
+static void aaa_print_frame(const aaa_frame *frame) {
+    if (!frame) {
+        return;
+    }
+
+    // Print outermost function first
+    aaa_print_frame(frame->caller);
+
+    fprintf(stderr, "- %s", frame->function_name);
+
+    for (size_t i = 0; i < frame->argument_count; i++) {
+        fputs(i == 0 ? ", arguments: " : ", ", stderr);
+        fprintf(stderr, "%s=", frame->argument_names[i]);
+        aaa_fprint(stderr, frame->arguments[i], true);
+    }
+}
+
+void aaa_assertion_failure(void) {
+    fflush(stdout);
+    fputs("Assertion failure, stacktrace:\n", stderr);
+    aaa_print_frame(aaa_call_stack);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+void aaa_not_implemented(const char *name) {
+    fflush(stdout);
+    fprintf(stderr, "%s is not implemented\n", name);
+    exit(1);
+}
+
+aaa_value aaa_copy(aaa_value value) {
+    aaa_value copied = value;
+
+    switch (value.kind) {
+    case AAA_VEC: {
+        copied = aaa_vec_new();
+        const aaa_vec *vec = value.vec;
+
+        for (size_t i = 0; i < vec->size; i++) {
+            aaa_vec_push(copied.vec, aaa_copy(vec->items[i]));
+        }
+        break;
+    }
+    case AAA_MAP:
+    case AAA_SET: {
+        const aaa_map *map = value.map;
+        copied = aaa_map_new(map->key_kind, map->value_kind);
+        copied.kind = value.kind;
+
+        for (size_t i = 0; i < map->entry_count; i++) {
+            const aaa_map_entry *entry = &map->entries[i];
+
+            if (!entry->deleted) {
+                aaa_map_set(copied.map, entry->key, aaa_copy(entry->value));
+            }
+        }
+        break;
+    }
+    case AAA_STRBUF: {
+        const aaa_str content = {value.strbuf->length, value.strbuf->data};
+        copied = aaa_strbuf_new();
+        aaa_strbuf_append(copied.strbuf, &content);
+        break;
+    }
+    case AAA_STRUCT: {
+        const aaa_struct *structure = value.structure;
+
+        if (!structure) {
+            break;
+        }
+
+        copied = aaa_struct_new(structure->type);
+
+        for (size_t i = 0; i < structure->type->field_count; i++) {
+            copied.structure->fields[i] = aaa_copy(structure->fields[i]);
+        }
+        break;
+    }
+    default:
+        // Values of other kinds are immutable, copies of iterators share their
+        // position
+        break;
+    }
+
+    return copied;
+}
+
+aaa_value aaa_zero(aaa_kind kind) {
+    switch (kind) {
+    case AAA_INT:
+        return aaa_int(0);
+    case AAA_BOOL:
+        return aaa_bool(false);
+    case AAA_STR: {
+        static const aaa_str empty = {0, ""};
+        return aaa_str_value(&empty);
+    }
+    case AAA_VEC:
+        return aaa_vec_new();
+    case AAA_MAP:
+        return aaa_map_new(AAA_INT, AAA_INT);
+    case AAA_SET:
+        return aaa_set_new();
+    case AAA_STRBUF:
+        return aaa_strbuf_new();
+    case AAA_ITER:
+    case AAA_MAP_ITER: {
+        // Iterator without any items
+        aaa_map *empty = aaa_map_new(AAA_INT, AAA_INT).map;
+        aaa_value iterator = aaa_map_iterate(empty, AAA_KEYS);
+        iterator.kind = kind;
+        return iterator;
+    }
+    case AAA_STRUCT:
+        break;
+    }
+
+    // Like the Simulator, nested structs have no fields yet
+    aaa_value value = {.kind = AAA_STRUCT, .structure = NULL};
+    return value;
+}
+
+aaa_value aaa_vec_new(void) {
+    aaa_vec *vec = aaa_alloc(sizeof(aaa_vec));
+    vec->items = NULL;
+    vec->size = 0;
+    vec->capacity = 0;
+
+    aaa_value value = {.kind = AAA_VEC, .vec = vec};
+    return value;
+}
+
+void aaa_vec_push(aaa_vec *vec, aaa_value item) {
+    if (vec->size == vec->capacity) {
+        vec->capacity = vec->capacity ? 2 * vec->capacity : 8;
+        vec->items = aaa_realloc(vec->items, vec->capacity * sizeof(aaa_value));
+    }
+
+    vec->items[vec->size++] = item;
+}
+
+aaa_value aaa_vec_pop(aaa_vec *vec) {
+    if (vec->size == 0) {
+        aaa_error("vec:pop on empty vec");
+    }
+
+    return vec->items[--vec->size];
+}
+
+static void aaa_vec_check_index(const aaa_vec *vec, int64_t index) {
+    if (index < 0 || (uint64_t)index >= vec->size) {
+        aaa_error("vec index out of range");
+    }
+}
+
+aaa_value aaa_vec_get(const aaa_vec *vec, int64_t index) {
+    aaa_vec_check_index(vec, index);
+    return vec->items[index];
+}
+
+void aaa_vec_set(aaa_vec *vec, int64_t index, aaa_value item) {
+    aaa_vec_check_index(vec, index);
+    vec->items[index] = item;
+}
+
+int64_t aaa_vec_size(const aaa_vec *vec) { return (int64_t)vec->size; }
+
+void aaa_vec_clear(aaa_vec *vec) { vec->size = 0; }
+
+void aaa_vec_reserve(aaa_vec *vec, int64_t capacity) {
+    if (capacity <= 0 || (size_t)capacity <= vec->capacity) {
+        return;
+    }
+
+    vec->capacity = (size_t)capacity;
+    vec->items = aaa_realloc(vec->items, vec->capacity * sizeof(aaa_value));
+}
+
+void aaa_vec_extend(aaa_vec *vec, const aaa_vec *other) {
+    // Other can be vec itself, so only its current items are added
+    size_t count = other->size;
+    aaa_vec_reserve(vec, (int64_t)(vec->size + count));
+
+    for (size_t i = 0; i < count; i++) {
+        vec->items[vec->size++] = aaa_copy(other->items[i]);
+    }
+}
+
+aaa_value aaa_vec_slice(const aaa_vec *vec, int64_t start, int64_t end) {
+    int64_t size = (int64_t)vec->size;
+    start = start < 0 ? 0 : (start > size ? size : start);
+    end = end < start ? start : (end > size ? size : end);
+
+    aaa_value sliced = aaa_vec_new();
+    aaa_vec_reserve(sliced.vec, end - start);
+
+    for (int64_t i = start; i < end; i++) {
+        sliced.vec->items[sliced.vec->size++] = aaa_copy(vec->items[i]);
+    }
+
+    return sliced;
+}
+
+void aaa_vec_fill(aaa_vec *vec, int64_t count, aaa_value item) {
+    if (count <= 0) {
+        return;
+    }
+
+    aaa_vec_reserve(vec, (int64_t)vec->size + count);
+
+    for (int64_t i = 0; i < count; i++) {
+        vec->items[vec->size++] = aaa_copy(item);
+    }
+}
+
+static uint64_t aaa_hash(aaa_value key) {
+    uint64_t hash;
+
+    switch (key.kind) {
+    case AAA_STR:
+        // FNV-1a
+        hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < key.str->length; i++) {
+            hash ^= (unsigned char)key.str->data[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    case AAA_BOOL:
+        hash = key.boolean;
+        break;
+    default:
+        hash = (uint64_t)key.integer;
+        break;
+    }
+
+    // splitmix64 finalizer
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+static bool aaa_key_equals(aaa_value a, aaa_value b) {
+    switch (a.kind) {
+    case AAA_STR:
+        return aaa_str_equals(a.str, b.str);
+    case AAA_BOOL:
+        return a.boolean == b.boolean;
+    case AAA_INT:
+        return a.integer == b.integer;
+    default:
+        aaa_error("Unsupported map key type");
+        return false;
+    }
+}
+
+aaa_value aaa_map_new(aaa_kind key_kind, aaa_kind value_kind) {
+    aaa_map *map = aaa_alloc(sizeof(aaa_map));
+    map->entries = NULL;
+    map->entry_count = 0;
+    map->entry_capacity = 0;
+    map->size = 0;
+    map->index = NULL;
+    map->index_capacity = 0;
+    map->shared = false;
+    map->key_kind = key_kind;
+    map->value_kind = value_kind;
+
+    aaa_value value = {.kind = AAA_MAP, .map = map};
+    return value;
+}
+
+// Returns offset in map->index, which either points to entry for key or is -1
+static size_t aaa_map_find(const aaa_map *map, aaa_value key, uint64_t hash) {
+    size_t mask = map->index_capacity - 1;
+    size_t slot = hash & mask;
+
+    while (map->index[slot] != -1) {
+        const aaa_map_entry *entry = &map->entries[map->index[slot]];
+
+        if (!entry->deleted && entry->hash == hash && aaa_key_equals(entry->key, key)) {
+            break;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+// Called before every change to a map, so iterators never see it
+static void aaa_map_unshare(aaa_map *map) {
+    if (!map->shared) {
+        return;
+    }
+
+    aaa_map_entry *entries = aaa_alloc(map->entry_capacity * sizeof(aaa_map_entry));
+    memcpy(entries, map->entries, map->entry_count * sizeof(aaa_map_entry));
+
+    map->entries = entries;
+    map->shared = false;
+}
+
+static void aaa_map_resize(aaa_map *map) {
+    // Remove deleted entries
+    size_t entry_count = 0;
+
+    for (size_t i = 0; i < map->entry_count; i++) {
+        if (!map->entries[i].deleted) {
+            map->entries[entry_count++] = map->entries[i];
+        }
+    }
+
+    map->entry_count = entry_count;
+
+    // Keep index at most half full
+    size_t index_capacity = 8;
+    while (index_capacity < 4 * (entry_count + 1)) {
+        index_capacity *= 2;
+    }
+
+    free(map->index);
+    map->index = aaa_alloc(index_capacity * sizeof(int64_t));
+    map->index_capacity = index_capacity;
+
+    for (size_t i = 0; i < index_capacity; i++) {
+        map->index[i] = -1;
+    }
+
+    for (size_t i = 0; i < entry_count; i++) {
+        size_t slot = aaa_map_find(map, map->entries[i].key, map->entries[i].hash);
+        map->index[slot] = (int64_t)i;
+    }
+
+    map->entry_capacity = index_capacity / 2;
+    map->entries =
+        aaa_realloc(map->entries, map->entry_capacity * sizeof(aaa_map_entry));
+}
+
+static const aaa_map_entry *aaa_map_lookup(const aaa_map *map, aaa_value key) {
+    if (map->size == 0) {
+        return NULL;
+    }
+
+    size_t slot = aaa_map_find(map, key, aaa_hash(key));
+
+    if (map->index[slot] == -1) {
+        return NULL;
+    }
+
+    return &map->entries[map->index[slot]];
+}
+
+aaa_value aaa_map_get(const aaa_map *map, aaa_value key) {
+    const aaa_map_entry *entry = aaa_map_lookup(map, key);
+
+    if (!entry) {
+        aaa_error("map:get with key that is not in map");
+    }
+
+    return entry->value;
+}
+
+void aaa_map_set(aaa_map *map, aaa_value key, aaa_value value) {
+    aaa_map_unshare(map);
+    map->key_kind = key.kind;
+    map->value_kind = value.kind;
+
+    if (map->entry_count == map->entry_capacity) {
+        aaa_map_resize(map);
+    }
+
+    uint64_t hash = aaa_hash(key);
+    size_t slot = aaa_map_find(map, key, hash);
+
+    if (map->index[slot] != -1) {
+        map->entries[map->index[slot]].value = value;
+        return;
+    }
+
+    aaa_map_entry *entry = &map->entries[map->entry_count];
+    entry->key = key;
+    entry->value = value;
+    entry->hash = hash;
+    entry->deleted = false;
+
+    map->index[slot] = (int64_t)map->entry_count++;
+    map->size++;
+}
+
+bool aaa_map_has_key(const aaa_map *map, aaa_value key) {
+    return aaa_map_lookup(map, key) != NULL;
+}
+
+int64_t aaa_map_size(const aaa_map *map) { return (int64_t)map->size; }
+
+aaa_value aaa_map_pop(aaa_map *map, aaa_value key) {
+    aaa_map_unshare(map);
+    aaa_map_entry *entry = (aaa_map_entry *)aaa_map_lookup(map, key);
+
+    if (!entry) {
+        aaa_error("map:pop with key that is not in map");
+    }
+
+    entry->deleted = true;
+    map->size--;
+    return entry->value;
+}
+
+void aaa_map_drop(aaa_map *map, aaa_value key) {
+    aaa_map_unshare(map);
+    aaa_map_entry *entry = (aaa_map_entry *)aaa_map_lookup(map, key);
+
+    if (!entry) {
+        aaa_error("map:drop with key that is not in map");
+    }
+
+    entry->deleted = true;
+    map->size--;
+}
+
+void aaa_map_clear(aaa_map *map) {
+    aaa_map_unshare(map);
+    map->entry_count = 0;
+    map->size = 0;
+
+    for (size_t i = 0; i < map->index_capacity; i++) {
+        map->index[i] = -1;
+    }
+}
+
+aaa_value aaa_map_iterate(aaa_map *map, aaa_iter_view view) {
+    aaa_iter *iter = aaa_alloc(sizeof(aaa_iter));
+    iter->entries = map->entries;
+    iter->entry_count = map->entry_count;
+    iter->position = 0;
+    iter->view = view;
+    iter->key_kind = map->key_kind;
+    iter->value_kind = map->value_kind;
+
+    // Without entries there is nothing to protect
+    if (map->entry_count) {
+        map->shared = true;
+    }
+
+    aaa_kind kind = view == AAA_ITEMS ? AAA_MAP_ITER : AAA_ITER;
+    aaa_value value = {.kind = kind, .iter = iter};
+    return value;
+}
+
+static const aaa_map_entry *aaa_iter_advance(aaa_iter *iter) {
+    while (iter->position < iter->entry_count) {
+        const aaa_map_entry *entry = &iter->entries[iter->position++];
+
+        if (!entry->deleted) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+bool aaa_iter_next(aaa_iter *iter, aaa_value *item, aaa_kind kind) {
+    const aaa_map_entry *entry = aaa_iter_advance(iter);
+
+    if (!entry) {
+        *item = aaa_zero(kind);
+        return false;
+    }
+
+    *item = iter->view == AAA_VALUES ? entry->value : entry->key;
+    return true;
+}
+
+bool aaa_map_iter_next(aaa_iter *iter, aaa_value *key, aaa_value *value,
+                       aaa_kind key_kind, aaa_kind value_kind) {
+    const aaa_map_entry *entry = aaa_iter_advance(iter);
+
+    if (!entry) {
+        *key = aaa_zero(key_kind);
+        *value = aaa_zero(value_kind);
+        return false;
+    }
+
+    *key = entry->key;
+    *value = entry->value;
+    return true;
+}
+
+aaa_kind aaa_iter_item_kind(const aaa_iter *iter) {
+    return iter->view == AAA_VALUES ? iter->value_kind : iter->key_kind;
+}
+
+aaa_kind aaa_iter_value_kind(const aaa_iter *iter) { return iter->value_kind; }
+
+aaa_value aaa_set_new(void) {
+    aaa_value value = aaa_map_new(AAA_INT, AAA_BOOL);
+    value.kind = AAA_SET;
+    return value;
+}
+
+void aaa_set_add(aaa_map *set, aaa_value item) {
+    aaa_map_set(set, item, aaa_bool(true));
+}
+
+void aaa_set_drop(aaa_map *set, aaa_value item) {
+    aaa_map_unshare(set);
+    aaa_map_entry *entry = (aaa_map_entry *)aaa_map_lookup(set, item);
+
+    // Dropping an item that is not in the set does nothing
+    if (entry) {
+        entry->deleted = true;
+        set->size--;
+    }
+}
+
+// Files opened by the program, by handle. Handles of opened files start after the
+// ones of stdin, stdout and stderr.
+#define AAA_FIRST_FILE_HANDLE 3
+
+static FILE **aaa_files = NULL;
+static size_t aaa_file_capacity = 0;
+
+static FILE *aaa_file(int64_t fd) {
+    if (fd == 0) {
+        return stdin;
+    }
+
+    if (fd < 0 || (size_t)fd >= aaa_file_capacity) {
+        return NULL;
+    }
+
+    return aaa_files[fd];
+}
+
+static aaa_value aaa_owned_str(const char *data, size_t length) {
+    aaa_str *str = aaa_alloc(sizeof(aaa_str));
+    str->length = length;
+    str->data = data;
+    return aaa_str_value(str);
+}
+
+static aaa_value aaa_empty_str(void) {
+    static const aaa_str empty = {0, ""};
+    return aaa_str_value(&empty);
+}
+
+// Returns NUL terminated copy, for passing to the C library
+static char *aaa_c_string(const aaa_str *str) {
+    char *copied = aaa_alloc(str->length + 1);
+    memcpy(copied, str->data, str->length);
+    copied[str->length] = '\0';
+    return copied;
+}
+
+void aaa_sys_read_line(aaa_value *sp) {
+    FILE *file = aaa_file(sp[0].integer);
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length = file ? getline(&line, &capacity, file) : -1;
+
+    if (length < 0) {
+        free(line);
+        sp[0] = aaa_empty_str();
+        sp[1] = aaa_bool(false);
+        return;
+    }
+
+    // Python reads files with universal newlines, so \r\n is a line ending too
+    if (length && line[length - 1] == '\n') {
+        length--;
+        if (length && line[length - 1] == '\r') {
+            length--;
+        }
+    }
+
+    sp[0] = aaa_owned_str(line, (size_t)length);
+    sp[1] = aaa_bool(true);
+}
+
+void aaa_sys_read_chunk(aaa_value *sp) {
+    FILE *file = aaa_file(sp[0].integer);
+    int64_t size = sp[1].integer;
+
+    if (size <= 0) {
+        fflush(stdout);
+        fprintf(stderr, "Invalid argument for read_chunk: size %" PRId64
+                " is not positive\n", size);
+        exit(1);
+    }
+
+    aaa_value buffer = aaa_strbuf_new();
+    aaa_strbuf *chunk = buffer.strbuf;
+
+    // Sizes count characters like Python, so read up to the next UTF-8 lead byte
+    while (file) {
+        int c = getc(file);
+
+        if (c == EOF) {
+            break;
+        }
+
+        if ((c & 0xC0) != 0x80 && (int64_t)chunk->char_count == size) {
+            ungetc(c, file);
+            break;
+        }
+
+        char byte = (char)c;
+        const aaa_str str = {1, &byte};
+        aaa_strbuf_append(chunk, &str);
+    }
+
+    sp[0] = aaa_owned_str(chunk->data ? chunk->data : "", chunk->length);
+    sp[1] = aaa_bool(chunk->length > 0);
+}
+
+void aaa_sys_open_file(aaa_value *sp) {
+    char *path = aaa_c_string(sp[0].str);
+    FILE *file = fopen(path, "r");
+    free(path);
+
+    if (!file) {
+        sp[0] = aaa_int(-1);
+        sp[1] = aaa_bool(false);
+        return;
+    }
+
+    // Handles are not file descriptors, which can be 0 when stdin was closed
+    size_t handle = AAA_FIRST_FILE_HANDLE;
+    while (handle < aaa_file_capacity && aaa_files[handle]) {
+        handle++;
+    }
+
+    if (handle >= aaa_file_capacity) {
+        size_t capacity = aaa_file_capacity ? aaa_file_capacity : 8;
+        while (capacity <= handle) {
+            capacity *= 2;
+        }
+
+        aaa_files = aaa_realloc(aaa_files, capacity * sizeof(FILE *));
+        for (size_t i = aaa_file_capacity; i < capacity; i++) {
+            aaa_files[i] = NULL;
+        }
+        aaa_file_capacity = capacity;
+    }
+
+    aaa_files[handle] = file;
+    sp[0] = aaa_int((int64_t)handle);
+    sp[1] = aaa_bool(true);
+}
+
+void aaa_sys_close_file(aaa_value *sp) {
+    int64_t fd = sp[0].integer;
+
+    // Only files opened by the program can be closed
+    FILE *file = fd == 0 ? NULL : aaa_file(fd);
+
+    if (file) {
+        fclose(file);
+        aaa_files[fd] = NULL;
+    }
+
+    sp[0] = aaa_bool(file != NULL);
+}
+
+void aaa_sys_read_file(aaa_value *sp) {
+    char *path = aaa_c_string(sp[0].str);
+    int fd = open(path, O_RDONLY);
+    free(path);
+
+    struct stat info;
+
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        sp[0] = aaa_empty_str();
+        sp[1] = aaa_bool(false);
+        return;
+    }
+
+    if (info.st_size == 0) {
+        close(fd);
+        sp[0] = aaa_empty_str();
+        sp[1] = aaa_bool(true);
+        return;
+    }
+
+    // Strings are never freed, so the mapping can be used as string data directly
+    size_t size = (size_t)info.st_size;
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapped == MAP_FAILED) {
+        sp[0] = aaa_empty_str();
+        sp[1] = aaa_bool(false);
+        return;
+    }
+
+    sp[0] = aaa_owned_str(mapped, size);
+    sp[1] = aaa_bool(true);
+}
+
+aaa_value aaa_struct_new(const aaa_struct_type *type) {
+    size_t size = sizeof(aaa_struct) + type->field_count * sizeof(aaa_value);
+    aaa_struct *structure = aaa_alloc(size);
+    structure->type = type;
+
+    for (size_t i = 0; i < type->field_count; i++) {
+        structure->fields[i] = aaa_zero(type->fields[i].kind);
+    }
+
+    aaa_value value = {.kind = AAA_STRUCT, .structure = structure};
+    return value;
+}
+
+static void aaa_struct_check(const aaa_struct *structure) {
+    if (!structure) {
+        aaa_error("Struct field of uninitialized struct");
+    }
+}
+
+aaa_value aaa_struct_get(const aaa_struct *structure, size_t slot) {
+    aaa_struct_check(structure);
+    return structure->fields[slot];
+}
+
+void aaa_struct_set(aaa_struct *structure, size_t slot, aaa_value value) {
+    aaa_struct_check(structure);
+    structure->fields[slot] = value;
+}
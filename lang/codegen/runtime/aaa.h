@@ -0,0 +1,180 @@
+// Runtime library for Aaa programs compiled to C by lang/codegen.
+//
+// Values are tagged, so printing and hashing work without knowing the type
+// statically. Containers and strings are allocated on the heap and never freed.
+
+#ifndef AAA_H
+#define AAA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum aaa_kind {
+    AAA_INT,
+    AAA_BOOL,
+    AAA_STR,
+    AAA_VEC,
+    AAA_MAP,
+    AAA_SET,
+    AAA_ITER,
+    AAA_MAP_ITER,
+    AAA_STRBUF,
+    AAA_STRUCT,
+} aaa_kind;
+
+typedef struct aaa_str {
+    size_t length;
+    const char *data;
+} aaa_str;
+
+typedef struct aaa_vec aaa_vec;
+typedef struct aaa_map aaa_map;
+typedef struct aaa_iter aaa_iter;
+typedef struct aaa_strbuf aaa_strbuf;
+typedef struct aaa_struct aaa_struct;
+typedef struct aaa_struct_type aaa_struct_type;
+
+typedef struct aaa_value {
+    aaa_kind kind;
+    union {
+        int64_t integer;
+        bool boolean;
+        const aaa_str *str;
+        aaa_vec *vec;
+        // Also used by sets, which are maps with unused values
+        aaa_map *map;
+        // Used by both kinds of iterators
+        aaa_iter *iter;
+        aaa_strbuf *strbuf;
+        aaa_struct *structure;
+    };
+} aaa_value;
+
+typedef struct aaa_field {
+    aaa_str name;
+    aaa_kind kind;
+} aaa_field;
+
+struct aaa_struct_type {
+    const char *name;
+    size_t field_count;
+    const aaa_field *fields;
+};
+
+// Running function, used to print a stack trace when an assertion fails
+typedef struct aaa_frame {
+    const char *function_name;
+    const char *const *argument_names;
+    const aaa_value *arguments;
+    size_t argument_count;
+    struct aaa_frame *caller;
+} aaa_frame;
+
+extern aaa_frame *aaa_call_stack;
+
+static inline aaa_value aaa_int(int64_t integer) {
+    aaa_value value = {.kind = AAA_INT, .integer = integer};
+    return value;
+}
+
+static inline aaa_value aaa_bool(bool boolean) {
+    aaa_value value = {.kind = AAA_BOOL, .boolean = boolean};
+    return value;
+}
+
+static inline aaa_value aaa_str_value(const aaa_str *str) {
+    aaa_value value = {.kind = AAA_STR, .str = str};
+    return value;
+}
+
+// Python-style floor division and modulo: y is replaced by the result and x by
+// whether it succeeded. Division by zero gives 0 and false.
+void aaa_divide(aaa_value *y, aaa_value *x);
+void aaa_modulo(aaa_value *y, aaa_value *x);
+
+const aaa_str *aaa_str_concat(const aaa_str *a, const aaa_str *b);
+bool aaa_str_equals(const aaa_str *a, const aaa_str *b);
+
+// Growable buffer to build strings in O(n), sizes count characters like Python
+aaa_value aaa_strbuf_new(void);
+void aaa_strbuf_append(aaa_strbuf *buffer, const aaa_str *str);
+const aaa_str *aaa_strbuf_to_str(const aaa_strbuf *buffer);
+int64_t aaa_strbuf_size(const aaa_strbuf *buffer);
+
+void aaa_print(aaa_value value);
+void aaa_assertion_failure(void);
+void aaa_not_implemented(const char *name);
+
+// Returns value that behaves like a deep copy
+aaa_value aaa_copy(aaa_value value);
+
+// Returns value a container or struct field of kind has before it is set
+aaa_value aaa_zero(aaa_kind kind);
+
+aaa_value aaa_vec_new(void);
+void aaa_vec_push(aaa_vec *vec, aaa_value item);
+aaa_value aaa_vec_pop(aaa_vec *vec);
+aaa_value aaa_vec_get(const aaa_vec *vec, int64_t index);
+void aaa_vec_set(aaa_vec *vec, int64_t index, aaa_value item);
+int64_t aaa_vec_size(const aaa_vec *vec);
+void aaa_vec_clear(aaa_vec *vec);
+
+// Bulk operations, items are copied with aaa_copy. Out of range slice bounds are
+// clamped and a negative count fills nothing.
+void aaa_vec_extend(aaa_vec *vec, const aaa_vec *other);
+aaa_value aaa_vec_slice(const aaa_vec *vec, int64_t start, int64_t end);
+void aaa_vec_fill(aaa_vec *vec, int64_t count, aaa_value item);
+void aaa_vec_reserve(aaa_vec *vec, int64_t capacity);
+
+// Kinds of keys and values are only used for the zero values at the end of
+// iterators in functions with placeholder types, see aaa_iter_item_kind()
+aaa_value aaa_map_new(aaa_kind key_kind, aaa_kind value_kind);
+aaa_value aaa_map_get(const aaa_map *map, aaa_value key);
+void aaa_map_set(aaa_map *map, aaa_value key, aaa_value value);
+bool aaa_map_has_key(const aaa_map *map, aaa_value key);
+int64_t aaa_map_size(const aaa_map *map);
+aaa_value aaa_map_pop(aaa_map *map, aaa_value key);
+void aaa_map_drop(aaa_map *map, aaa_value key);
+void aaa_map_clear(aaa_map *map);
+
+typedef enum aaa_iter_view {
+    AAA_KEYS,
+    AAA_VALUES,
+    AAA_ITEMS,
+} aaa_iter_view;
+
+// Iterators go over the map as it was when they were created: the first change to
+// the map after that copies its entries.
+aaa_value aaa_map_iterate(aaa_map *map, aaa_iter_view view);
+
+// Return whether there was a next item. At the end items are set to the zero
+// value of the kinds that are passed.
+bool aaa_iter_next(aaa_iter *iter, aaa_value *item, aaa_kind kind);
+bool aaa_map_iter_next(aaa_iter *iter, aaa_value *key, aaa_value *value,
+                       aaa_kind key_kind, aaa_kind value_kind);
+
+// Kinds of items of the map an iterator was created from, for when they are not
+// known at compile time. Map iterators give keys and values.
+aaa_kind aaa_iter_item_kind(const aaa_iter *iter);
+aaa_kind aaa_iter_value_kind(const aaa_iter *iter);
+
+// Other set operations use the aaa_map functions
+aaa_value aaa_set_new(void);
+void aaa_set_add(aaa_map *set, aaa_value item);
+void aaa_set_drop(aaa_map *set, aaa_value item);
+
+// Input, used by the SysCall instruction. Like Aaa functions they get arguments
+// at sp and write return values there, see builtins.aaa for their signatures.
+void aaa_sys_read_line(aaa_value *sp);
+void aaa_sys_read_chunk(aaa_value *sp);
+void aaa_sys_open_file(aaa_value *sp);
+void aaa_sys_close_file(aaa_value *sp);
+void aaa_sys_read_file(aaa_value *sp);
+
+aaa_value aaa_struct_new(const aaa_struct_type *type);
+// Fields are found by their index in the struct type, which is known statically
+aaa_value aaa_struct_get(const aaa_struct *structure, size_t slot);
+void aaa_struct_set(aaa_struct *structure, size_t slot, aaa_value value);
+
+#endif
@@ -1,5 +1,5 @@
 from pathlib import Path
-from typing import Sequence
+from typing import Any, Sequence, Tuple
 
 from lark.lexer import Token
 
@@ -7,7 +7,10 @@ from lang.typing.types import TypePlaceholder, VariableType
 
 
 class AaaException(Exception):
-    ...
+    def __reduce__(self) -> Tuple[Any, ...]:
+        # Subclasses take keyword arguments that are not stored in self.args, which
+        # breaks the default pickling. Errors are pickled by worker processes.
+        return (type(self).__new__, (type(self),), self.__dict__)
 
 
 class AaaLoadException(AaaException):
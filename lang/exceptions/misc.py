@@ -2,7 +2,8 @@ from pathlib import Path
 
 from lark.exceptions import UnexpectedInput
 
-from lang.exceptions import AaaLoadException
+from lang.exceptions import AaaException, AaaLoadException, error_location
+from lang.models.parse import Function
 
 
 class MainFunctionNotFound(AaaLoadException):
@@ -22,14 +23,59 @@ class MissingEnvironmentVariable(AaaLoadException):
 
 
 class AaaParseException(AaaLoadException):
-    def __init__(self, *, file: Path, parse_error: UnexpectedInput) -> None:
+    def __init__(self, *, file: Path, parse_error: UnexpectedInput, code: str) -> None:
         self.parse_error = parse_error
         self.file = file
 
+        # The file can be changed or not be saved yet, as in an editor
+        self.code = code
+
     def where(self) -> str:
         return f"{self.file}:{self.parse_error.line}:{self.parse_error.column}"
 
     def __str__(self) -> str:
-        context = self.parse_error.get_context(self.file.read_text())
+        context = self.parse_error.get_context(self.code)
 
         return f"{self.where()}: Could not parse file\n" + context
+
+
+class StackHeightExceeded(AaaException):
+    """
+    Raised by the CGenerator when instructions would use more stack slots than the
+    TypeChecker found for the function. Generated code would overflow its fixed
+    size stack, so this is always a bug in the interpreter.
+    """
+
+    def __init__(
+        self, *, file: Path, function: Function, depth: int, stack_height: int
+    ) -> None:
+        self.file = file
+        self.function = function
+        self.depth = depth
+        self.stack_height = stack_height
+
+    def __str__(self) -> str:
+        return (
+            f"{error_location(self.file, self.function.token)}: Function "
+            + f"{self.function.name} uses {self.depth} stack slots, but only "
+            + f"{self.stack_height} were reserved in compiled code"
+        )
+
+
+class IntegerOutOfRange(AaaException):
+    """
+    Raised by the CGenerator for integers that compiled code can't hold. The
+    PeepholeOptimizer can also create these when folding constants.
+    """
+
+    def __init__(self, *, file: Path, function: Function, value: int) -> None:
+        self.file = file
+        self.function = function
+        self.value = value
+
+    def __str__(self) -> str:
+        return (
+            f"{error_location(self.file, self.function.token)}: Function "
+            + f"{self.function.name} uses integer {self.value}, which does not fit "
+            + "in the 64 bits of compiled code"
+        )
@@ -2,6 +2,28 @@ from typing import List
 
 from lang.exceptions import AaaRuntimeException
 from lang.models.runtime import CallStackItem
+from lang.typing.types import repr_value
+
+
+def format_call_stack(call_stack: List[CallStackItem]) -> str:
+    msg = ""
+
+    for call_stack_item in call_stack:
+        function = call_stack_item.function
+        name = function.name
+
+        args = ""
+        if call_stack_item.argument_values:
+            args = ", arguments: " + ", ".join(
+                f"{argument.name}={repr_value(value)}"
+                for argument, value in zip(
+                    function.arguments, call_stack_item.argument_values
+                )
+            )
+
+        msg += f"- {name}{args}"
+
+    return msg
 
 
 class AaaAssertionFailure(AaaRuntimeException):
@@ -9,18 +31,37 @@ class AaaAssertionFailure(AaaRuntimeException):
         self.call_stack = call_stack
 
     def __str__(self) -> str:
-        msg = "Assertion failure, stacktrace:\n"
+        return "Assertion failure, stacktrace:\n" + format_call_stack(self.call_stack)
 
-        for call_stack_item in self.call_stack:
-            name = call_stack_item.function.name
 
-            args = ""
-            if call_stack_item.argument_values:
-                args = ", arguments: " + ", ".join(
-                    f"{name}={value.__repr__()}"
-                    for name, value in call_stack_item.argument_values.items()
-                )
+class AaaLimitExceeded(AaaRuntimeException):
+    """
+    Raised when a program runs longer or uses more memory than its Limits allow.
+    """
+
+    def __init__(
+        self, call_stack: List[CallStackItem], limit_name: str, limit: int
+    ) -> None:
+        self.call_stack = call_stack
+        self.limit_name = limit_name
+        self.limit = limit
+
+    def __str__(self) -> str:
+        return (
+            f"{self.limit_name} limit of {self.limit} exceeded, stacktrace:\n"
+            + format_call_stack(self.call_stack)
+        )
 
-            msg += f"- {name}{args}"
 
-        return msg
+class AaaInvalidArgument(AaaRuntimeException):
+    """
+    Raised by builtin functions for arguments that can never work, as opposed to
+    failures like a missing file, which return false.
+    """
+
+    def __init__(self, function_name: str, message: str) -> None:
+        self.function_name = function_name
+        self.message = message
+
+    def __str__(self) -> str:
+        return f"Invalid argument for {self.function_name}: {self.message}"
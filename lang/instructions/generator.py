@@ -1,5 +1,5 @@
 from pathlib import Path
-from typing import TYPE_CHECKING, Callable, Dict, List, Type
+from typing import TYPE_CHECKING, Callable, Dict, List, Tuple, Type
 
 from lang.instructions.types import (
     And,
@@ -8,14 +8,16 @@ from lang.instructions.types import (
     Divide,
     Drop,
     Dup,
-    Equals,
     GetStructField,
     Instruction,
+    IntEquals,
     IntGreaterEquals,
     IntGreaterThan,
     IntLessEquals,
     IntLessThan,
     IntNotEqual,
+    IntPlus,
+    IterNext,
     Jump,
     JumpIfNot,
     MapClear,
@@ -24,6 +26,8 @@ from lang.instructions.types import (
     MapEmpty,
     MapGet,
     MapHasKey,
+    MapItems,
+    MapIterNext,
     MapKeys,
     MapPop,
     MapSet,
@@ -36,26 +40,45 @@ from lang.instructions.types import (
     Not,
     Or,
     Over,
-    Plus,
     Print,
     PushBool,
     PushFunctionArgument,
     PushInt,
+    PushIterator,
     PushMap,
+    PushSet,
+    PushStrbuf,
     PushString,
     PushStruct,
     PushVec,
     Rot,
+    SetAdd,
+    SetClear,
+    SetDrop,
+    SetHas,
+    SetSize,
     SetStructField,
+    StrConcat,
+    StrEquals,
+    StrbufAppend,
+    StrbufSize,
+    StrbufToStr,
     Swap,
+    SysCall,
+    SysCallKind,
+    TailCall,
     VecClear,
     VecCopy,
     VecEmpty,
+    VecExtend,
+    VecFill,
     VecGet,
     VecPop,
     VecPush,
+    VecReserve,
     VecSet,
     VecSize,
+    VecSlice,
 )
 from lang.models.parse import (
     AaaTreeNode,
@@ -87,10 +110,8 @@ OPERATOR_INSTRUCTIONS: Dict[str, Instruction] = {
     "*": Multiply(),
     "/": Divide(),
     "%": Modulo(),
-    "+": Plus(),
     "<": IntLessThan(),
     "<=": IntLessEquals(),
-    "=": Equals(),
     ">": IntGreaterThan(),
     ">=": IntGreaterEquals(),
     "and": And(),
@@ -103,13 +124,18 @@ OPERATOR_INSTRUCTIONS: Dict[str, Instruction] = {
     "over": Over(),
     "rot": Rot(),
     "swap": Swap(),
+    "read_line": SysCall(kind=SysCallKind.READ_LINE),
+    "read_chunk": SysCall(kind=SysCallKind.READ_CHUNK),
+    "open_file": SysCall(kind=SysCallKind.OPEN_FILE),
+    "close_file": SysCall(kind=SysCallKind.CLOSE_FILE),
+    "read_file": SysCall(kind=SysCallKind.READ_FILE),
     "vec:clear": VecClear(),
     "vec:copy": VecCopy(),
+    "vec:extend": VecExtend(),
+    "vec:slice": VecSlice(),
+    "vec:fill": VecFill(),
+    "vec:reserve": VecReserve(),
     "vec:empty": VecEmpty(),
-    "vec:get": VecGet(),
-    "vec:pop": VecPop(),
-    "vec:push": VecPush(),
-    "vec:set": VecSet(),
     "vec:size": VecSize(),
     "map:get": MapGet(),
     "map:set": MapSet(),
@@ -122,6 +148,31 @@ OPERATOR_INSTRUCTIONS: Dict[str, Instruction] = {
     "map:copy": MapCopy(),
     "map:keys": MapKeys(),
     "map:values": MapValues(),
+    "map:items": MapItems(),
+    "strbuf:append": StrbufAppend(),
+    "strbuf:to_str": StrbufToStr(),
+    "strbuf:size": StrbufSize(),
+    "set:add": SetAdd(),
+    "set:has": SetHas(),
+    "set:drop": SetDrop(),
+    "set:size": SetSize(),
+    "set:clear": SetClear(),
+}
+
+# Vec member functions that depend on the item type
+VEC_ITEM_INSTRUCTIONS: Dict[str, Type[VecGet | VecPop | VecPush | VecSet]] = {
+    "vec:get": VecGet,
+    "vec:pop": VecPop,
+    "vec:push": VecPush,
+    "vec:set": VecSet,
+}
+
+# Operators with multiple signatures, selected by root type of their first argument
+TYPED_OPERATOR_INSTRUCTIONS: Dict[Tuple[str, RootType], Instruction] = {
+    ("+", RootType.INTEGER): IntPlus(),
+    ("+", RootType.STRING): StrConcat(),
+    ("=", RootType.INTEGER): IntEquals(),
+    ("=", RootType.STRING): StrEquals(),
 }
 
 
@@ -149,7 +200,48 @@ class InstructionGenerator:
         }
 
     def generate_instructions(self) -> List[Instruction]:
-        return self._generate_instructions(self.function.body, 0)
+        instructions = self._generate_instructions(self.function.body, 0)
+        return self._tail_calls(instructions)
+
+    def _tail_calls(self, instructions: List[Instruction]) -> List[Instruction]:
+        """
+        Replaces calls of this function after which it returns by TailCall.
+        """
+
+        name = self.function.identify()
+
+        for offset, instruction in enumerate(instructions):
+            if (
+                isinstance(instruction, CallFunction)
+                and instruction.file == self.file
+                and instruction.func_name == name
+                and self._returns_after(instructions, offset)
+            ):
+                instructions[offset] = TailCall(function=self.function)
+
+        return instructions
+
+    def _returns_after(self, instructions: List[Instruction], offset: int) -> bool:
+        """
+        Returns whether the instruction at offset is followed by the end of the
+        function, directly or through jumps out of branches.
+        """
+
+        offset += 1
+
+        while offset < len(instructions):
+            instruction = instructions[offset]
+
+            if not isinstance(instruction, Jump):
+                return False
+
+            # Jumping back is a loop, which doesn't end the function
+            if instruction.instruction_offset <= offset:
+                return False
+
+            offset = instruction.instruction_offset
+
+        return True
 
     def _generate_instructions(
         self, node: AaaTreeNode, offset: int
@@ -178,16 +270,25 @@ class InstructionGenerator:
         self, node: AaaTreeNode, offset: int
     ) -> List[Instruction]:
         assert isinstance(node, Operator)
-        return [OPERATOR_INSTRUCTIONS[node.value]]
+
+        if node.value in OPERATOR_INSTRUCTIONS:
+            return [OPERATOR_INSTRUCTIONS[node.value]]
+
+        # The TypeChecker stored which signature matched the stack for this operator
+        signature = self.program.operator_signatures[id(node)]
+        first_arg_type = signature.arg_types[0]
+        assert isinstance(first_arg_type, VariableType)
+
+        return [TYPED_OPERATOR_INSTRUCTIONS[(node.value, first_arg_type.root_type)]]
 
     def instructions_for_loop(
         self, node: AaaTreeNode, offset: int
     ) -> List[Instruction]:
         assert isinstance(node, Loop)
         condition_instructions = self._generate_instructions(node.condition, offset)
-        body_offset = offset + len(condition_instructions) + 2
+        body_offset = offset + len(condition_instructions) + 1
         body_instructions = self._generate_instructions(node.body, body_offset)
-        beyond_loop_end = body_offset + len(body_instructions)
+        beyond_loop_end = body_offset + len(body_instructions) + 1
 
         loop_instructions: List[Instruction] = []
 
@@ -205,9 +306,9 @@ class InstructionGenerator:
 
         identifier = node.name
 
-        for argument in self.function.arguments:
+        for arg_index, argument in enumerate(self.function.arguments):
             if node.name == argument.name:
-                return [PushFunctionArgument(arg_name=argument.name)]
+                return [PushFunctionArgument(arg_index=arg_index)]
 
         identified = self.program.identifiers[self.file][identifier]
 
@@ -221,7 +322,7 @@ class InstructionGenerator:
             source_file, original_name = self.program.get_function_source_and_name(
                 self.file, identifier
             )
-            return [CallFunction(func_name=original_name, file=source_file)]
+            return [self._call_function(source_file, original_name)]
         elif isinstance(identified, Struct):
             return [PushStruct(type=identified)]
         else:  # pragma: nocover
@@ -292,6 +393,15 @@ class InstructionGenerator:
                 )
             ]
 
+        elif root_type == RootType.SET:
+            return [PushSet(item_type=var_type.get_variable_type_param(0))]
+
+        elif root_type == RootType.STRING_BUFFER:
+            return [PushStrbuf()]
+
+        elif root_type in [RootType.ITERATOR, RootType.MAP_ITERATOR]:
+            return [PushIterator(type=var_type)]
+
         else:  # pragma: nocover
             assert False
 
@@ -300,10 +410,27 @@ class InstructionGenerator:
     ) -> List[Instruction]:
         assert isinstance(node, MemberFunctionName)
 
-        if node.type_name in ["vec", "map"]:
-            key = f"{node.type_name}:{node.func_name}"
+        key = f"{node.type_name}:{node.func_name}"
+
+        if key in VEC_ITEM_INSTRUCTIONS:
+            # Vec type is always returned first
+            vec_type = self.program.member_function_types[id(node)][0]
+            assert isinstance(vec_type, VariableType)
+            item_type = vec_type.type_params[0]
+            return [VEC_ITEM_INSTRUCTIONS[key](item_type=item_type)]
+
+        if node.type_name in ["vec", "map", "set", "strbuf"]:
             return [OPERATOR_INSTRUCTIONS[key]]
 
+        if node.type_name in ["iter", "map_iter"]:
+            # Next item types are needed for the zero values returned at the end
+            return_types = self.program.member_function_types[id(node)]
+            item_types = return_types[1:-1]
+
+            if node.type_name == "iter":
+                return [IterNext(item_type=item_types[0])]
+            return [MapIterNext(key_type=item_types[0], value_type=item_types[1])]
+
         member_function_name = f"{node.type_name}:{node.func_name}"
         identified = self.program.identifiers[self.file][member_function_name]
 
@@ -311,22 +438,23 @@ class InstructionGenerator:
         source_file, original_name = self.program.get_function_source_and_name(
             self.file, member_function_name
         )
-        return [CallFunction(func_name=original_name, file=source_file)]
+        return [self._call_function(source_file, original_name)]
+
+    def _call_function(self, source_file: Path, func_name: str) -> CallFunction:
+        function = self.program.get_identifier(source_file, func_name)
+        assert isinstance(function, Function)
+        return CallFunction(func_name=func_name, file=source_file, function=function)
 
     def instructions_for_struct_field_query(
         self, node: AaaTreeNode, offset: int
     ) -> List[Instruction]:
         assert isinstance(node, StructFieldQuery)
-        return [PushString(value=node.field_name.value), GetStructField()]
+        return [GetStructField(slot=self.program.struct_field_slots[id(node)])]
 
     def instructions_for_struct_field_update(
         self, node: AaaTreeNode, offset: int
     ) -> List[Instruction]:
         assert isinstance(node, StructFieldUpdate)
-        instructions: List[Instruction] = []
-        instructions += [PushString(value=node.field_name.value)]
-        instructions += self.instructions_for_function_body(
-            node.new_value_expr, offset + 1
-        )
-        instructions += [SetStructField()]
+        instructions = self.instructions_for_function_body(node.new_value_expr, offset)
+        instructions += [SetStructField(slot=self.program.struct_field_slots[id(node)])]
         return instructions
@@ -0,0 +1,261 @@
+import operator
+from typing import Callable, Dict, List, Optional, Set, Tuple, Type
+
+from lang.instructions.types import (
+    Drop,
+    Dup,
+    Dup2,
+    Instruction,
+    IntEquals,
+    IntGreaterEquals,
+    IntGreaterThan,
+    IntLessEquals,
+    IntLessThan,
+    IntNotEqual,
+    IntPlus,
+    IntPlusImmediate,
+    Jump,
+    JumpIfNot,
+    JumpIfNotIntEquals,
+    JumpIfNotIntGreaterEquals,
+    JumpIfNotIntGreaterThan,
+    JumpIfNotIntLessEquals,
+    JumpIfNotIntLessThan,
+    JumpIfNotIntNotEqual,
+    Minus,
+    Multiply,
+    Nop,
+    Over,
+    PushBool,
+    PushInt,
+    PushString,
+    Swap,
+)
+
+JumpInstruction = (
+    Jump
+    | JumpIfNot
+    | JumpIfNotIntEquals
+    | JumpIfNotIntGreaterEquals
+    | JumpIfNotIntGreaterThan
+    | JumpIfNotIntLessEquals
+    | JumpIfNotIntLessThan
+    | JumpIfNotIntNotEqual
+)
+
+JUMP_INSTRUCTIONS = (
+    Jump,
+    JumpIfNot,
+    JumpIfNotIntEquals,
+    JumpIfNotIntGreaterEquals,
+    JumpIfNotIntGreaterThan,
+    JumpIfNotIntLessEquals,
+    JumpIfNotIntLessThan,
+    JumpIfNotIntNotEqual,
+)
+
+# Integer operations that are computed at compile time if both operands are literals
+FOLDABLE_INT_OPERATIONS: Dict[Type[Instruction], Callable[[int, int], int | bool]] = {
+    IntPlus: operator.add,
+    Minus: operator.sub,
+    Multiply: operator.mul,
+    IntEquals: operator.eq,
+    IntNotEqual: operator.ne,
+    IntLessThan: operator.lt,
+    IntLessEquals: operator.le,
+    IntGreaterThan: operator.gt,
+    IntGreaterEquals: operator.ge,
+}
+
+# Comparisons directly followed by a JumpIfNot are merged into one instruction
+FUSED_CONDITIONAL_JUMPS: Dict[Type[Instruction], Type[JumpInstruction]] = {
+    IntEquals: JumpIfNotIntEquals,
+    IntNotEqual: JumpIfNotIntNotEqual,
+    IntLessThan: JumpIfNotIntLessThan,
+    IntLessEquals: JumpIfNotIntLessEquals,
+    IntGreaterThan: JumpIfNotIntGreaterThan,
+    IntGreaterEquals: JumpIfNotIntGreaterEquals,
+}
+
+# Pairs of instructions that together don't do anything
+NO_OP_PAIRS: List[Tuple[Type[Instruction], Type[Instruction]]] = [
+    (Swap, Swap),
+    (Dup, Drop),
+    (PushInt, Drop),
+    (PushBool, Drop),
+    (PushString, Drop),
+]
+
+
+class PeepholeOptimizer:
+    """
+    Rewrites the instructions of one function into an equivalent shorter list.
+
+    Rewrites are applied until nothing changes anymore. A sequence of instructions
+    is only merged if no jump lands in the middle of it. Jump offsets are relocated
+    after every pass.
+    """
+
+    def __init__(self, instructions: List[Instruction]) -> None:
+        self.instructions = list(instructions)
+
+    def optimize(self) -> List[Instruction]:
+        while True:
+            threaded = self._thread_jumps()
+            rewritten = self._rewrite()
+
+            if not (threaded or rewritten):
+                return self.instructions
+
+    def _jump_targets(self) -> Set[int]:
+        return {
+            instruction.instruction_offset
+            for instruction in self.instructions
+            if isinstance(instruction, JUMP_INSTRUCTIONS)
+        }
+
+    def _thread_jumps(self) -> bool:
+        """
+        Makes jumps that land on a Jump go to the destination of that Jump instead.
+        """
+
+        changed = False
+
+        for offset, instruction in enumerate(self.instructions):
+            if not isinstance(instruction, JUMP_INSTRUCTIONS):
+                continue
+
+            target = instruction.instruction_offset
+            visited: Set[int] = set()
+
+            while target < len(self.instructions) and target not in visited:
+                target_instruction = self.instructions[target]
+
+                if not isinstance(target_instruction, Jump):
+                    break
+
+                visited.add(target)
+                target = target_instruction.instruction_offset
+
+            if target != instruction.instruction_offset:
+                self.instructions[offset] = type(instruction)(
+                    instruction_offset=target
+                )
+                changed = True
+
+        return changed
+
+    def _rewrite(self) -> bool:
+        jump_targets = self._jump_targets()
+        optimized: List[Instruction] = []
+
+        # Maps offsets in self.instructions to offsets in optimized
+        relocated_offsets: List[int] = []
+
+        changed = False
+        offset = 0
+
+        while offset < len(self.instructions):
+            rewrite = self._match(offset, jump_targets)
+
+            if rewrite:
+                replacement, consumed = rewrite
+                changed = True
+            else:
+                replacement, consumed = [self.instructions[offset]], 1
+
+            relocated_offsets += [len(optimized)] * consumed
+            optimized += replacement
+            offset += consumed
+
+        # Jumping to the end of the function is allowed
+        relocated_offsets.append(len(optimized))
+
+        for offset, instruction in enumerate(optimized):
+            if isinstance(instruction, JUMP_INSTRUCTIONS):
+                optimized[offset] = type(instruction)(
+                    instruction_offset=relocated_offsets[instruction.instruction_offset]
+                )
+
+        self.instructions = optimized
+        return changed
+
+    def _match(
+        self, offset: int, jump_targets: Set[int]
+    ) -> Optional[Tuple[List[Instruction], int]]:
+        """
+        Returns replacement for instructions starting at offset and how many
+        instructions it replaces, or None if nothing can be rewritten.
+        """
+
+        def window(length: int) -> List[Instruction]:
+            # Instructions after the first one can't be merged if a jump lands on them
+            instructions = self.instructions[offset : offset + length]
+
+            if len(instructions) < length:
+                return []
+
+            for i in range(offset + 1, offset + length):
+                if i in jump_targets:
+                    return []
+
+            return instructions
+
+        first = self.instructions[offset]
+
+        if isinstance(first, Nop):
+            return [], 1
+
+        if isinstance(first, (Jump, JumpIfNot)) and (
+            first.instruction_offset == offset + 1
+        ):
+            # Jumping to next instruction only needs to get rid of the condition
+            if isinstance(first, JumpIfNot):
+                return [Drop()], 1
+            return [], 1
+
+        if triple := window(3):
+            x, y, operation = triple
+            if (
+                isinstance(x, PushInt)
+                and isinstance(y, PushInt)
+                and type(operation) in FOLDABLE_INT_OPERATIONS
+            ):
+                folded = FOLDABLE_INT_OPERATIONS[type(operation)](x.value, y.value)
+
+                if type(folded) is bool:
+                    return [PushBool(value=folded)], 3
+                return [PushInt(value=folded)], 3
+
+        if pair := window(2):
+            first, second = pair
+
+            for no_op_pair in NO_OP_PAIRS:
+                if isinstance(first, no_op_pair[0]) and isinstance(
+                    second, no_op_pair[1]
+                ):
+                    return [], 2
+
+            if isinstance(first, Over) and isinstance(second, Over):
+                return [Dup2()], 2
+
+            if isinstance(first, PushInt) and isinstance(second, (IntPlus, Minus)):
+                value = first.value if isinstance(second, IntPlus) else -first.value
+                return [IntPlusImmediate(value=value)], 2
+
+            if isinstance(first, IntPlusImmediate) and isinstance(
+                second, IntPlusImmediate
+            ):
+                value = first.value + second.value
+
+                if value == 0:
+                    return [], 2
+                return [IntPlusImmediate(value=value)], 2
+
+            if type(first) in FUSED_CONDITIONAL_JUMPS and isinstance(
+                second, JumpIfNot
+            ):
+                fused_jump = FUSED_CONDITIONAL_JUMPS[type(first)]
+                return [fused_jump(instruction_offset=second.instruction_offset)], 2
+
+        return None
@@ -1,15 +1,21 @@
+from dataclasses import dataclass
+from enum import IntEnum, auto
 from pathlib import Path
+from typing import Dict, Final, Tuple
 
-from lang.models import AaaModel
-from lang.models.parse import Struct
-from lang.typing.types import VariableType
+from lang.models.parse import Function, Struct
+from lang.typing.types import SignatureItem, VariableType
 
 
-class Instruction(AaaModel):
-    class Config:
-        arbitrary_types_allowed = True  # TODO fix
+@dataclass(slots=True)
+class Instruction:
+    """
+    Instructions are plain slotted dataclasses instead of AaaModels: validating them
+    only slows down generating instructions and loading them from cache files.
+    """
 
 
+@dataclass(slots=True)
 class PushInt(Instruction):
     value: int
 
@@ -17,22 +23,32 @@ class PushInt(Instruction):
         return f"{type(self).__name__}({self.value})"
 
 
-class Plus(Instruction):
+@dataclass(slots=True)
+class IntPlus(Instruction):
     ...
 
 
+@dataclass(slots=True)
+class StrConcat(Instruction):
+    ...
+
+
+@dataclass(slots=True)
 class Minus(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class Multiply(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class Divide(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class PushBool(Instruction):
     value: bool
 
@@ -41,66 +57,87 @@ class PushBool(Instruction):
         return f"{type(self).__name__}({value})"
 
 
+@dataclass(slots=True)
 class And(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class Or(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class Not(Instruction):
     ...
 
 
-class Equals(Instruction):
+@dataclass(slots=True)
+class IntEquals(Instruction):
+    ...
+
+
+@dataclass(slots=True)
+class StrEquals(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class IntGreaterThan(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class IntGreaterEquals(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class IntLessThan(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class IntLessEquals(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class IntNotEqual(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class Drop(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class Dup(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class Swap(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class Over(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class Rot(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class Print(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class PushString(Instruction):
     value: str
 
@@ -108,22 +145,47 @@ class PushString(Instruction):
         return f'{type(self).__name__}("{self.value}")'
 
 
+@dataclass(slots=True)
 class Modulo(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class CallFunction(Instruction):
     func_name: str
     file: Path
 
+    # Called function, resolved by the InstructionGenerator
+    function: Function
+
     def __repr__(self) -> str:  # pragma: nocover
         return f"{type(self).__name__}('{self.func_name}')"
 
 
+@dataclass(slots=True)
+class TailCall(Instruction):
+    """
+    Call of the function containing it, right before that function returns. It
+    replaces the arguments and starts over in the same frame, so recursion like this
+    runs in constant space.
+    """
+
+    function: Function
+
+    def __repr__(self) -> str:  # pragma: nocover
+        return f"{type(self).__name__}('{self.function.identify()}')"
+
+
+@dataclass(slots=True)
 class PushFunctionArgument(Instruction):
-    arg_name: str
+    # Position of the argument in the function signature
+    arg_index: int
+
+    def __repr__(self) -> str:  # pragma: nocover
+        return f"{type(self).__name__}({self.arg_index})"
 
 
+@dataclass(slots=True)
 class Jump(Instruction):
     instruction_offset: int
 
@@ -131,6 +193,7 @@ class Jump(Instruction):
         return f"{type(self).__name__}({self.instruction_offset})"
 
 
+@dataclass(slots=True)
 class JumpIfNot(Instruction):
     instruction_offset: int
 
@@ -138,106 +201,321 @@ class JumpIfNot(Instruction):
         return f"{type(self).__name__}({self.instruction_offset})"
 
 
+@dataclass(slots=True)
 class Nop(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class Assert(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class PushVec(Instruction):
     item_type: VariableType
 
 
+@dataclass(slots=True)
 class PushMap(Instruction):
     key_type: VariableType
     value_type: VariableType
 
 
+@dataclass(slots=True)
 class VecPush(Instruction):
-    ...
+    # Vec instructions moving items in or out depend on how items are stored, see
+    # Variable. In functions with placeholder types the item type is a
+    # TypePlaceholder, then the storage is only known at runtime.
+    item_type: SignatureItem
 
 
+@dataclass(slots=True)
 class VecPop(Instruction):
-    ...
+    item_type: SignatureItem
 
 
+@dataclass(slots=True)
 class VecGet(Instruction):
-    ...
+    item_type: SignatureItem
 
 
+@dataclass(slots=True)
 class VecSet(Instruction):
-    ...
+    item_type: SignatureItem
 
 
+@dataclass(slots=True)
 class VecSize(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class VecEmpty(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class VecClear(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class VecCopy(Instruction):
     ...
 
 
+@dataclass(slots=True)
+class VecExtend(Instruction):
+    ...
+
+
+@dataclass(slots=True)
+class VecSlice(Instruction):
+    ...
+
+
+@dataclass(slots=True)
+class VecFill(Instruction):
+    ...
+
+
+@dataclass(slots=True)
+class VecReserve(Instruction):
+    ...
+
+
+@dataclass(slots=True)
 class MapGet(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class MapSet(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class MapHasKey(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class MapSize(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class MapEmpty(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class MapPop(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class MapDrop(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class MapClear(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class MapCopy(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class MapKeys(Instruction):
     ...
 
 
+@dataclass(slots=True)
 class MapValues(Instruction):
     ...
 
 
+@dataclass(slots=True)
+class MapItems(Instruction):
+    ...
+
+
+@dataclass(slots=True)
+class StrbufAppend(Instruction):
+    ...
+
+
+@dataclass(slots=True)
+class StrbufToStr(Instruction):
+    ...
+
+
+@dataclass(slots=True)
+class StrbufSize(Instruction):
+    ...
+
+
+@dataclass(slots=True)
+class IterNext(Instruction):
+    # Zero value of this is returned at the end of the iterator. Python engines get
+    # it from the type of the iterator at runtime, because in functions with
+    # placeholder types this is a TypePlaceholder.
+    item_type: SignatureItem
+
+
+@dataclass(slots=True)
+class MapIterNext(Instruction):
+    # Like IterNext
+    key_type: SignatureItem
+    value_type: SignatureItem
+
+
+@dataclass(slots=True)
+class PushSet(Instruction):
+    item_type: VariableType
+
+
+@dataclass(slots=True)
+class PushStrbuf(Instruction):
+    ...
+
+
+@dataclass(slots=True)
+class PushIterator(Instruction):
+    # Iterator without items
+    type: VariableType
+
+
+@dataclass(slots=True)
+class SetAdd(Instruction):
+    ...
+
+
+@dataclass(slots=True)
+class SetHas(Instruction):
+    ...
+
+
+@dataclass(slots=True)
+class SetDrop(Instruction):
+    ...
+
+
+@dataclass(slots=True)
+class SetSize(Instruction):
+    ...
+
+
+@dataclass(slots=True)
+class SetClear(Instruction):
+    ...
+
+
+@dataclass(slots=True)
 class PushStruct(Instruction):
     type: Struct
 
 
+@dataclass(slots=True)
 class GetStructField(Instruction):
-    ...
+    # Index of field in the declared fields of the struct
+    slot: int
 
 
+@dataclass(slots=True)
 class SetStructField(Instruction):
+    # Index of field in the declared fields of the struct
+    slot: int
+
+
+class SysCallKind(IntEnum):
+    # Lowercase names are the names of the builtin functions and SysCalls methods
+    READ_LINE = auto()
+    READ_CHUNK = auto()
+    OPEN_FILE = auto()
+    CLOSE_FILE = auto()
+    READ_FILE = auto()
+
+
+# Number of arguments and return values of each SysCallKind
+SYS_CALL_STACK_EFFECTS: Final[Dict[SysCallKind, Tuple[int, int]]] = {
+    SysCallKind.READ_LINE: (1, 2),
+    SysCallKind.READ_CHUNK: (2, 2),
+    SysCallKind.OPEN_FILE: (1, 2),
+    SysCallKind.CLOSE_FILE: (1, 1),
+    SysCallKind.READ_FILE: (1, 2),
+}
+
+
+@dataclass(slots=True)
+class SysCall(Instruction):
+    kind: SysCallKind
+
+
+# Instructions below are only emitted by the PeepholeOptimizer
+
+
+@dataclass(slots=True)
+class IntPlusImmediate(Instruction):
+    value: int
+
+    def __repr__(self) -> str:  # pragma: nocover
+        return f"{type(self).__name__}({self.value})"
+
+
+@dataclass(slots=True)
+class Dup2(Instruction):
     ...
+
+
+@dataclass(slots=True)
+class JumpIfNotIntEquals(Instruction):
+    instruction_offset: int
+
+    def __repr__(self) -> str:  # pragma: nocover
+        return f"{type(self).__name__}({self.instruction_offset})"
+
+
+@dataclass(slots=True)
+class JumpIfNotIntNotEqual(Instruction):
+    instruction_offset: int
+
+    def __repr__(self) -> str:  # pragma: nocover
+        return f"{type(self).__name__}({self.instruction_offset})"
+
+
+@dataclass(slots=True)
+class JumpIfNotIntLessThan(Instruction):
+    instruction_offset: int
+
+    def __repr__(self) -> str:  # pragma: nocover
+        return f"{type(self).__name__}({self.instruction_offset})"
+
+
+@dataclass(slots=True)
+class JumpIfNotIntLessEquals(Instruction):
+    instruction_offset: int
+
+    def __repr__(self) -> str:  # pragma: nocover
+        return f"{type(self).__name__}({self.instruction_offset})"
+
+
+@dataclass(slots=True)
+class JumpIfNotIntGreaterThan(Instruction):
+    instruction_offset: int
+
+    def __repr__(self) -> str:  # pragma: nocover
+        return f"{type(self).__name__}({self.instruction_offset})"
+
+
+@dataclass(slots=True)
+class JumpIfNotIntGreaterEquals(Instruction):
+    instruction_offset: int
+
+    def __repr__(self) -> str:  # pragma: nocover
+        return f"{type(self).__name__}({self.instruction_offset})"
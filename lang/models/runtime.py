@@ -1,16 +1,38 @@
 from pathlib import Path
-from typing import Dict
+from typing import Any, Callable, List
 
-from lang.models import AaaModel
 from lang.models.parse import Function
-from lang.typing.types import Variable
 
 
-class CallStackItem(AaaModel):
-    class Config:
-        arbitrary_types_allowed = True  # TODO fix
+class CallStackItem:
+    """
+    One running Aaa function. This is created for every function call, so it is a
+    plain class with slots instead of an AaaModel.
+    """
 
-    function: Function
-    source_file: Path
-    instruction_pointer: int
-    argument_values: Dict[str, Variable]
+    __slots__ = (
+        "function",
+        "source_file",
+        "code",
+        "instruction_pointer",
+        "argument_values",
+    )
+
+    def __init__(
+        self,
+        function: Function,
+        source_file: Path,
+        code: List[Callable[[int], int]],
+        argument_values: List[Any],
+    ) -> None:
+        self.function = function
+        self.source_file = source_file
+
+        # Decoded instructions of function
+        self.code = code
+
+        # Offset of next instruction to run when this function continues
+        self.instruction_pointer = 0
+
+        # Values of arguments in the order of the function signature
+        self.argument_values = argument_values
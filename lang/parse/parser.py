@@ -1,6 +1,21 @@
+from pathlib import Path
+
 from lark.lark import Lark
 
-AAA_GRAMMAR_PATH = "lang/parse/aaa.lark"
+from lang.parse.transformer import AaaTransformer
+
+AAA_GRAMMAR_PATH = Path(__file__).parent / "aaa.lark"
+
+BUILTINS_FILE_ROOT = "builtins_file_root"
+REGULAR_FILE_ROOT = "regular_file_root"
 
-aaa_builtins_parser = Lark(open(AAA_GRAMMAR_PATH).read(), start="builtins_file_root")
-aaa_source_parser = Lark(open(AAA_GRAMMAR_PATH).read(), start="regular_file_root")
+# Built once per process and shared by all files. The LALR tables are cached in the
+# temp directory by Lark, so later processes don't need to build them again. The
+# transformer runs while parsing, so parse() returns models instead of a tree.
+aaa_parser = Lark(
+    AAA_GRAMMAR_PATH.read_text(),
+    start=[BUILTINS_FILE_ROOT, REGULAR_FILE_ROOT],
+    parser="lalr",
+    transformer=AaaTransformer(),
+    cache=True,
+)
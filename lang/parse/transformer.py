@@ -223,11 +223,15 @@ class AaaTransformer(Transformer[Any, Any]):
 
     # TODO the token and function name needs to be improved
     def member_function(
-        self, type_name: TypeLiteral, func_name: Identifier
+        self, type_name: Union[TypeLiteral, Identifier], func_name: Identifier
     ) -> MemberFunctionName:
-        return MemberFunctionName(
-            type_name=type_name.type_name, func_name=func_name.name
-        )
+        if isinstance(type_name, TypeLiteral):
+            name = type_name.type_name
+        else:
+            # Struct names are parsed as identifiers inside function bodies
+            name = type_name.name
+
+        return MemberFunctionName(type_name=name, func_name=func_name.name)
 
     def operator(self, token: Token) -> Operator:
         return Operator(value=token.value)
@@ -0,0 +1,95 @@
+from contextlib import redirect_stdout
+from io import StringIO
+from pathlib import Path
+from statistics import median
+from time import perf_counter
+from typing import Any, Dict, List
+
+from lang.runtime.profiler import Profiler
+from lang.runtime.program import Program
+from lang.runtime.simulator import Simulator
+
+BENCHMARKS_PATH = Path(__file__).parent.parent.parent / "benchmarks"
+
+
+def find_benchmarks() -> List[Path]:
+    return sorted(BENCHMARKS_PATH.glob("*.aaa"))
+
+
+def run_benchmark(
+    file: Path, warmup: int, repeat: int, optimize: bool = False
+) -> Dict[str, Any]:
+    """
+    Loads and runs an Aaa program in the Simulator and returns timings in seconds.
+    Output of the program is discarded.
+    """
+
+    start = perf_counter()
+    program = Program(file, optimize=optimize, use_cache=False)
+    load_time = perf_counter() - start
+
+    program.exit_on_error()
+
+    start = perf_counter()
+    Simulator(program)
+    decode_time = perf_counter() - start
+
+    run_times: List[float] = []
+
+    for run in range(warmup + repeat):
+        # Decoding is timed separately
+        simulator = Simulator(program)
+
+        with redirect_stdout(StringIO()):
+            start = perf_counter()
+            simulator.run(raise_=True)
+            run_time = perf_counter() - start
+
+        if run >= warmup:
+            run_times.append(run_time)
+
+    instruction_count = count_instructions(program)
+    median_time = median(run_times)
+
+    return {
+        "file": str(file),
+        "load": {
+            "total": load_time,
+            **program.load_times,
+            "decode": decode_time,
+        },
+        "run": {
+            "min": min(run_times),
+            "median": median_time,
+            "times": run_times,
+        },
+        "instructions": instruction_count,
+        "instructions_per_second": instruction_count / median_time,
+    }
+
+
+def count_instructions(program: Program) -> int:
+    """
+    Runs program once in the Profiler and returns the number of executed
+    instructions. This includes the implicit return at the end of each function.
+    """
+
+    profiler = Profiler(Simulator(program))
+
+    with redirect_stdout(StringIO()):
+        profiler.run(raise_=True)
+
+    return sum(profiler.instruction_counts().values())
+
+
+def run_benchmarks(
+    files: List[Path], warmup: int, repeat: int, optimize: bool = False
+) -> Dict[str, Any]:
+    return {
+        "optimize": optimize,
+        "warmup": warmup,
+        "repeat": repeat,
+        "benchmarks": [
+            run_benchmark(file, warmup, repeat, optimize) for file in files
+        ],
+    }
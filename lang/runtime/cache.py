@@ -0,0 +1,83 @@
+import os
+import pickle
+from hashlib import sha256
+from pathlib import Path
+from tempfile import NamedTemporaryFile
+from typing import Any, Optional
+
+# Change this when changes to the interpreter make cached files incompatible
+CACHE_VERSION = "12"
+
+CACHE_DIR_NAME = "__aaacache__"
+
+
+def content_hash(*parts: str) -> str:
+    hashed = sha256(CACHE_VERSION.encode())
+
+    for part in parts:
+        hashed.update(part.encode())
+        hashed.update(b"\0")
+
+    return hashed.hexdigest()
+
+
+def cache_file(source_file: Path, optimize: bool) -> Path:
+    suffix = ".optimized" if optimize else ""
+    return source_file.parent / CACHE_DIR_NAME / f"{source_file.name}{suffix}.pickle"
+
+
+def load_cache(file: Path, key: str) -> Optional[Any]:
+    """
+    Returns value saved in file with the same key, or None if there is none.
+
+    Cache files start with a header line holding the cache version, the key and
+    the hash of the pickled payload, which are all checked before unpickling.
+    This protects against stale and damaged files, not against malicious ones:
+    unpickling can run arbitrary code, so cache directories must be trusted.
+    """
+
+    try:
+        with open(file, "rb") as opened:
+            if not _owned_by_current_user(opened.fileno()):
+                return None
+
+            header = opened.readline().decode().split()
+            payload = opened.read()
+    except (OSError, UnicodeDecodeError):
+        return None
+
+    if header != [CACHE_VERSION, key, sha256(payload).hexdigest()]:
+        return None
+
+    try:
+        return pickle.loads(payload)
+    except Exception:
+        # Written by an incompatible version without bumping CACHE_VERSION
+        return None
+
+
+def save_cache(file: Path, key: str, value: Any) -> None:
+    payload = pickle.dumps(value)
+    header = f"{CACHE_VERSION} {key} {sha256(payload).hexdigest()}\n"
+
+    try:
+        file.parent.mkdir(exist_ok=True)
+
+        # Write to temporary file first, so concurrent runs never see partial files
+        with NamedTemporaryFile("wb", dir=file.parent, delete=False) as temp_file:
+            temp_file.write(header.encode())
+            temp_file.write(payload)
+
+        os.replace(temp_file.name, file)
+    except OSError:  # pragma: nocover
+        # Not being able to write the cache, for example in a read-only
+        # directory, only makes loading slower next time
+        pass
+
+
+def _owned_by_current_user(fd: int) -> bool:
+    # Files planted by other users in a shared directory are never loaded
+    if not hasattr(os, "getuid"):  # pragma: nocover
+        return True
+
+    return os.fstat(fd).st_uid == os.getuid()
@@ -1,21 +1,19 @@
-from typing import Optional
+from typing import Any, Optional
 
-from lang.typing.types import RootType, Variable
 
-
-def format_stack_item(var: Variable) -> str:  # pragma: nocover
+def format_stack_item(value: Any) -> str:  # pragma: nocover
     # TODO consider using __repr__() methods
 
-    if var.has_root_type(RootType.BOOL):
-        if var.value:
+    if type(value) is bool:
+        if value:
             return "true"
         return "false"
 
-    elif var.has_root_type(RootType.INTEGER):
-        return str(var.value)
+    elif type(value) is int:
+        return str(value)
 
-    elif var.has_root_type(RootType.STRING):
-        formatted = var.value.replace("\n", "\\n").replace('"', '\\"')
+    elif type(value) is str:
+        formatted = value.replace("\n", "\\n").replace('"', '\\"')
         return f'"{formatted}"'
 
     else:  # pragma: nocover
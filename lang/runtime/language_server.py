@@ -0,0 +1,218 @@
+import json
+import re
+import sys
+import traceback
+from pathlib import Path
+from typing import IO, Any, Dict, List, Optional, Set
+from urllib.parse import unquote, urlparse
+
+from lang.exceptions import AaaLoadException
+from lang.runtime.workspace import Workspace
+
+# Matches location at the start of error messages, like "/foo/main.aaa:3:17: ..."
+# Type errors put a space instead of ": " after the column
+ERROR_LOCATION = re.compile(
+    r"^(?P<file>[^:\n]+?)(:(?P<line>\d+):(?P<column>\d+):? |: )"
+)
+
+# Error codes defined by JSON-RPC
+PARSE_ERROR = -32700
+METHOD_NOT_FOUND = -32601
+INTERNAL_ERROR = -32603
+
+# Values defined by the Language Server Protocol
+FULL_TEXT_DOCUMENT_SYNC = 1
+ERROR_SEVERITY = 1
+
+
+class InvalidMessage(Exception):
+    ...
+
+
+class LanguageServer:
+    """
+    Minimal Language Server Protocol server, which reports errors of open files.
+
+    Editors send the full code of a file on every change, which is then checked by a
+    Workspace that stays loaded while the server runs. So only the changed file is
+    parsed again and only affected functions are type checked again.
+    """
+
+    def __init__(self, input: IO[bytes], output: IO[bytes]) -> None:
+        self.input = input
+        self.output = output
+
+        # Created when the first file is opened
+        self.workspace: Optional[Workspace] = None
+
+        # Files for which errors were published, so they can be cleared later
+        self.files_with_errors: Set[Path] = set()
+
+        self.shutdown_requested = False
+
+    def run(self) -> int:
+        """
+        Handles messages until the client exits, returns the exit code.
+        """
+
+        while True:
+            try:
+                message = self._read_message()
+            except InvalidMessage as e:
+                error = {"code": PARSE_ERROR, "message": str(e)}
+                self._send({"id": None, "error": error})
+                continue
+
+            if message is None or message.get("method") == "exit":
+                return 0 if self.shutdown_requested else 1
+
+            try:
+                self._handle(message)
+            except Exception as e:
+                # A bug or a malformed message must not end the editor session
+                print(f"Handling {message.get('method')} failed:", file=sys.stderr)
+                traceback.print_exc(file=sys.stderr)
+
+                if "id" in message:
+                    error = {"code": INTERNAL_ERROR, "message": repr(e)}
+                    self._send({"id": message["id"], "error": error})
+
+    def _read_message(self) -> Optional[Dict[str, Any]]:
+        content_length = 0
+        invalid_length: Optional[str] = None
+
+        while True:
+            header = self.input.readline()
+
+            if not header:
+                return None
+
+            header = header.strip()
+
+            if not header:
+                break
+
+            name, _, value = header.decode(errors="replace").partition(":")
+            if name.lower() == "content-length":
+                if value.strip().isdigit():
+                    content_length = int(value)
+                else:
+                    invalid_length = value.strip()
+
+        if invalid_length is not None:
+            # Where the body ends is unknown, so only the headers are skipped
+            raise InvalidMessage(f"Invalid Content-Length {invalid_length!r}")
+
+        try:
+            message = json.loads(self.input.read(content_length))
+        except ValueError:
+            raise InvalidMessage("Message is not valid JSON")
+
+        if not isinstance(message, dict):
+            raise InvalidMessage("Message is not a JSON object")
+
+        return message
+
+    def _send(self, message: Dict[str, Any]) -> None:
+        body = json.dumps({"jsonrpc": "2.0", **message}).encode()
+        self.output.write(f"Content-Length: {len(body)}\r\n\r\n".encode() + body)
+        self.output.flush()
+
+    def _handle(self, message: Dict[str, Any]) -> None:
+        method = message.get("method", "")
+        params = message.get("params", {})
+        result: Any = None
+
+        if method == "initialize":
+            result = {"capabilities": {"textDocumentSync": FULL_TEXT_DOCUMENT_SYNC}}
+
+        elif method == "shutdown":
+            self.shutdown_requested = True
+
+        elif method == "textDocument/didOpen":
+            document = params["textDocument"]
+            self._check(_uri_to_path(document["uri"]), document["text"])
+
+        elif method == "textDocument/didChange":
+            # Full sync was requested, so the last change has all code
+            code = params["contentChanges"][-1]["text"]
+            self._check(_uri_to_path(params["textDocument"]["uri"]), code)
+
+        elif method == "textDocument/didClose":
+            file = _uri_to_path(params["textDocument"]["uri"])
+
+            if self.workspace:
+                self.workspace.close(file)
+
+            self._publish(file, [])
+            self.files_with_errors.discard(file)
+
+        elif "id" in message:
+            error = {"code": METHOD_NOT_FOUND, "message": f"Unknown method {method}"}
+            self._send({"id": message["id"], "error": error})
+            return
+
+        # Responses are only sent for requests, which have an id
+        if "id" in message:
+            self._send({"id": message["id"], "result": result})
+
+    def _check(self, file: Path, code: str) -> None:
+        if not self.workspace:
+            self.workspace = Workspace(file)
+
+        self.workspace.open(file, code)
+        errors = self.workspace.check(file)
+
+        errors_by_file: Dict[Path, List[AaaLoadException]] = {
+            file: [] for file in self.files_with_errors
+        }
+        errors_by_file[file] = []
+
+        for error in errors:
+            error_file = Path(getattr(error, "file", file)).resolve()
+            errors_by_file.setdefault(error_file, []).append(error)
+
+        # Errors of files that are not open are shown too, they can break this file
+        for error_file, file_errors in errors_by_file.items():
+            self._publish(error_file, file_errors)
+
+        self.files_with_errors = {
+            error_file
+            for error_file, file_errors in errors_by_file.items()
+            if file_errors
+        }
+
+    def _publish(self, file: Path, errors: List[AaaLoadException]) -> None:
+        params = {
+            "uri": file.as_uri(),
+            "diagnostics": [_diagnostic(error) for error in errors],
+        }
+        self._send({"method": "textDocument/publishDiagnostics", "params": params})
+
+
+def _uri_to_path(uri: str) -> Path:
+    return Path(unquote(urlparse(uri).path)).resolve()
+
+
+def _diagnostic(error: AaaLoadException) -> Dict[str, Any]:
+    message = str(error).strip()
+    line = column = 1
+
+    match = ERROR_LOCATION.match(message)
+    if match:
+        message = message[match.end() :]
+
+        if match.group("line"):
+            line = int(match.group("line"))
+            column = int(match.group("column"))
+
+    # Positions in the protocol start at zero
+    position = {"line": line - 1, "character": column - 1}
+    end = {"line": line - 1, "character": column}
+
+    return {
+        "range": {"start": position, "end": end},
+        "severity": ERROR_SEVERITY,
+        "source": "aaa",
+        "message": message,
+    }
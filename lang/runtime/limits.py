@@ -0,0 +1,297 @@
+from typing import TYPE_CHECKING, Any, Callable, Iterable, List, Set
+
+from lang.exceptions.runtime import AaaLimitExceeded
+from lang.instructions.types import (
+    CallFunction,
+    Instruction,
+    Jump,
+    JumpIfNot,
+    JumpIfNotIntEquals,
+    JumpIfNotIntGreaterEquals,
+    JumpIfNotIntGreaterThan,
+    JumpIfNotIntLessEquals,
+    JumpIfNotIntLessThan,
+    JumpIfNotIntNotEqual,
+    TailCall,
+    VecExtend,
+    VecFill,
+    VecSlice,
+)
+from lang.models import AaaModel
+from lang.typing.types import ITERATOR_ROOT_TYPES, RootType, Variable
+
+if TYPE_CHECKING:  # pragma: nocover
+    from lang.runtime.simulator import Simulator
+
+JUMP_INSTRUCTIONS = (
+    Jump,
+    JumpIfNot,
+    JumpIfNotIntEquals,
+    JumpIfNotIntGreaterEquals,
+    JumpIfNotIntGreaterThan,
+    JumpIfNotIntLessEquals,
+    JumpIfNotIntLessThan,
+    JumpIfNotIntNotEqual,
+)
+
+
+class Limits(AaaModel):
+    """
+    Limits for running a program in the Simulator, 0 means unlimited.
+
+    Instructions are counted when jumping back to the start of a loop and when
+    calling a function, because only loops and recursion can make a program run
+    forever. Each time the size of the loop or function is charged, so the count is
+    an upper bound of the executed instructions. The other limits are checked every
+    check_interval charged instructions, the call depth also on every call.
+    """
+
+    max_instructions: int = 0
+    max_call_depth: int = 0
+    max_stack_size: int = 0
+
+    # Items in all containers reachable from the stack and function arguments
+    max_container_items: int = 0
+
+    # Number of charged instructions between checks, counting all container items
+    # takes time proportional to the number of containers
+    check_interval: int = 1000
+
+    def any(self) -> bool:
+        return any(
+            [
+                self.max_instructions,
+                self.max_call_depth,
+                self.max_stack_size,
+                self.max_container_items,
+            ]
+        )
+
+
+class LimitChecker:
+    """
+    Wraps decoded handlers of a Simulator in place, to raise AaaLimitExceeded when
+    the program exceeds its Limits. Only loops, calls and bulk vec operations are
+    wrapped, so the overhead is small.
+    """
+
+    def __init__(self, simulator: "Simulator", limits: Limits) -> None:
+        self.simulator = simulator
+        self.limits = limits
+
+        # Upper bound of the number of executed instructions, and the value at which
+        # to check limits next. These are lists so handlers can change them cheaply.
+        self.charged = [0]
+        self.next_check = [0]
+        self._schedule_check()
+
+        # Upper bound of container items, exact right after counting them
+        self.container_items = 0
+
+        for file, functions in simulator.decoded_functions.items():
+            for name, code in functions.items():
+                instructions = simulator.program.function_instructions[file][name]
+
+                # Lists are replaced in place, because CallFunction handlers refer
+                # to them
+                code[:] = [
+                    self._wrap(handler, instructions, ip)
+                    for ip, handler in enumerate(code)
+                ]
+
+    def _wrap(
+        self,
+        handler: Callable[[int], int],
+        instructions: List[Instruction],
+        ip: int,
+    ) -> Callable[[int], int]:
+        if ip == len(instructions):
+            return handler
+
+        instruction = instructions[ip]
+        charged, next_check, check = self.charged, self.next_check, self.check
+        call_stack = self.simulator.call_stack
+        stack = self.simulator.stack
+        max_call_depth = self.limits.max_call_depth
+
+        if isinstance(instruction, (CallFunction, TailCall)):
+            if isinstance(instruction, CallFunction):
+                program = self.simulator.program
+                functions = program.function_instructions[instruction.file]
+                called = functions[instruction.func_name]
+            else:
+                # Tail calls only call the function they are in
+                called = instructions
+
+            # Includes the return at the end
+            cost = len(called) + 1
+
+            def limited_call(ip: int) -> int:
+                result = handler(ip)
+
+                if max_call_depth and len(call_stack) > max_call_depth:
+                    self._exceeded("Call depth", max_call_depth)
+
+                charged[0] += cost
+                if charged[0] >= next_check[0]:
+                    check()
+
+                return result
+
+            return limited_call
+
+        if isinstance(instruction, JUMP_INSTRUCTIONS):
+            target = instruction.instruction_offset
+
+            if target > ip:
+                return handler
+
+            cost = ip - target + 1
+
+            def limited_jump(ip: int) -> int:
+                charged[0] += cost
+                if charged[0] >= next_check[0]:
+                    check()
+
+                return handler(ip)
+
+            # Loops end with this one, which is replaced to not add a call
+            def limited_unconditional_jump(ip: int) -> int:
+                charged[0] += cost
+                if charged[0] >= next_check[0]:
+                    check()
+
+                return target
+
+            if isinstance(instruction, Jump):
+                return limited_unconditional_jump
+            return limited_jump
+
+        if not self.limits.max_container_items:
+            return handler
+
+        add_items = self.add_container_items
+
+        if isinstance(instruction, VecFill):
+            # Checked first, filling allocates all items at once
+            def limited_vec_fill(ip: int) -> int:
+                add_items(max(stack[-2], 0), pending=True)
+                return handler(ip)
+
+            return limited_vec_fill
+
+        if isinstance(instruction, VecExtend):
+
+            def limited_vec_extend(ip: int) -> int:
+                added = len(stack[-1].value)
+                result = handler(ip)
+                add_items(added)
+                return result
+
+            return limited_vec_extend
+
+        if isinstance(instruction, VecSlice):
+
+            def limited_vec_slice(ip: int) -> int:
+                result = handler(ip)
+                add_items(len(stack[-1].value))
+                return result
+
+            return limited_vec_slice
+
+        return handler
+
+    def start(self) -> None:
+        """
+        Charges the main function, called when it starts running.
+        """
+
+        self.charged[0] += len(self.simulator.call_stack[-1].code)
+        self.check()
+
+    def check(self) -> None:
+        limits = self.limits
+        simulator = self.simulator
+
+        max_instructions = limits.max_instructions
+        if max_instructions and self.charged[0] > max_instructions:
+            self._exceeded("Instruction", max_instructions)
+
+        max_stack_size = limits.max_stack_size
+        if max_stack_size and len(simulator.stack) > max_stack_size:
+            self._exceeded("Stack size", max_stack_size)
+
+        if limits.max_container_items:
+            self._count_container_items()
+
+        self._schedule_check()
+
+    def _schedule_check(self) -> None:
+        next_check = self.charged[0] + max(self.limits.check_interval, 1)
+
+        # The instruction limit is exact
+        if self.limits.max_instructions:
+            next_check = min(next_check, self.limits.max_instructions + 1)
+
+        self.next_check[0] = next_check
+
+    def add_container_items(self, count: int, pending: bool = False) -> None:
+        """
+        Adds count to the upper bound of container items. Pending items are about to
+        be added, they are not in a container yet.
+        """
+
+        self.container_items += count
+
+        if self.container_items > self.limits.max_container_items:
+            # The upper bound can be too high, because items were removed
+            self._count_container_items(count if pending else 0)
+
+    def _count_container_items(self, pending: int = 0) -> None:
+        simulator = self.simulator
+        values: List[Any] = list(simulator.stack)
+
+        for call_stack_item in simulator.call_stack:
+            values += call_stack_item.argument_values
+
+        self.container_items = count_container_items(values) + pending
+
+        if self.container_items > self.limits.max_container_items:
+            self._exceeded("Container item", self.limits.max_container_items)
+
+    def _exceeded(self, limit_name: str, limit: int) -> None:
+        # Nothing runs after this, so the call stack doesn't need to be copied
+        call_stack = list(self.simulator.call_stack)
+        raise AaaLimitExceeded(call_stack, limit_name, limit)
+
+
+def count_container_items(values: Iterable[Any]) -> int:
+    """
+    Returns number of items in all containers in values, including nested ones.
+    Values shared by copies are counted once, fields of structs are not counted.
+    """
+
+    count = 0
+    counted: Set[int] = set()
+    todo = [value for value in values if isinstance(value, Variable)]
+
+    while todo:
+        variable = todo.pop()
+        root_type = variable.type.root_type
+
+        if root_type in ITERATOR_ROOT_TYPES or id(variable.value) in counted:
+            continue
+
+        counted.add(id(variable.value))
+
+        if root_type != RootType.STRUCT:
+            count += len(variable.value)
+
+        if variable._contains_variables():
+            items = variable.value
+            if isinstance(items, dict):
+                items = list(items.keys()) + list(items.values())
+
+            todo += [item for item in items if isinstance(item, Variable)]
+
+    return count
@@ -0,0 +1,112 @@
+import json
+from time import perf_counter
+from typing import TYPE_CHECKING, Any, Dict
+
+from lang.typing.types import RootType, Variable
+
+if TYPE_CHECKING:  # pragma: nocover
+    from lang.runtime.simulator import Simulator
+
+
+class Observer:
+    """
+    Gets notified while a Simulator runs, see Simulator.add_observer(). Subclasses
+    override the methods they need, the others do nothing.
+
+    All methods get the Simulator, so they can look at its stack and call stack.
+    """
+
+    # Number of executed instructions between calls to sample(), 0 never calls it
+    sample_interval = 0
+
+    def started(self, simulator: "Simulator") -> None:
+        ...
+
+    def function_entered(self, simulator: "Simulator") -> None:
+        """
+        Called when a function starts, it is on top of the call stack. Tail calls
+        leave the running function and then enter the called one.
+        """
+
+    def function_left(self, simulator: "Simulator") -> None:
+        """
+        Called when a function returns, it is still on top of the call stack.
+        """
+
+    def sample(self, simulator: "Simulator") -> None:
+        """
+        Called before every sample_interval-th instruction runs.
+        """
+
+    def allocated(self, simulator: "Simulator", variable: Variable) -> None:
+        """
+        Called when an instruction created a container, struct or iterator. Copies
+        made later by copy-on-write are not reported.
+        """
+
+    def finished(self, simulator: "Simulator") -> None:
+        """
+        Called when the program stopped, also when it failed.
+        """
+
+
+class MetricsObserver(Observer):
+    """
+    Collects counters of a run, which metrics() returns once the program finished.
+
+    The peak stack depth is only measured when sampling and when functions are
+    entered or left, so a lower sample_interval makes it more precise.
+    """
+
+    def __init__(self, sample_interval: int = 1000) -> None:
+        self.sample_interval = sample_interval
+
+        self.max_stack_depth = 0
+        self.max_call_depth = 0
+
+        # Number of created values by type name, like "vec" or "map"
+        self.allocations: Dict[str, int] = {}
+
+        self.executed_instructions = 0
+        self.start_time = 0.0
+        self.seconds = 0.0
+
+    def started(self, simulator: "Simulator") -> None:
+        self.start_time = perf_counter()
+
+    def function_entered(self, simulator: "Simulator") -> None:
+        self.max_call_depth = max(self.max_call_depth, len(simulator.call_stack))
+        self.max_stack_depth = max(self.max_stack_depth, len(simulator.stack))
+
+    def function_left(self, simulator: "Simulator") -> None:
+        self.max_stack_depth = max(self.max_stack_depth, len(simulator.stack))
+
+    def sample(self, simulator: "Simulator") -> None:
+        self.max_stack_depth = max(self.max_stack_depth, len(simulator.stack))
+
+    def allocated(self, simulator: "Simulator", variable: Variable) -> None:
+        root_type = variable.type.root_type
+
+        if root_type == RootType.STRUCT:
+            name = variable.type.struct_name
+        else:
+            name = repr(root_type)
+
+        self.allocations[name] = self.allocations.get(name, 0) + 1
+        self.max_stack_depth = max(self.max_stack_depth, len(simulator.stack))
+
+    def finished(self, simulator: "Simulator") -> None:
+        self.seconds = perf_counter() - self.start_time
+        self.executed_instructions = simulator.executed_instructions()
+
+    def metrics(self) -> Dict[str, Any]:
+        return {
+            "executed_instructions": self.executed_instructions,
+            "max_stack_depth": self.max_stack_depth,
+            "max_call_depth": self.max_call_depth,
+            "allocations": dict(sorted(self.allocations.items())),
+            "seconds": self.seconds,
+        }
+
+    def json(self) -> str:
+        return json.dumps(self.metrics())
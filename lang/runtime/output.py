@@ -0,0 +1,59 @@
+import sys
+from typing import List, Optional, TextIO
+
+# Number of characters collected before they are written to the sink
+DEFAULT_BUFFER_SIZE = 64 * 1024
+
+
+class OutputBuffer:
+    """
+    Collects text printed by a running program and writes it to the sink in large
+    pieces, which is a lot faster than writing every printed value separately.
+
+    When the sink is a terminal, output is written after every newline instead, so
+    interactive programs show lines as soon as they are printed.
+    """
+
+    __slots__ = ("sink", "buffer_size", "line_buffered", "parts", "size")
+
+    def __init__(
+        self, sink: Optional[TextIO] = None, buffer_size: int = DEFAULT_BUFFER_SIZE
+    ) -> None:
+        # None means sys.stdout at the time of writing, so redirecting it works
+        self.sink = sink
+        self.buffer_size = buffer_size
+        self.line_buffered = False
+
+        self.parts: List[str] = []
+        self.size = 0
+
+    def start(self) -> None:
+        """
+        Checks whether the sink is a terminal. Called before a program starts running.
+        """
+
+        try:
+            self.line_buffered = self._sink().isatty()
+        except (AttributeError, ValueError):
+            self.line_buffered = False
+
+    def write(self, text: str) -> None:
+        self.parts.append(text)
+        self.size += len(text)
+
+        if self.size >= self.buffer_size or (self.line_buffered and "\n" in text):
+            self.flush()
+
+    def flush(self) -> None:
+        if not self.parts:
+            return
+
+        sink = self._sink()
+        sink.write("".join(self.parts))
+        sink.flush()
+
+        self.parts.clear()
+        self.size = 0
+
+    def _sink(self) -> TextIO:
+        return self.sink or sys.stdout
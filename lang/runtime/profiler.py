@@ -0,0 +1,255 @@
+import sys
+from pathlib import Path
+from time import perf_counter
+from typing import Dict, List, Optional, TextIO, Tuple
+
+from lang.instructions.types import CallFunction, Instruction, TailCall
+from lang.models.parse import Function
+from lang.runtime.simulator import Handler, Simulator
+
+# Name used for the handler that returns at the end of each function
+RETURN_NAME = "Return"
+
+# Number of rows printed in each section of the report
+REPORT_ROWS = 20
+
+
+class ProfilerFrame:
+    __slots__ = ("function_name", "stack", "start_time", "child_time")
+
+    def __init__(self, function_name: str, stack: str, start_time: float) -> None:
+        self.function_name = function_name
+
+        # Names of all running functions, outermost first, separated by ";"
+        self.stack = stack
+
+        self.start_time = start_time
+
+        # Time spent in functions called from this one
+        self.child_time = 0.0
+
+
+class Profiler:
+    """
+    Runs a program in the Simulator and counts how often each instruction runs and
+    how much time is spent in each Aaa function.
+
+    Every decoded handler is wrapped, so the profiled program runs a lot slower than
+    normally. Times should only be compared with each other.
+    """
+
+    def __init__(self, simulator: Simulator) -> None:
+        self.simulator = simulator
+        self.program = simulator.program
+
+        # Number of times each instruction ran, by file, function name and offset
+        self.location_counts: Dict[Path, Dict[str, List[int]]] = {}
+
+        # Function times in seconds and calls, by Function.identify()
+        self.inclusive_times: Dict[str, float] = {}
+        self.exclusive_times: Dict[str, float] = {}
+        self.call_counts: Dict[str, int] = {}
+
+        # Exclusive time in seconds by stack, for flamegraphs
+        self.collapsed_stacks: Dict[str, float] = {}
+
+        self.frames: List[ProfilerFrame] = []
+
+        # Number of frames of each function, to not count recursion twice
+        self.active_frames: Dict[str, int] = {}
+
+        for file, functions in simulator.decoded_functions.items():
+            self.location_counts[file] = {}
+
+            for name, code in functions.items():
+                instructions = self.program.function_instructions[file][name]
+                counts = [0] * len(code)
+                self.location_counts[file][name] = counts
+
+                # Lists are replaced in place, because CallFunction handlers refer
+                # to them
+                code[:] = [
+                    self._wrap(handler, counts, instructions, ip)
+                    for ip, handler in enumerate(code)
+                ]
+
+    def _wrap(
+        self,
+        handler: Handler,
+        counts: List[int],
+        instructions: List[Instruction],
+        ip: int,
+    ) -> Handler:
+        if ip == len(instructions):
+            leave = self._leave
+
+            def profiled_return(ip: int) -> int:
+                counts[ip] += 1
+                leave()
+                return handler(ip)
+
+            return profiled_return
+
+        instruction = instructions[ip]
+
+        if isinstance(instruction, CallFunction):
+            enter = self._enter
+            called_name = instruction.function.identify()
+
+            def profiled_call(ip: int) -> int:
+                counts[ip] += 1
+                enter(called_name)
+                return handler(ip)
+
+            return profiled_call
+
+        if isinstance(instruction, TailCall):
+            enter, leave = self._enter, self._leave
+            called_name = instruction.function.identify()
+
+            # The frame is reused, but it is still reported as a call
+            def profiled_tail_call(ip: int) -> int:
+                counts[ip] += 1
+                leave()
+                enter(called_name)
+                return handler(ip)
+
+            return profiled_tail_call
+
+        def profiled(ip: int) -> int:
+            counts[ip] += 1
+            return handler(ip)
+
+        return profiled
+
+    def run(self, raise_: bool = False) -> None:
+        main = self.program.get_identifier(self.program.entry_point_file, "main")
+        assert isinstance(main, Function)
+
+        self._enter(main.identify())
+
+        try:
+            self.simulator.run(raise_=raise_)
+        finally:
+            # Functions that didn't return because the program failed
+            while self.frames:
+                self._leave()
+
+    def _enter(self, function_name: str) -> None:
+        stack = function_name
+
+        if self.frames:
+            stack = self.frames[-1].stack + ";" + function_name
+
+        self.frames.append(ProfilerFrame(function_name, stack, perf_counter()))
+        self.active_frames[function_name] = self.active_frames.get(function_name, 0) + 1
+        self.call_counts[function_name] = self.call_counts.get(function_name, 0) + 1
+
+    def _leave(self) -> None:
+        frame = self.frames.pop()
+        name = frame.function_name
+
+        inclusive_time = perf_counter() - frame.start_time
+        exclusive_time = inclusive_time - frame.child_time
+
+        self.active_frames[name] -= 1
+
+        if self.active_frames[name] == 0:
+            self.inclusive_times[name] = (
+                self.inclusive_times.get(name, 0.0) + inclusive_time
+            )
+
+        self.exclusive_times[name] = (
+            self.exclusive_times.get(name, 0.0) + exclusive_time
+        )
+        self.collapsed_stacks[frame.stack] = (
+            self.collapsed_stacks.get(frame.stack, 0.0) + exclusive_time
+        )
+
+        if self.frames:
+            self.frames[-1].child_time += inclusive_time
+
+    def instruction_counts(self) -> Dict[str, int]:
+        """
+        Returns number of executions by instruction type name.
+        """
+
+        counts: Dict[str, int] = {}
+
+        for file, name, ip, count in self._locations():
+            type_name = self._instruction_name(file, name, ip)
+            counts[type_name] = counts.get(type_name, 0) + count
+
+        return counts
+
+    def _locations(self) -> List[Tuple[Path, str, int, int]]:
+        return [
+            (file, name, ip, count)
+            for file, functions in self.location_counts.items()
+            for name, counts in functions.items()
+            for ip, count in enumerate(counts)
+            if count
+        ]
+
+    def _instruction(self, file: Path, name: str, ip: int) -> Optional[Instruction]:
+        instructions = self.program.function_instructions[file][name]
+
+        if ip == len(instructions):
+            return None
+
+        return instructions[ip]
+
+    def _instruction_name(self, file: Path, name: str, ip: int) -> str:
+        instruction = self._instruction(file, name, ip)
+
+        if instruction is None:
+            return RETURN_NAME
+
+        return type(instruction).__name__
+
+    def print_report(self, file: TextIO = sys.stderr) -> None:
+        print("Functions by exclusive time:", file=file)
+        print(
+            f"{'exclusive':>12} {'inclusive':>12} {'calls':>10}  function", file=file
+        )
+
+        for name, exclusive_time in sorted(
+            self.exclusive_times.items(), key=lambda item: -item[1]
+        )[:REPORT_ROWS]:
+            inclusive_time = self.inclusive_times.get(name, 0.0)
+            calls = self.call_counts[name]
+            print(
+                f"{exclusive_time:>11.6f}s {inclusive_time:>11.6f}s {calls:>10}  "
+                + name,
+                file=file,
+            )
+
+        print("\nInstructions by executions:", file=file)
+        print(f"{'count':>12}  instruction", file=file)
+
+        for type_name, count in sorted(
+            self.instruction_counts().items(), key=lambda item: -item[1]
+        )[:REPORT_ROWS]:
+            print(f"{count:>12}  {type_name}", file=file)
+
+        print("\nHot spots:", file=file)
+        print(f"{'count':>12}  {'function':>30}  {'ip':>4}  instruction", file=file)
+
+        for source_file, name, ip, count in sorted(
+            self._locations(), key=lambda location: -location[3]
+        )[:REPORT_ROWS]:
+            instruction = self._instruction(source_file, name, ip)
+            formatted = RETURN_NAME if instruction is None else repr(instruction)
+            print(f"{count:>12}  {name:>30}  {ip:>4}  {formatted}", file=file)
+
+    def write_collapsed_stacks(self, file: TextIO) -> None:
+        """
+        Writes exclusive time in microseconds per stack, in the collapsed format
+        used by flamegraph.pl and speedscope.
+        """
+
+        for stack, seconds in sorted(self.collapsed_stacks.items()):
+            microseconds = round(seconds * 1_000_000)
+
+            if microseconds > 0:
+                print(f"{stack} {microseconds}", file=file)
@@ -1,8 +1,10 @@
 import os
 import sys
+from concurrent.futures import Executor, ProcessPoolExecutor
+from contextlib import contextmanager
 from pathlib import Path
-from tempfile import NamedTemporaryFile
-from typing import Dict, List, Optional, Tuple, Union
+from time import perf_counter
+from typing import Any, Dict, Generator, List, Optional, Tuple, Union
 
 from lark.exceptions import UnexpectedInput
 
@@ -20,10 +22,12 @@ from lang.exceptions.misc import (
 )
 from lang.exceptions.naming import CollidingIdentifier
 from lang.instructions.generator import InstructionGenerator
+from lang.instructions.optimizer import PeepholeOptimizer
 from lang.instructions.types import Instruction
 from lang.models import AaaModel
 from lang.models.parse import (
     Function,
+    Import,
     MemberFunctionName,
     ParsedBuiltinsFile,
     ParsedFile,
@@ -32,11 +36,21 @@ from lang.models.parse import (
     TypeLiteral,
 )
 from lang.models.program import ProgramImport
-from lang.parse.parser import aaa_builtins_parser, aaa_source_parser
-from lang.parse.transformer import AaaTransformer
+from lang.parse.parser import BUILTINS_FILE_ROOT, REGULAR_FILE_ROOT, aaa_parser
+from lang.runtime.cache import cache_file, content_hash, load_cache, save_cache
 from lang.runtime.debug import format_str
 from lang.typing.checker import TypeChecker
-from lang.typing.types import Signature, SignatureItem, TypePlaceholder, VariableType
+from lang.typing.types import (
+    Signature,
+    SignatureItem,
+    TypePlaceholder,
+    TypeStack,
+    VariableType,
+)
+
+# Name of the file in the current directory that Program.without_file() pretends to
+# load, like Python does for code passed with -c
+CODE_WITHOUT_FILE_NAME = "<string>"
 
 # Identifiable are things identified uniquely by a filepath and name
 Identifiable = Function | ProgramImport | Struct
@@ -46,33 +60,165 @@ Identifiable = Function | ProgramImport | Struct
 class Builtins(AaaModel):
     functions: Dict[str, List[Signature]]
 
+    # Hash of the builtins file, which is part of the hash of every loaded file
+    hash: str = ""
+
     @classmethod
     def empty(cls) -> "Builtins":
         return Builtins(functions={})
 
 
+class CachedFile:
+    """
+    Result of loading a file, stored in __aaacache__ next to it.
+    """
+
+    def __init__(
+        self,
+        dependency_hashes: Dict[Path, str],
+        identifiers: Dict[str, Identifiable],
+        function_instructions: Dict[str, List[Instruction]],
+        function_stack_heights: Dict[str, int],
+    ) -> None:
+        # Imported files with their hash when this file was loaded
+        self.dependency_hashes = dependency_hashes
+
+        self.identifiers = identifiers
+        self.function_instructions = function_instructions
+        self.function_stack_heights = function_stack_heights
+
+
+# Result of type checking and generating instructions for some functions of a file,
+# with the stack heights of those functions
+FunctionsResult = Tuple[
+    List[AaaLoadException], Dict[str, List[Instruction]], Dict[str, int]
+]
+
+
 class Program:
-    def __init__(self, file: Path) -> None:
+    def __init__(
+        self,
+        file: Path,
+        optimize: bool = False,
+        use_cache: bool = True,
+        jobs: int = 1,
+        builtins: Optional[Builtins] = None,
+        sources: Optional[Dict[Path, str]] = None,
+    ) -> None:
         self.entry_point_file = file.resolve()
+        self.optimize = optimize
+        self.use_cache = use_cache
+
+        # Code used instead of reading files from disk, by resolved path. These files
+        # are never cached, there is no directory to put the cache in.
+        self.sources: Dict[Path, str] = {
+            path.resolve(): code for path, code in (sources or {}).items()
+        }
+
+        # Number of processes type checking and generating functions, 0 uses all
+        # CPU cores. Starting processes is slow, so this only helps large programs.
+        self.jobs = jobs or os.cpu_count() or 1
+        self._pool: Optional[Executor] = None
         self.identifiers: Dict[Path, Dict[str, Identifiable]] = {}
         self.function_instructions: Dict[Path, Dict[str, List[Instruction]]] = {}
 
+        # Highest number of values each function has on the stack, found by the
+        # TypeChecker. Optimized instructions never need more.
+        self.function_stack_heights: Dict[Path, Dict[str, int]] = {}
+
+        # Maps id() of each Operator node to the signature the TypeChecker selected
+        self.operator_signatures: Dict[int, Signature] = {}
+
+        # Maps id() of each call to a builtin member function to the types it returned
+        self.member_function_types: Dict[int, TypeStack] = {}
+
+        # Maps id() of each struct field query and update to the index of the field
+        self.struct_field_slots: Dict[int, int] = {}
+
+        # Maps id() of each type checked function to its highest stack height
+        self.stack_heights: Dict[int, int] = {}
+
         # Used to detect cyclic import loops
         self.file_load_stack: List[Path] = []
 
-        self._builtins, self.file_load_errors = self._load_builtins()
+        # Errors of each file that was loaded, so files imported more than once are
+        # only loaded once
+        self.loaded_files: Dict[Path, List[AaaLoadException]] = {}
+
+        # Seconds spent in each phase of loading, summed over all files
+        self.load_times: Dict[str, float] = {
+            "parse": 0.0,
+            "type_check": 0.0,
+            "generate": 0.0,
+        }
+
+        # Hash of each loaded file including everything it depends on
+        self.file_hashes: Dict[Path, str] = {}
+
+        # Loading builtins of another Program again would give the same result
+        if builtins:
+            self._builtins, self.file_load_errors = builtins, []
+        else:
+            self._builtins, self.file_load_errors = self._load_builtins()
+
+        self.builtins_hash = self._builtins.hash
 
         if self.file_load_errors:
             return
 
-        self.file_load_errors = self._load_file(self.entry_point_file)
+        try:
+            self.file_load_errors = self._load_file(self.entry_point_file)
+        finally:
+            if self._pool:
+                self._pool.shutdown()
+                self._pool = None
 
     @classmethod
-    def without_file(cls, code: str) -> "Program":
-        with NamedTemporaryFile(delete=False) as file:
-            saved_file = Path(file.name)
-            saved_file.write_text(code)
-            return cls(file=saved_file)
+    def without_file(
+        cls,
+        code: str,
+        optimize: bool = False,
+        use_cache: bool = True,
+        jobs: int = 1,
+        builtins: Optional[Builtins] = None,
+    ) -> "Program":
+        """
+        Loads code without writing it to a file. Imports are relative to the current
+        directory.
+        """
+
+        file = Path.cwd() / CODE_WITHOUT_FILE_NAME
+        return cls(
+            file=file,
+            optimize=optimize,
+            use_cache=use_cache,
+            jobs=jobs,
+            builtins=builtins,
+            sources={file: code},
+        )
+
+    @property
+    def builtins(self) -> Builtins:
+        """
+        Returns loaded builtins, they can be passed to other Programs when loading
+        them didn't fail.
+        """
+
+        return self._builtins
+
+    def __getstate__(self) -> Dict[str, Any]:
+        # Only what worker processes need to type check and generate functions
+        return {
+            "entry_point_file": self.entry_point_file,
+            "optimize": self.optimize,
+            "identifiers": self.identifiers,
+            "operator_signatures": {},
+            "member_function_types": {},
+            "struct_field_slots": {},
+            "stack_heights": {},
+            "function_stack_heights": {},
+            "_builtins": self._builtins,
+        }
 
     def _load_builtins(self) -> Tuple[Builtins, List[AaaLoadException]]:
         builtins = Builtins.empty()
@@ -85,10 +231,20 @@ class Program:
         builtins_file = stdlib_path / "builtins.aaa"
 
         try:
-            parsed_file = self._parse_builtins_file(builtins_file)
+            code = builtins_file.read_text()
         except OSError:
             return builtins, [FileReadError(builtins_file)]
 
+        builtins.hash = content_hash(code)
+        builtins_cache_file = cache_file(builtins_file, optimize=False)
+
+        if self.use_cache:
+            cached = load_cache(builtins_cache_file, builtins.hash)
+            if isinstance(cached, Builtins):
+                return cached, []
+
+        parsed_file = self._parse_builtins_file(builtins_file, code)
+
         for function in parsed_file.functions:
             if function.name not in builtins.functions:
                 builtins.functions[function.name] = []
@@ -119,6 +275,9 @@ class Program:
                 Signature(arg_types=arg_types, return_types=return_types)
             )
 
+        if self.use_cache:
+            save_cache(builtins_cache_file, builtins.hash, builtins)
+
         return builtins, []
 
     def exit_on_error(self) -> None:  # pragma: nocover
@@ -136,7 +295,8 @@ class Program:
         exit(1)
 
     def _load_file(self, file: Path) -> List[AaaLoadException]:
-        # TODO make sure the file wasn't loaded already
+        if file in self.loaded_files:
+            return self.loaded_files[file]
 
         if file in self.file_load_stack:
             return [
@@ -146,57 +306,149 @@ class Program:
         self.file_load_stack.append(file)
 
         try:
-            parsed_file = self._parse_regular_file(file)
-        except OSError:
+            errors = self._load_new_file(file)
+        finally:
             self.file_load_stack.pop()
+
+        self.loaded_files[file] = errors
+        return errors
+
+    def _load_new_file(self, file: Path) -> List[AaaLoadException]:
+        try:
+            code = self._read_file(file)
+        except OSError:
             return [FileReadError(file)]
+
+        # Builtins and interpreter version are part of the hash, their changes can
+        # change the outcome of type checking and instruction generation. Cached
+        # files hold absolute paths of the file and its imports, so a copied or
+        # moved file must not reuse the cache of the original.
+        source_hash = content_hash(self.builtins_hash, str(file), code)
+        use_cache = self.use_cache and file not in self.sources
+
+        if use_cache and self._load_cached_file(file, source_hash):
+            return []
+
+        try:
+            parsed_file = self._parse_regular_file(file, code)
         except AaaLoadException as e:
-            self.file_load_stack.pop()
             return [e]
 
         self.identifiers[file] = {}
         import_errors = self._load_imported_files(file, parsed_file)
 
         if import_errors:
-            self.file_load_stack.pop()
             return import_errors
 
         try:
             self._load_file_identifiers(file, parsed_file)
         except AaaLoadException as e:
-            self.file_load_stack.pop()
             return [e]
 
-        load_file_exceptions = self._type_check_file(file, parsed_file)
+        if self.jobs > 1 and len(parsed_file.functions) > 1:
+            (
+                load_file_exceptions,
+                file_instructions,
+                stack_heights,
+            ) = self._load_functions_in_pool(file, parsed_file)
+            self.function_stack_heights[file] = stack_heights
+        else:
+            with self._timed("type_check"):
+                load_file_exceptions = self._type_check_file(file, parsed_file)
+
+            file_instructions = {}
+
+            if not load_file_exceptions:
+                with self._timed("generate"):
+                    file_instructions = self._generate_file_instructions(
+                        file, parsed_file.functions
+                    )
+
         if load_file_exceptions:
-            self.file_load_stack.pop()
             return load_file_exceptions
 
-        self.function_instructions[file] = self._generate_file_instructions(
-            file, parsed_file
-        )
-        self.file_load_stack.pop()
+        self.function_instructions[file] = file_instructions
+
+        dependency_hashes = {
+            self._import_path(file, import_): "" for import_ in parsed_file.imports
+        }
+        for dependency in dependency_hashes:
+            dependency_hashes[dependency] = self.file_hashes[dependency]
+
+        self.file_hashes[file] = content_hash(source_hash, *dependency_hashes.values())
+
+        if use_cache:
+            cached_file = CachedFile(
+                dependency_hashes,
+                self.identifiers[file],
+                self.function_instructions[file],
+                self.function_stack_heights[file],
+            )
+            save_cache(cache_file(file, self.optimize), source_hash, cached_file)
+
         return []
 
-    def _parse_regular_file(self, file: Path) -> ParsedFile:
-        code = file.read_text()
+    def _read_file(self, file: Path) -> str:
+        if file in self.sources:
+            return self.sources[file]
 
-        try:
-            tree = aaa_source_parser.parse(code)
-        except UnexpectedInput as e:
-            raise AaaParseException(file=file, parse_error=e)
+        return file.read_text()
+
+    def _load_cached_file(self, file: Path, source_hash: str) -> bool:
+        """
+        Loads file from cache if it is there and nothing it depends on changed.
+        Returns whether that succeeded.
+        """
+
+        cached = load_cache(cache_file(file, self.optimize), source_hash)
+
+        if not isinstance(cached, CachedFile):
+            return False
+
+        if (
+            file == self.entry_point_file
+            and "main" not in cached.function_instructions
+        ):
+            # Let regular loading report the missing main function
+            return False
+
+        for dependency, dependency_hash in cached.dependency_hashes.items():
+            if self._load_file(dependency):
+                return False
 
-        return AaaTransformer().transform(tree)  # type: ignore
+            if self.file_hashes[dependency] != dependency_hash:
+                return False
 
-    def _parse_builtins_file(self, file: Path) -> ParsedBuiltinsFile:
-        code = file.read_text()
+        self.identifiers[file] = cached.identifiers
+        self.function_instructions[file] = cached.function_instructions
+        self.function_stack_heights[file] = cached.function_stack_heights
+        self.file_hashes[file] = content_hash(
+            source_hash, *cached.dependency_hashes.values()
+        )
+        return True
+
+    @contextmanager
+    def _timed(self, phase: str) -> Generator[None, None, None]:
+        start = perf_counter()
 
         try:
-            tree = aaa_builtins_parser.parse(code)
-        except UnexpectedInput as e:
-            raise AaaParseException(file=file, parse_error=e)
+            yield
+        finally:
+            self.load_times[phase] += perf_counter() - start
+
+    def _parse_regular_file(self, file: Path, code: str) -> ParsedFile:
+        with self._timed("parse"):
+            try:
+                return aaa_parser.parse(code, start=REGULAR_FILE_ROOT)  # type: ignore
+            except UnexpectedInput as e:
+                raise AaaParseException(file=file, parse_error=e, code=code)
 
-        return AaaTransformer().transform(tree)  # type: ignore
+    def _parse_builtins_file(self, file: Path, code: str) -> ParsedBuiltinsFile:
+        with self._timed("parse"):
+            try:
+                return aaa_parser.parse(code, start=BUILTINS_FILE_ROOT)  # type: ignore
+            except UnexpectedInput as e:
+                raise AaaParseException(file=file, parse_error=e, code=code)
 
     def _load_file_identifiers(self, file: Path, parsed_file: ParsedFile) -> None:
         identifiables: List[Union[Function, Struct]] = []
@@ -216,32 +468,86 @@ class Program:
 
             file_identifiers[identifier] = identifiable
 
-    def _generate_file_instructions(
+    def _load_functions_in_pool(
         self, file: Path, parsed_file: ParsedFile
+    ) -> FunctionsResult:
+        """
+        Type checks and generates functions of file in worker processes. Each worker
+        only gets a copy of this Program, so generating has to happen in the worker
+        that type checked the function.
+        """
+
+        if not self._pool:
+            self._pool = ProcessPoolExecutor(self.jobs)
+
+        functions = parsed_file.functions
+        chunk_count = min(self.jobs, len(functions))
+        chunk_size = -(-len(functions) // chunk_count)
+
+        with self._timed("type_check"):
+            futures = [
+                self._pool.submit(
+                    _load_functions, self, file, functions[start : start + chunk_size]
+                )
+                for start in range(0, len(functions), chunk_size)
+            ]
+
+            # Results are combined in function order, so errors are deterministic
+            exceptions = self._check_main_function(file, parsed_file)
+            file_instructions: Dict[str, List[Instruction]] = {}
+            stack_heights: Dict[str, int] = {}
+
+            for future in futures:
+                chunk_exceptions, chunk_instructions, chunk_heights = future.result()
+                exceptions += chunk_exceptions
+                file_instructions.update(chunk_instructions)
+                stack_heights.update(chunk_heights)
+
+        return exceptions, file_instructions, stack_heights
+
+    def _generate_file_instructions(
+        self, file: Path, functions: List[Function]
     ) -> Dict[str, List[Instruction]]:
         file_instructions: Dict[str, List[Instruction]] = {}
-        for function in parsed_file.functions:
-            file_instructions[str(function.name)] = InstructionGenerator(
+        stack_heights = self.function_stack_heights.setdefault(file, {})
+
+        for function in functions:
+            instructions = InstructionGenerator(
                 file, function, self
             ).generate_instructions()
+
+            if self.optimize:
+                instructions = PeepholeOptimizer(instructions).optimize()
+
+            file_instructions[str(function.name)] = instructions
+            stack_heights[str(function.name)] = self.stack_heights[id(function)]
         return file_instructions
 
     def _type_check_file(
         self, file: Path, parsed_file: ParsedFile
     ) -> List[AaaLoadException]:
-        exceptions: List[AaaLoadException] = []
-
-        if file == self.entry_point_file:
-            main_found = False
-            for function in parsed_file.functions:
-                if function.name == "main":
-                    main_found = True
-                    break
+        exceptions = self._check_main_function(file, parsed_file)
+        exceptions += self._type_check_functions(file, parsed_file.functions)
+        return exceptions
 
-            if not main_found:
-                exceptions.append(MainFunctionNotFound(file))
+    def _check_main_function(
+        self, file: Path, parsed_file: ParsedFile
+    ) -> List[AaaLoadException]:
+        if file != self.entry_point_file:
+            return []
 
         for function in parsed_file.functions:
+            if function.name == "main":
+                return []
+
+        return [MainFunctionNotFound(file)]
+
+    def _type_check_functions(
+        self, file: Path, functions: List[Function]
+    ) -> List[AaaLoadException]:
+        exceptions: List[AaaLoadException] = []
+
+        for function in functions:
             try:
                 TypeChecker(file, function, self).check()
             except AaaLoadException as e:
@@ -261,11 +567,12 @@ class Program:
                 errors.append(AbsoluteImportError(file=file, import_=import_))
                 continue
 
-            import_path = (file.parent / f"{import_.source}.aaa").resolve()
+            import_path = self._import_path(file, import_)
 
             import_errors = self._load_file(import_path)
             if import_errors:
-                errors += import_errors
+                # Files imported from multiple places return the same errors
+                errors += [error for error in import_errors if error not in errors]
                 continue
 
             loaded_identifiers = self.identifiers[import_path]
@@ -303,6 +610,9 @@ class Program:
 
         return errors
 
+    def _import_path(self, file: Path, import_: Import) -> Path:
+        return (file.parent / f"{import_.source}.aaa").resolve()
+
     def get_identifier(self, file: Path, name: str) -> Optional[Identifiable]:
         try:
             identified = self.identifiers[file][name]
@@ -334,6 +644,9 @@ class Program:
     def get_instructions(self, file: Path, name: str) -> List[Instruction]:
         return self.function_instructions[file][name]
 
+    def get_stack_height(self, file: Path, name: str) -> int:
+        return self.function_stack_heights[file][name]
+
     def print_all_instructions(self) -> None:  # pragma: nocover
         for functions in self.function_instructions.values():
             for name, instructions in functions.items():
@@ -354,3 +667,16 @@ class Program:
                 print(file=sys.stderr)
 
         print("---", file=sys.stderr)
+
+
+def _load_functions(
+    program: Program, file: Path, functions: List[Function]
+) -> FunctionsResult:
+    # Runs in worker processes of Program._load_functions_in_pool
+    exceptions = program._type_check_functions(file, functions)
+
+    if exceptions:
+        return exceptions, {}, {}
+
+    instructions = program._generate_file_instructions(file, functions)
+    return [], instructions, program.function_stack_heights[file]
@@ -0,0 +1,852 @@
+import re
+import sys
+import threading
+from array import array
+from copy import deepcopy
+from pathlib import Path
+from types import CodeType, FrameType
+from typing import (
+    Any,
+    Callable,
+    Dict,
+    List,
+    NoReturn,
+    Optional,
+    Set,
+    TextIO,
+    Tuple,
+    Type,
+)
+
+from lang.exceptions import AaaRuntimeException
+from lang.exceptions.runtime import AaaAssertionFailure
+from lang.instructions.types import (
+    SYS_CALL_STACK_EFFECTS,
+    And,
+    Assert,
+    CallFunction,
+    Divide,
+    Drop,
+    Dup,
+    Dup2,
+    GetStructField,
+    Instruction,
+    IntEquals,
+    IntGreaterEquals,
+    IntGreaterThan,
+    IntLessEquals,
+    IntLessThan,
+    IntNotEqual,
+    IntPlus,
+    IntPlusImmediate,
+    IterNext,
+    Jump,
+    JumpIfNot,
+    JumpIfNotIntEquals,
+    JumpIfNotIntGreaterEquals,
+    JumpIfNotIntGreaterThan,
+    JumpIfNotIntLessEquals,
+    JumpIfNotIntLessThan,
+    JumpIfNotIntNotEqual,
+    MapClear,
+    MapCopy,
+    MapDrop,
+    MapEmpty,
+    MapGet,
+    MapHasKey,
+    MapItems,
+    MapIterNext,
+    MapKeys,
+    MapPop,
+    MapSet,
+    MapSize,
+    MapValues,
+    Minus,
+    Modulo,
+    Multiply,
+    Nop,
+    Not,
+    Or,
+    Over,
+    Print,
+    PushBool,
+    PushFunctionArgument,
+    PushInt,
+    PushIterator,
+    PushMap,
+    PushSet,
+    PushStrbuf,
+    PushString,
+    PushStruct,
+    PushVec,
+    Rot,
+    SetAdd,
+    SetClear,
+    SetDrop,
+    SetHas,
+    SetSize,
+    SetStructField,
+    StrConcat,
+    StrEquals,
+    StrbufAppend,
+    StrbufSize,
+    StrbufToStr,
+    Swap,
+    SysCall,
+    TailCall,
+    VecClear,
+    VecCopy,
+    VecEmpty,
+    VecExtend,
+    VecFill,
+    VecGet,
+    VecPop,
+    VecPush,
+    VecReserve,
+    VecSet,
+    VecSize,
+    VecSlice,
+)
+from lang.models.parse import Function
+from lang.models.runtime import CallStackItem
+from lang.runtime.output import DEFAULT_BUFFER_SIZE, OutputBuffer
+from lang.runtime.program import Program
+from lang.runtime.syscalls import SysCalls
+from lang.typing.types import (
+    Bool,
+    Int,
+    RootType,
+    TypePlaceholder,
+    Variable,
+    extend_vec,
+    fill_vec,
+    format_value,
+    get_vec_item,
+    iterate_map_items,
+    iterate_map_keys,
+    iterate_map_values,
+    next_item,
+    next_map_item,
+    pop_vec_item,
+    slice_vec,
+    strbuf_size,
+    strbuf_to_str,
+    unpack_vec,
+    vec_items,
+    zero_struct,
+)
+
+# Python code and stack size change of instructions without fields. In the code, x is
+# the top of the stack, y and z are below it and n0, n1 and n2 are pushed on top of it.
+INSTRUCTION_TEMPLATES: Dict[Type[Instruction], Tuple[str, int]] = {
+    And: ("{y} = {y} and {x}", -1),
+    Assert: ("if not {x}:\n    assertion_failure()", -1),
+    Divide: (
+        "if {x} == 0:\n"
+        + "    {y}, {x} = 0, False\n"
+        + "else:\n"
+        + "    {y}, {x} = {y} // {x}, True",
+        0,
+    ),
+    Drop: ("", -1),
+    Dup: ("{n0} = {x}", 1),
+    Dup2: ("{n0}, {n1} = {y}, {x}", 2),
+    IntEquals: ("{y} = {y} == {x}", -1),
+    IntGreaterEquals: ("{y} = {y} >= {x}", -1),
+    IntGreaterThan: ("{y} = {y} > {x}", -1),
+    IntLessEquals: ("{y} = {y} <= {x}", -1),
+    IntLessThan: ("{y} = {y} < {x}", -1),
+    IntNotEqual: ("{y} = {y} != {x}", -1),
+    IntPlus: ("{y} = {y} + {x}", -1),
+    Minus: ("{y} = {y} - {x}", -1),
+    Modulo: (
+        "if {x} == 0:\n"
+        + "    {y}, {x} = 0, False\n"
+        + "else:\n"
+        + "    {y}, {x} = {y} % {x}, True",
+        0,
+    ),
+    Multiply: ("{y} = {y} * {x}", -1),
+    Nop: ("", 0),
+    Not: ("{x} = not {x}", 0),
+    Or: ("{y} = {y} or {x}", -1),
+    Over: ("{n0} = {y}", 1),
+    Print: ("write(format_value({x}))", -1),
+    Rot: ("{z}, {y}, {x} = {y}, {x}, {z}", 0),
+    StrConcat: ("{y} = {y} + {x}", -1),
+    StrEquals: ("{y} = {y} == {x}", -1),
+    Swap: ("{y}, {x} = {x}, {y}", 0),
+    VecClear: ("{x}.writable().clear()", 0),
+    VecCopy: ("{n0} = {x}.copy()", 1),
+    VecExtend: ("extend_vec({y}, {x})", -1),
+    VecSlice: ("{y} = slice_vec({z}, {y}, {x})", -1),
+    VecFill: ("fill_vec({z}, {y}, {x})", -2),
+    VecReserve: ("", -1),
+    VecEmpty: ("{n0} = not {x}.value", 1),
+    VecSize: ("{n0} = len({x}.value)", 1),
+    MapClear: ("{x}.writable().clear()", 0),
+    MapCopy: ("{n0} = {x}.copy()", 1),
+    MapDrop: ("del {y}.writable()[{x}]", -1),
+    MapEmpty: ("{n0} = not {x}.value", 1),
+    MapGet: ("{x} = {y}.value[{x}]", 0),
+    MapHasKey: ("{x} = {x} in {y}.value", 0),
+    MapKeys: ("{n0} = iterate_map_keys({x})", 1),
+    MapPop: ("{x} = {y}.writable().pop({x})", 0),
+    MapSet: ("{z}.writable()[{y}] = {x}", -2),
+    MapSize: ("{n0} = len({x}.value)", 1),
+    MapValues: ("{n0} = iterate_map_values({x})", 1),
+    MapItems: ("{n0} = iterate_map_items({x})", 1),
+    PushStrbuf: ("{n0} = Variable(RootType.STRING_BUFFER, [])", 1),
+    StrbufAppend: ("{y}.writable().append({x})", -1),
+    StrbufToStr: ("{n0} = strbuf_to_str({x})", 1),
+    StrbufSize: ("{n0} = strbuf_size({x})", 1),
+    SetAdd: ("{y}.writable()[{x}] = None", -1),
+    SetClear: ("{x}.writable().clear()", 0),
+    SetDrop: ("{y}.writable().pop({x}, None)", -1),
+    SetHas: ("{x} = {x} in {y}.value", 0),
+    SetSize: ("{n0} = len({x}.value)", 1),
+}
+
+# Aaa calls are Python calls in generated code, deep recursion needs a big stack
+RECURSION_LIMIT = 1_000_000
+THREAD_STACK_SIZE = 512 * 1024 * 1024
+
+# Comparison made by conditional jumps, they jump if it is false
+CONDITIONAL_JUMPS: Dict[Type[Instruction], str] = {
+    JumpIfNot: "",
+    JumpIfNotIntEquals: "==",
+    JumpIfNotIntNotEqual: "!=",
+    JumpIfNotIntLessThan: "<",
+    JumpIfNotIntLessEquals: "<=",
+    JumpIfNotIntGreaterThan: ">",
+    JumpIfNotIntGreaterEquals: ">=",
+}
+
+
+class UnstructuredCode(Exception):
+    """
+    Raised when jumps don't form the loops and branches the InstructionGenerator
+    creates.
+    """
+
+
+class PyCompiler:
+    """
+    Translates the instructions of all functions into Python source code and runs it.
+
+    Every Aaa function becomes a Python function. Because of type checking the stack
+    size at every instruction is known, so stack items are local variables s0, s1, ...
+    and arguments are parameters a0, a1, ...
+
+    Jumps created for loops and branches become `while` and `if` again. Functions
+    with jumps that don't match that, for example when the PeepholeOptimizer threaded
+    them, run a loop that dispatches basic blocks instead.
+
+    Aaa function calls are Python function calls. Code runs in a thread with a big
+    stack and a high recursion limit, so deep recursion still works.
+    """
+
+    def __init__(
+        self,
+        program: Program,
+        verbose: bool = False,
+        output: Optional[TextIO] = None,
+        output_buffer_size: int = DEFAULT_BUFFER_SIZE,
+        input: Optional[TextIO] = None,
+    ) -> None:
+        self.program = program
+        self.verbose = verbose
+
+        # Printed values go here, output defaults to sys.stdout when running
+        self.output = OutputBuffer(output, output_buffer_size)
+
+        # Read from by SysCall instructions, input defaults to sys.stdin
+        self.input = input
+
+        # Objects used by generated code, by the name it uses for them
+        self.constants: Dict[str, Any] = {}
+
+        # Name of generated Python function for each Aaa function
+        self.function_names: Dict[Path, Dict[str, str]] = {}
+
+        for file, functions in program.function_instructions.items():
+            self.function_names[file] = {}
+            for name in functions:
+                # Functions in different files can have the same name
+                index = sum(len(names) for names in self.function_names.values())
+                python_name = f"aaa_{index}_" + re.sub(r"\W", "_", name)
+                self.function_names[file][name] = python_name
+
+        # Maps code objects of generated functions to Aaa function, for stack traces
+        self.compiled_code: Dict[CodeType, Tuple[Function, Path]] = {}
+
+        # Backward jumps of function being generated, by target
+        self.back_jumps: Dict[int, List[int]] = {}
+
+    def generate(self) -> str:
+        self.constants = {}
+        lines: List[str] = []
+
+        for file, functions in self.program.function_instructions.items():
+            for name, instructions in functions.items():
+                lines += self._generate_function(file, name, instructions)
+                lines.append("")
+
+        return "\n".join(lines)
+
+    def run(self, raise_: bool = False) -> None:
+        source = self.generate()
+
+        if self.verbose:  # pragma: nocover
+            print(source, file=sys.stderr)
+            print("---", file=sys.stderr)
+
+        self.output.start()
+        sys_calls = SysCalls(self.input, before_stdin_read=self._before_stdin_read)
+
+        namespace: Dict[str, Any] = {
+            "RootType": RootType,
+            "array": array,
+            "Variable": Variable,
+            "assertion_failure": self._assertion_failure,
+            "extend_vec": extend_vec,
+            "fill_vec": fill_vec,
+            "format_value": format_value,
+            "get_vec_item": get_vec_item,
+            "iterate_map_items": iterate_map_items,
+            "iterate_map_keys": iterate_map_keys,
+            "iterate_map_values": iterate_map_values,
+            "next_item": next_item,
+            "next_map_item": next_map_item,
+            "pop_vec_item": pop_vec_item,
+            "slice_vec": slice_vec,
+            "strbuf_size": strbuf_size,
+            "strbuf_to_str": strbuf_to_str,
+            "sys_calls": sys_calls,
+            "unpack_vec": unpack_vec,
+            "write": self.output.write,
+        }
+        namespace.update(self.constants)
+
+        exec(compile(source, "<aaa>", "exec"), namespace)
+
+        for file, functions in self.function_names.items():
+            for name, python_name in functions.items():
+                function = self.program.get_identifier(file, name)
+                assert isinstance(function, Function)
+                self.compiled_code[namespace[python_name].__code__] = (function, file)
+
+        main = namespace[self.function_names[self.program.entry_point_file]["main"]]
+
+        try:
+            self._run_in_thread(main)
+        except AaaRuntimeException as e:
+            # Show output of the program before the error
+            self.output.flush()
+            print(e, file=sys.stderr)
+            if raise_:  # This is for testing. TODO find better solution
+                raise e
+            else:  # pragma: nocover
+                exit(1)
+        finally:
+            self.output.flush()
+            sys_calls.close()
+
+    def _before_stdin_read(self) -> None:
+        # Interactive programs should show their prompt before waiting for input
+        if self.output.line_buffered:
+            self.output.flush()
+
+    def _run_in_thread(self, main: Callable[[], None]) -> None:
+        """
+        Runs main in a thread with a big stack, so Aaa code can recurse deeply.
+        """
+
+        exceptions: List[BaseException] = []
+
+        def run_main() -> None:
+            try:
+                main()
+            except BaseException as e:
+                exceptions.append(e)
+
+        # Both are process-wide, so they are restored for the embedding program
+        recursion_limit = sys.getrecursionlimit()
+        stack_size = threading.stack_size()
+
+        try:
+            threading.stack_size(THREAD_STACK_SIZE)
+            sys.setrecursionlimit(RECURSION_LIMIT)
+
+            thread = threading.Thread(target=run_main)
+            thread.start()
+            thread.join()
+        finally:
+            sys.setrecursionlimit(recursion_limit)
+            threading.stack_size(stack_size)
+
+        if exceptions:
+            raise exceptions[0]
+
+    def _assertion_failure(self) -> NoReturn:
+        call_stack: List[CallStackItem] = []
+        frame: Optional[FrameType] = sys._getframe(1)
+
+        while frame:
+            if frame.f_code in self.compiled_code:
+                function, file = self.compiled_code[frame.f_code]
+                argument_values = [
+                    frame.f_locals[f"a{i}"] for i in range(len(function.arguments))
+                ]
+                call_stack.append(
+                    CallStackItem(function, file, [], deepcopy(argument_values))
+                )
+            frame = frame.f_back
+
+        call_stack.reverse()
+        raise AaaAssertionFailure(call_stack)
+
+    def _constant(self, value: Any) -> str:
+        name = f"c{len(self.constants)}"
+        self.constants[name] = value
+        return name
+
+    def _generate_function(
+        self, file: Path, name: str, instructions: List[Instruction]
+    ) -> List[str]:
+        function = self.program.get_identifier(file, name)
+        assert isinstance(function, Function)
+
+        arguments = ", ".join(f"a{i}" for i in range(len(function.arguments)))
+        lines = [f"def {self.function_names[file][name]}({arguments}):"]
+
+        self.back_jumps = {}
+        for offset, instruction in enumerate(instructions):
+            if isinstance(instruction, Jump):
+                target = instruction.instruction_offset
+                if target < offset:
+                    self.back_jumps.setdefault(target, []).append(offset)
+
+        constant_count = len(self.constants)
+
+        try:
+            body, depth = self._structured(instructions, 0, len(instructions), 0)
+            body.append(self._return(depth))
+
+            # Tail calls start the function over by continuing this loop
+            if any(isinstance(instruction, TailCall) for instruction in instructions):
+                body = ["while True:"] + _indent(body)
+        except UnstructuredCode:
+            # Remove constants of failed attempt
+            for name in list(self.constants)[constant_count:]:
+                del self.constants[name]
+
+            body = self._dispatch_loop(instructions)
+
+        return lines + _indent(body)
+
+    def _return(self, depth: int) -> str:
+        return ("return " + ", ".join(f"s{i}" for i in range(depth))).strip()
+
+    def _structured(
+        self, instructions: List[Instruction], start: int, end: int, depth: int
+    ) -> Tuple[List[str], int]:
+        """
+        Generates code for instructions in [start, end), in which jumps can only
+        target an offset in [start, end]. Returns code and stack depth at end.
+        """
+
+        lines: List[str] = []
+        offset = start
+
+        while offset < end:
+            instruction = instructions[offset]
+            loop_jumps = [
+                jump for jump in self.back_jumps.get(offset, []) if jump < end
+            ]
+
+            if loop_jumps:
+                loop_end = max(loop_jumps)
+                code, depth = self._loop(instructions, offset, loop_end, depth)
+                offset = loop_end + 1
+
+            elif type(instruction) in CONDITIONAL_JUMPS:
+                code, depth, offset = self._branch(instructions, offset, end, depth)
+
+            elif isinstance(instruction, Jump):
+                raise UnstructuredCode
+
+            else:
+                code, depth = self._instruction(instruction, depth)
+                offset += 1
+
+                if isinstance(instruction, TailCall):
+                    # Tail calls are never inside loops, see _generate_function()
+                    code.append("continue")
+
+            lines += code
+
+        return lines, depth
+
+    def _loop(
+        self, instructions: List[Instruction], start: int, loop_end: int, depth: int
+    ) -> Tuple[List[str], int]:
+        # The jump at loop_end jumps back to start, the condition jumps beyond it
+        for offset in range(start, loop_end):
+            instruction = instructions[offset]
+            if (
+                type(instruction) in CONDITIONAL_JUMPS
+                and getattr(instruction, "instruction_offset") == loop_end + 1
+            ):
+                condition_end = offset
+                break
+        else:
+            raise UnstructuredCode
+
+        condition_code, depth = self._structured(
+            instructions, start, condition_end, depth
+        )
+        condition, depth = self._condition(instructions[condition_end], depth)
+        body_code, body_depth = self._structured(
+            instructions, condition_end + 1, loop_end, depth
+        )
+
+        if body_depth != depth:  # pragma: nocover
+            raise UnstructuredCode
+
+        lines = ["while True:"]
+        lines += _indent(condition_code)
+        lines += _indent([f"if not {condition}:", "    break"])
+        lines += _indent(body_code)
+        return lines, depth
+
+    def _branch(
+        self, instructions: List[Instruction], start: int, end: int, depth: int
+    ) -> Tuple[List[str], int, int]:
+        """
+        Returns code, stack depth after branch and offset of instruction after it.
+        """
+
+        jump = instructions[start]
+        else_offset: int = getattr(jump, "instruction_offset")
+
+        if not start < else_offset <= end:
+            raise UnstructuredCode
+
+        condition, depth = self._condition(jump, depth)
+
+        # Jump at end of if-body going beyond the else-body
+        if_end = instructions[else_offset - 1]
+
+        if (
+            else_offset - 1 > start
+            and isinstance(if_end, Jump)
+            and else_offset <= if_end.instruction_offset <= end
+        ):
+            branch_end = if_end.instruction_offset
+            if_code, if_depth = self._structured(
+                instructions, start + 1, else_offset - 1, depth
+            )
+            else_code, else_depth = self._structured(
+                instructions, else_offset, branch_end, depth
+            )
+        else:
+            branch_end = else_offset
+            if_code, if_depth = self._structured(
+                instructions, start + 1, else_offset, depth
+            )
+            else_code, else_depth = [], depth
+
+        if if_depth != else_depth:  # pragma: nocover
+            raise UnstructuredCode
+
+        lines = [f"if {condition}:"] + _indent(if_code or ["pass"])
+
+        if else_code:
+            lines += ["else:"] + _indent(else_code)
+
+        return lines, if_depth, branch_end
+
+    def _dispatch_loop(self, instructions: List[Instruction]) -> List[str]:
+        depths = self._stack_depths(instructions)
+        block_starts: Set[int] = {0}
+
+        for offset, instruction in enumerate(instructions):
+            if isinstance(instruction, Jump) or type(instruction) in CONDITIONAL_JUMPS:
+                block_starts.add(getattr(instruction, "instruction_offset"))
+                block_starts.add(offset + 1)
+            elif isinstance(instruction, TailCall):
+                block_starts.add(offset + 1)
+
+        blocks = sorted(block_starts | {len(instructions)})
+        lines = ["pc = 0", "while True:"]
+        keyword = "if"
+
+        for block_start, block_end in zip(blocks, blocks[1:]):
+            depth = depths[block_start]
+
+            if depth is None:
+                # Unreachable
+                continue
+
+            code: List[str] = []
+            next_pc = f"{block_end}"
+
+            for offset in range(block_start, block_end):
+                instruction = instructions[offset]
+
+                if isinstance(instruction, Jump):
+                    next_pc = f"{instruction.instruction_offset}"
+                elif type(instruction) in CONDITIONAL_JUMPS:
+                    condition, depth = self._condition(instruction, depth)
+                    target = getattr(instruction, "instruction_offset")
+                    next_pc = f"{offset + 1} if {condition} else {target}"
+                else:
+                    instruction_code, depth = self._instruction(instruction, depth)
+                    code += instruction_code
+
+                    if isinstance(instruction, TailCall):
+                        next_pc = "0"
+
+            code.append(f"pc = {next_pc}")
+            lines += _indent([f"{keyword} pc == {block_start}:"] + _indent(code))
+            keyword = "elif"
+
+        end_depth = depths[len(instructions)]
+        if end_depth is None:  # pragma: nocover
+            end_depth = 0
+
+        lines += _indent(["else:", "    " + self._return(end_depth)])
+        return lines
+
+    def _stack_depths(self, instructions: List[Instruction]) -> List[Optional[int]]:
+        """
+        Returns stack depth before each instruction, and at the end of the function.
+        Unreachable instructions get None.
+        """
+
+        depths: List[Optional[int]] = [None] * (len(instructions) + 1)
+        depths[0] = 0
+        todo = [0]
+
+        while todo:
+            offset = todo.pop()
+            depth = depths[offset]
+            assert depth is not None
+
+            if offset == len(instructions):
+                continue
+
+            instruction = instructions[offset]
+            successors = [offset + 1]
+
+            if isinstance(instruction, Jump):
+                successors = [instruction.instruction_offset]
+            elif type(instruction) in CONDITIONAL_JUMPS:
+                _, depth = self._condition(instruction, depth)
+                successors.append(getattr(instruction, "instruction_offset"))
+            else:
+                _, depth = self._instruction(instruction, depth)
+
+            for successor in successors:
+                if depths[successor] is None:
+                    depths[successor] = depth
+                    todo.append(successor)
+
+        return depths
+
+    def _condition(self, instruction: Instruction, depth: int) -> Tuple[str, int]:
+        """
+        Returns condition for not taking a conditional jump and stack depth after it.
+        """
+
+        operator = CONDITIONAL_JUMPS[type(instruction)]
+
+        if not operator:
+            return f"s{depth - 1}", depth - 1
+
+        return f"s{depth - 2} {operator} s{depth - 1}", depth - 2
+
+    def _instruction(
+        self, instruction: Instruction, depth: int
+    ) -> Tuple[List[str], int]:
+        """
+        Returns code for a non-jump instruction and stack depth after it.
+        """
+
+        slots = {
+            "x": f"s{depth - 1}",
+            "y": f"s{depth - 2}",
+            "z": f"s{depth - 3}",
+            "n0": f"s{depth}",
+            "n1": f"s{depth + 1}",
+            "n2": f"s{depth + 2}",
+        }
+
+        if isinstance(instruction, (PushInt, PushBool, PushString)):
+            template, change = f"{{n0}} = {instruction.value!r}", 1
+
+        elif isinstance(instruction, IntPlusImmediate):
+            template, change = f"{{x}} = {{x}} + {instruction.value!r}", 0
+
+        elif isinstance(instruction, PushFunctionArgument):
+            template, change = f"{{n0}} = a{instruction.arg_index}", 1
+
+        elif isinstance(instruction, PushVec):
+            type_params = self._constant([instruction.item_type])
+            items = repr(vec_items(instruction.item_type))
+            template = f"{{n0}} = Variable(RootType.VECTOR, {items}, {type_params})"
+            change = 1
+
+        elif isinstance(instruction, (VecGet, VecPop, VecPush, VecSet)):
+            template, change = self._vec_item_instruction(instruction)
+
+        elif isinstance(instruction, PushMap):
+            type_params = self._constant(
+                [instruction.key_type, instruction.value_type]
+            )
+            template = f"{{n0}} = Variable(RootType.MAPPING, {{{{}}}}, {type_params})"
+            change = 1
+
+        elif isinstance(instruction, PushSet):
+            type_params = self._constant([instruction.item_type])
+            template = f"{{n0}} = Variable(RootType.SET, {{{{}}}}, {type_params})"
+            change = 1
+
+        elif isinstance(instruction, PushIterator):
+            # Empty iterators never change, so they can be shared
+            zero = self._constant(Variable.zero_value(instruction.type))
+            template, change = f"{{n0}} = {zero}", 1
+
+        elif isinstance(instruction, PushStruct):
+            zero = self._constant(zero_struct(instruction.type))
+            template, change = f"{{n0}} = {zero}.copy()", 1
+
+        elif isinstance(instruction, GetStructField):
+            template, change = f"{{n0}} = {{x}}.value[{instruction.slot}]", 1
+
+        elif isinstance(instruction, SetStructField):
+            template, change = f"{{y}}.writable()[{instruction.slot}] = {{x}}", -1
+
+        elif isinstance(instruction, IterNext):
+            template, change = "{n0}, {n1} = next_item({x})", 2
+
+        elif isinstance(instruction, MapIterNext):
+            template, change = "{n0}, {n1}, {n2} = next_map_item({x})", 3
+
+        elif isinstance(instruction, CallFunction):
+            return self._call_function(instruction, depth)
+
+        elif isinstance(instruction, SysCall):
+            return self._sys_call(instruction, depth)
+
+        elif isinstance(instruction, TailCall):
+            return self._tail_call(instruction, depth)
+
+        else:
+            template, change = INSTRUCTION_TEMPLATES[type(instruction)]
+
+        code = template.format(**slots)
+        lines = code.split("\n") if code else []
+        return lines, depth + change
+
+    def _vec_item_instruction(
+        self, instruction: VecGet | VecPop | VecPush | VecSet
+    ) -> Tuple[str, int]:
+        """
+        Returns template and stack size change of instructions that depend on how vec
+        items are stored, see Variable.
+        """
+
+        # Storage of vecs with a placeholder item type is only known at runtime
+        generic = isinstance(instruction.item_type, TypePlaceholder)
+
+        # Reading items from an array of bools gives ints
+        read = "bool({})" if instruction.item_type == Bool else "{}"
+
+        # Ints too big for an array of ints turn it into a list
+        if instruction.item_type == Int or generic:
+            change_items = "try:\n    {0}\nexcept OverflowError:\n    {1}"
+        else:
+            change_items = "{0}"
+
+        if isinstance(instruction, VecGet):
+            if generic:
+                return "{x} = get_vec_item({y}.value, {x})", 0
+            return "{x} = " + read.format("{y}.value[{x}]"), 0
+
+        if isinstance(instruction, VecPop):
+            if generic:
+                return "{n0} = pop_vec_item({x})", 1
+            return "{n0} = " + read.format("{x}.writable().pop()"), 1
+
+        if isinstance(instruction, VecPush):
+            template = change_items.format(
+                "{y}.writable().append({x})", "unpack_vec({y}).append({x})"
+            )
+            return template, -1
+
+        template = change_items.format(
+            "{z}.writable()[{y}] = {x}", "unpack_vec({z})[{y}] = {x}"
+        )
+        return template, -2
+
+    def _call_function(
+        self, instruction: CallFunction, depth: int
+    ) -> Tuple[List[str], int]:
+        function = instruction.function
+        python_name = self.function_names[instruction.file][instruction.func_name]
+
+        arg_count = len(function.arguments)
+        return_count = len(function.return_types)
+        first = depth - arg_count
+
+        arguments = ", ".join(f"s{i}" for i in range(first, depth))
+        call = f"{python_name}({arguments})"
+
+        if return_count == 0:
+            line = call
+        elif return_count == 1:
+            line = f"s{first} = {call}"
+        else:
+            results = ", ".join(f"s{i}" for i in range(first, first + return_count))
+            line = f"{results} = {call}"
+
+        return [line], first + return_count
+
+    def _tail_call(self, instruction: TailCall, depth: int) -> Tuple[List[str], int]:
+        """
+        Returns code that replaces the arguments. The caller of this method makes the
+        function start over.
+        """
+
+        function = instruction.function
+        arg_count = len(function.arguments)
+        first = depth - arg_count
+
+        lines: List[str] = []
+        if arg_count:
+            arguments = ", ".join(f"a{i}" for i in range(arg_count))
+            values = ", ".join(f"s{i}" for i in range(first, depth))
+            lines.append(f"{arguments} = {values}")
+
+        return lines, first + len(function.return_types)
+
+    def _sys_call(self, instruction: SysCall, depth: int) -> Tuple[List[str], int]:
+        arg_count, return_count = SYS_CALL_STACK_EFFECTS[instruction.kind]
+        first = depth - arg_count
+
+        arguments = ", ".join(f"s{i}" for i in range(first, depth))
+        results = ", ".join(f"s{i}" for i in range(first, first + return_count))
+        call = f"sys_calls.{instruction.kind.name.lower()}({arguments})"
+
+        # System calls always return a tuple
+        if return_count == 1:
+            results += ","
+
+        return [f"{results} = {call}"], first + return_count
+
+
+def _indent(lines: List[str]) -> List[str]:
+    return ["    " + line for line in lines]
+
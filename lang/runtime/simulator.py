@@ -1,33 +1,46 @@
 import sys
 from copy import deepcopy
 from pathlib import Path
-from typing import Any, Callable, Dict, List, Type
+from typing import Any, Callable, Dict, List, Optional, TextIO, Type
 
 from lang.exceptions import AaaRuntimeException
 from lang.exceptions.runtime import AaaAssertionFailure
 from lang.instructions.types import (
+    SYS_CALL_STACK_EFFECTS,
     And,
     Assert,
     CallFunction,
     Divide,
     Drop,
     Dup,
-    Equals,
+    Dup2,
     GetStructField,
     Instruction,
+    IntEquals,
     IntGreaterEquals,
     IntGreaterThan,
     IntLessEquals,
     IntLessThan,
     IntNotEqual,
+    IntPlus,
+    IntPlusImmediate,
+    IterNext,
     Jump,
     JumpIfNot,
+    JumpIfNotIntEquals,
+    JumpIfNotIntGreaterEquals,
+    JumpIfNotIntGreaterThan,
+    JumpIfNotIntLessEquals,
+    JumpIfNotIntLessThan,
+    JumpIfNotIntNotEqual,
     MapClear,
     MapCopy,
     MapDrop,
     MapEmpty,
     MapGet,
     MapHasKey,
+    MapItems,
+    MapIterNext,
     MapKeys,
     MapPop,
     MapSet,
@@ -40,63 +53,140 @@ from lang.instructions.types import (
     Not,
     Or,
     Over,
-    Plus,
     Print,
     PushBool,
     PushFunctionArgument,
     PushInt,
+    PushIterator,
     PushMap,
+    PushSet,
+    PushStrbuf,
     PushString,
     PushStruct,
     PushVec,
     Rot,
+    SetAdd,
+    SetClear,
+    SetDrop,
+    SetHas,
+    SetSize,
     SetStructField,
+    StrConcat,
+    StrEquals,
+    StrbufAppend,
+    StrbufSize,
+    StrbufToStr,
     Swap,
+    SysCall,
+    TailCall,
     VecClear,
     VecCopy,
     VecEmpty,
+    VecExtend,
+    VecFill,
     VecGet,
     VecPop,
     VecPush,
+    VecReserve,
     VecSet,
     VecSize,
+    VecSlice,
 )
-from lang.models.parse import Function, TypeLiteral
+from lang.models.parse import Function
 from lang.models.runtime import CallStackItem
 from lang.runtime.debug import format_str
+from lang.runtime.limits import LimitChecker, Limits
+from lang.runtime.observer import Observer
+from lang.runtime.output import DEFAULT_BUFFER_SIZE, OutputBuffer
 from lang.runtime.program import Program
+from lang.runtime.syscalls import SysCalls
 from lang.typing.types import (
+    Bool,
+    Int,
     RootType,
+    SignatureItem,
+    TypePlaceholder,
     Variable,
-    VariableType,
-    bool_var,
-    int_var,
-    str_var,
+    extend_vec,
+    fill_vec,
+    format_value,
+    get_vec_item,
+    iterate_map_items,
+    iterate_map_keys,
+    iterate_map_values,
+    next_item,
+    next_map_item,
+    pop_vec_item,
+    repr_value,
+    slice_vec,
+    strbuf_size,
+    strbuf_to_str,
+    unpack_vec,
+    vec_items,
+    zero_struct,
+)
+
+
+# Decoded instruction: gets the current instruction pointer and returns the next one
+Handler = Callable[[int], int]
+
+# Instructions that push a new container, struct or iterator, reported to observers
+ALLOCATING_INSTRUCTIONS = (
+    MapCopy,
+    MapItems,
+    MapKeys,
+    MapValues,
+    PushIterator,
+    PushMap,
+    PushSet,
+    PushStrbuf,
+    PushStruct,
+    PushVec,
+    VecCopy,
+    VecSlice,
 )
 
 
 class Simulator:
-    def __init__(self, program: Program, verbose: bool = False) -> None:
+    def __init__(
+        self,
+        program: Program,
+        verbose: bool = False,
+        output: Optional[TextIO] = None,
+        output_buffer_size: int = DEFAULT_BUFFER_SIZE,
+        input: Optional[TextIO] = None,
+        limits: Optional[Limits] = None,
+    ) -> None:
         self.program = program
-        self.stack: List[Variable] = []
+        # Holds plain int, bool and str values and Variable for everything else
+        self.stack: List[Any] = []
         self.call_stack: List[CallStackItem] = []
         self.verbose = verbose
 
+        # Printed values go here, output defaults to sys.stdout when running
+        self.output = OutputBuffer(output, output_buffer_size)
+
+        # Read from by SysCall instructions, input defaults to sys.stdin
+        self.sys_calls = SysCalls(input, before_stdin_read=self._before_stdin_read)
+
+        # These turn an Instruction into a Handler, which is run by run_code()
         self.instruction_funcs: Dict[
-            Type[Instruction], Callable[[Instruction], int]
+            Type[Instruction], Callable[[Instruction], Handler]
         ] = {
             And: self.instruction_and,
             Assert: self.instruction_assert,
             CallFunction: self.instruction_call_function,
+            TailCall: self.instruction_tail_call,
             Divide: self.instruction_divide,
             Drop: self.instruction_drop,
             Dup: self.instruction_dup,
-            Equals: self.instruction_equals,
+            IntEquals: self.instruction_int_equals,
             IntGreaterEquals: self.instruction_int_greater_equals,
             IntGreaterThan: self.instruction_int_greater_than,
             IntLessEquals: self.instruction_int_less_equals,
             IntLessThan: self.instruction_int_less_than,
             IntNotEqual: self.instruction_int_not_equal,
+            IntPlus: self.instruction_int_plus,
             Jump: self.instruction_jump,
             JumpIfNot: self.instruction_jump_if_not,
             Minus: self.instruction_minus,
@@ -106,7 +196,6 @@ class Simulator:
             Not: self.instruction_not,
             Or: self.instruction_or,
             Over: self.instruction_over,
-            Plus: self.instruction_plus,
             Print: self.instruction_print,
             PushBool: self.instruction_push_bool,
             PushFunctionArgument: self.instruction_push_function_argument,
@@ -114,8 +203,13 @@ class Simulator:
             PushMap: self.instruction_map_push,
             PushString: self.instruction_push_string,
             PushStruct: self.instruction_push_struct,
+            PushStrbuf: self.instruction_push_strbuf,
+            PushIterator: self.instruction_push_iterator,
             PushVec: self.instruction_push_vec,
+            PushSet: self.instruction_push_set,
             Rot: self.instruction_rot,
+            StrConcat: self.instruction_str_concat,
+            StrEquals: self.instruction_str_equals,
             Swap: self.instruction_swap,
             VecPush: self.instruction_vec_push,
             VecPop: self.instruction_vec_pop,
@@ -125,6 +219,10 @@ class Simulator:
             VecEmpty: self.instruction_vec_empty,
             VecClear: self.instruction_vec_clear,
             VecCopy: self.instruction_vec_copy,
+            VecExtend: self.instruction_vec_extend,
+            VecSlice: self.instruction_vec_slice,
+            VecFill: self.instruction_vec_fill,
+            VecReserve: self.instruction_vec_reserve,
             MapGet: self.instruction_map_get,
             MapSet: self.instruction_map_set,
             MapHasKey: self.instruction_map_has_key,
@@ -136,33 +234,198 @@ class Simulator:
             MapCopy: self.instruction_map_copy,
             MapKeys: self.instruction_map_keys,
             MapValues: self.instruction_map_values,
+            MapItems: self.instruction_map_items,
+            StrbufAppend: self.instruction_strbuf_append,
+            StrbufToStr: self.instruction_strbuf_to_str,
+            StrbufSize: self.instruction_strbuf_size,
+            IterNext: self.instruction_iter_next,
+            MapIterNext: self.instruction_map_iter_next,
+            SetAdd: self.instruction_set_add,
+            SetHas: self.instruction_set_has,
+            SetDrop: self.instruction_set_drop,
+            SetSize: self.instruction_set_size,
+            SetClear: self.instruction_set_clear,
             GetStructField: self.instruction_get_struct_field,
             SetStructField: self.instruction_set_struct_field,
+            IntPlusImmediate: self.instruction_int_plus_immediate,
+            SysCall: self.instruction_sys_call,
+            Dup2: self.instruction_dup2,
+            JumpIfNotIntEquals: self.instruction_jump_if_not_int_equals,
+            JumpIfNotIntNotEqual: self.instruction_jump_if_not_int_not_equal,
+            JumpIfNotIntLessThan: self.instruction_jump_if_not_int_less_than,
+            JumpIfNotIntLessEquals: self.instruction_jump_if_not_int_less_equals,
+            JumpIfNotIntGreaterThan: self.instruction_jump_if_not_int_greater_than,
+            JumpIfNotIntGreaterEquals: (
+                self.instruction_jump_if_not_int_greater_equals
+            ),
+        }
+
+        # Every function is decoded once, so running it doesn't touch any Instruction
+        self.decoded_functions: Dict[Path, Dict[str, List[Handler]]] = {
+            file: {name: [] for name in functions}
+            for file, functions in self.program.function_instructions.items()
         }
 
-    def top(self) -> Variable:
-        return self.stack[-1]
+        # Lists are filled in place, so CallFunction handlers can refer to them
+        # before the called function has been decoded.
+        for file, functions in self.program.function_instructions.items():
+            for name, instructions in functions.items():
+                self.decoded_functions[file][name] += self.decode(instructions)
+
+        # Stops programs that run too long or use too much memory
+        self.limit_checker: Optional[LimitChecker] = None
+        if limits and limits.any():
+            self.limit_checker = LimitChecker(self, limits)
+
+        # Notified while running, see add_observer()
+        self.observers: List[Observer] = []
+
+        # Instructions executed while observed, and count at which to sample next
+        self.observed_count = [0]
+        self.next_sample = [0]
+
+    def decode(self, instructions: List[Instruction]) -> List[Handler]:
+        code = [
+            self.instruction_funcs[type(instruction)](instruction)
+            for instruction in instructions
+        ]
+
+        # Reaching the end of a function, including by jumping there, returns
+        code.append(self.return_handler())
+        return code
+
+    def return_handler(self) -> Handler:
+        call_stack = self.call_stack
+
+        def return_(ip: int) -> int:
+            call_stack.pop()
+            return -1
+
+        return return_
+
+    def add_observer(self, observer: Observer) -> None:
+        """
+        Notifies observer while running. Handlers are only wrapped when the first
+        observer is added, so without observers running costs nothing extra.
+        """
+
+        if not self.observers:
+            for file, functions in self.decoded_functions.items():
+                for name, code in functions.items():
+                    instructions = self.program.function_instructions[file][name]
+
+                    # Lists are replaced in place, because CallFunction handlers
+                    # refer to them
+                    code[:] = [
+                        self._observed(handler, instructions, ip)
+                        for ip, handler in enumerate(code)
+                    ]
+
+        self.observers.append(observer)
+        self._schedule_sample()
+
+    def executed_instructions(self) -> int:
+        """
+        Returns number of instructions executed since the first observer was added.
+        """
+
+        return self.observed_count[0]
+
+    def _observed(
+        self, handler: Handler, instructions: List[Instruction], ip: int
+    ) -> Handler:
+        if ip == len(instructions):
+            left = self._function_left
+
+            def observed_return(ip: int) -> int:
+                left()
+                return handler(ip)
+
+            return observed_return
+
+        instruction = instructions[ip]
+        observed = handler
+
+        if isinstance(instruction, CallFunction):
+            entered = self._function_entered
+
+            def observed_call(ip: int) -> int:
+                result = handler(ip)
+                entered()
+                return result
+
+            observed = observed_call
+
+        elif isinstance(instruction, TailCall):
+            entered, left = self._function_entered, self._function_left
+
+            def observed_tail_call(ip: int) -> int:
+                left()
+                result = handler(ip)
+                entered()
+                return result
+
+            observed = observed_tail_call
+
+        elif isinstance(instruction, ALLOCATING_INSTRUCTIONS):
+            stack = self.stack
+            allocated = self._allocated
+
+            def observed_allocation(ip: int) -> int:
+                result = handler(ip)
+                allocated(stack[-1])
+                return result
+
+            observed = observed_allocation
+
+        count = self.observed_count
+        next_sample = self.next_sample
+        sample = self._sample
+
+        def counted(ip: int) -> int:
+            count[0] += 1
+            if count[0] == next_sample[0]:
+                sample()
+            return observed(ip)
+
+        return counted
+
+    def _schedule_sample(self) -> None:
+        count = self.observed_count[0]
+
+        # Zero never matches, because the count is increased before comparing
+        self.next_sample[0] = min(
+            (
+                (count // observer.sample_interval + 1) * observer.sample_interval
+                for observer in self.observers
+                if observer.sample_interval > 0
+            ),
+            default=0,
+        )
 
-    def push(self, item: Variable) -> None:
-        self.stack.append(item)
+    def _sample(self) -> None:
+        count = self.observed_count[0]
 
-    def pop(self) -> Variable:
-        return self.stack.pop()
+        for observer in self.observers:
+            interval = observer.sample_interval
+            if interval > 0 and count % interval == 0:
+                observer.sample(self)
 
-    def get_function_argument(self, arg_name: str) -> Variable:
-        return self.call_stack[-1].argument_values[arg_name]
+        self._schedule_sample()
 
-    def get_instruction_pointer(self) -> int:
-        return self.call_stack[-1].instruction_pointer
+    def _function_entered(self) -> None:
+        for observer in self.observers:
+            observer.function_entered(self)
 
-    def set_instruction_pointer(self, offset: int) -> None:
-        self.call_stack[-1].instruction_pointer = offset
+    def _function_left(self) -> None:
+        for observer in self.observers:
+            observer.function_left(self)
 
-    def print_debug_info(self) -> None:  # pragma: nocover
-        if not self.verbose:
-            return
+    def _allocated(self, variable: Variable) -> None:
+        for observer in self.observers:
+            observer.allocated(self, variable)
 
-        ip = self.get_instruction_pointer()
+    def print_debug_info(self, ip: int) -> None:  # pragma: nocover
         call_stack_item = self.call_stack[-1]
         func_name = call_stack_item.function.identify()
         instructions = self.program.get_instructions(
@@ -179,7 +442,7 @@ class Simulator:
         instruction = format_str(instruction, max_length=30)
         func_name = format_str(func_name, max_length=15)
 
-        stack_str = " ".join(repr(item) for item in self.stack)
+        stack_str = " ".join(repr_value(item) for item in self.stack)
         stack_str = format_str(stack_str, max_length=60)
 
         print(
@@ -191,472 +454,1130 @@ class Simulator:
         if self.verbose:  # pragma: nocover
             self.program.print_all_instructions()
 
+        self.output.start()
+
+        for observer in self.observers:
+            observer.started(self)
+
         try:
             self.call_function(self.program.entry_point_file, "main")
+            self._function_entered()
+
+            if self.limit_checker:
+                self.limit_checker.start()
+
+            if self.verbose:  # pragma: nocover
+                self.run_code_verbose()
+            else:
+                self.run_code()
         except AaaRuntimeException as e:
+            # Show output of the program before the error
+            self.output.flush()
             print(e, file=sys.stderr)
             if raise_:  # This is for testing. TODO find better solution
                 raise e
             else:  # pragma: nocover
                 exit(1)
+        finally:
+            self.output.flush()
+            self.sys_calls.close()
+
+            for observer in self.observers:
+                observer.finished(self)
+
+    def _before_stdin_read(self) -> None:
+        # Interactive programs should show their prompt before waiting for input
+        if self.output.line_buffered:
+            self.output.flush()
 
     def call_function(self, file: Path, func_name: str) -> None:
+        """
+        Moves arguments from the stack into a new CallStackItem.
+        The function starts running when control returns to run_code().
+        """
+
         function = self.program.get_identifier(file, func_name)
 
         # If this assertion breaks, then Aaa's type checking is broken
         assert isinstance(function, Function)
 
-        argument_values: Dict[str, Variable] = {}
+        arg_count = len(function.arguments)
+        argument_values = self.stack[len(self.stack) - arg_count :]
+        del self.stack[len(self.stack) - arg_count :]
 
-        for argument in reversed(function.arguments):
-            argument_values[argument.name] = self.pop()
+        code = self.decoded_functions[file][str(function.name)]
 
-        self.call_stack.append(
-            CallStackItem(
-                function=function,
-                source_file=file,
-                instruction_pointer=0,
-                argument_values=argument_values,
-            )
-        )
+        self.call_stack.append(CallStackItem(function, file, code, argument_values))
 
-        instructions = self.program.get_instructions(file, str(function.name))
+    def run_code(self) -> None:
+        call_stack = self.call_stack
 
-        while True:
-            instruction_pointer = self.get_instruction_pointer()
+        # Handlers that call or return switch CallStackItem by returning -1
+        while call_stack:
+            call_stack_item = call_stack[-1]
+            code = call_stack_item.code
+            ip = call_stack_item.instruction_pointer
 
-            try:
-                instruction = instructions[instruction_pointer]
-            except IndexError:
-                # We hit the end of the function
-                break
+            # This is the hot loop, keep it as small as possible
+            while ip >= 0:
+                ip = code[ip](ip)
 
-            # Excecute the instruction and get value for next instruction ointer
-            next_instruction = self.instruction_funcs[type(instruction)](instruction)
-            self.print_debug_info()
-            self.set_instruction_pointer(next_instruction)
+    def run_code_verbose(self) -> None:  # pragma: nocover
+        call_stack = self.call_stack
 
-        self.call_stack.pop()
+        while call_stack:
+            call_stack_item = call_stack[-1]
+            code = call_stack_item.code
+            ip = call_stack_item.instruction_pointer
 
-    def instruction_push_int(self, instruction: Instruction) -> int:
+            while ip >= 0:
+                self.print_debug_info(ip)
+                ip = code[ip](ip)
+
+    def instruction_push_int(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, PushInt)
-        self.push(int_var(instruction.value))
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+        value = instruction.value
+
+        def push_int(ip: int) -> int:
+            stack.append(value)
+            return ip + 1
+
+        return push_int
+
+    def instruction_int_plus(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, IntPlus)
+        stack = self.stack
+
+        def int_plus(ip: int) -> int:
+            x: int = stack.pop()
+            stack[-1] = stack[-1] + x
+            return ip + 1
 
-    def instruction_plus(self, instruction: Instruction) -> int:
-        assert isinstance(instruction, Plus)
-        x: int | str = self.pop().value
-        y: int | str = self.pop().value
+        return int_plus
 
-        # TODO make different instruction for string concatenation
+    def instruction_str_concat(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, StrConcat)
+        stack = self.stack
 
-        if type(x) is int:
-            total = int_var(y + x)  # type: ignore
-        else:
-            total = str_var(y + x)  # type: ignore
+        def str_concat(ip: int) -> int:
+            x: str = stack.pop()
+            stack[-1] = stack[-1] + x
+            return ip + 1
 
-        self.push(total)
-        return self.get_instruction_pointer() + 1
+        return str_concat
 
-    def instruction_minus(self, instruction: Instruction) -> int:
+    def instruction_minus(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Minus)
-        x: int = self.pop().value
-        y: int = self.pop().value
-        self.push(int_var(y - x))
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
 
-    def instruction_multiply(self, instruction: Instruction) -> int:
+        def minus(ip: int) -> int:
+            x: int = stack.pop()
+            stack[-1] = stack[-1] - x
+            return ip + 1
+
+        return minus
+
+    def instruction_multiply(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Multiply)
-        x: int = self.pop().value
-        y: int = self.pop().value
-        self.push(int_var(x * y))
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+
+        def multiply(ip: int) -> int:
+            x: int = stack.pop()
+            stack[-1] = stack[-1] * x
+            return ip + 1
+
+        return multiply
 
-    def instruction_divide(self, instruction: Instruction) -> int:
+    def instruction_divide(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Divide)
-        x: int = self.pop().value
-        y: int = self.pop().value
+        stack = self.stack
 
-        if x == 0:
-            self.push(int_var(0))
-            self.push(bool_var(False))
-        else:
-            self.push(int_var(y // x))
-            self.push(bool_var(True))
+        def divide(ip: int) -> int:
+            x: int = stack.pop()
+            y: int = stack.pop()
 
-        return self.get_instruction_pointer() + 1
+            if x == 0:
+                stack.append(0)
+                stack.append(False)
+            else:
+                stack.append(y // x)
+                stack.append(True)
 
-    def instruction_modulo(self, instruction: Instruction) -> int:
+            return ip + 1
+
+        return divide
+
+    def instruction_modulo(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Modulo)
-        x: int = self.pop().value
-        y: int = self.pop().value
+        stack = self.stack
+
+        def modulo(ip: int) -> int:
+            x: int = stack.pop()
+            y: int = stack.pop()
 
-        if x == 0:
-            self.push(int_var(0))
-            self.push(bool_var(False))
-        else:
-            self.push(int_var(y % x))
-            self.push(bool_var(True))
+            if x == 0:
+                stack.append(0)
+                stack.append(False)
+            else:
+                stack.append(y % x)
+                stack.append(True)
 
-        return self.get_instruction_pointer() + 1
+            return ip + 1
 
-    def instruction_push_bool(self, instruction: Instruction) -> int:
+        return modulo
+
+    def instruction_push_bool(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, PushBool)
-        self.push(bool_var(instruction.value))
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+        value = instruction.value
+
+        def push_bool(ip: int) -> int:
+            stack.append(value)
+            return ip + 1
 
-    def instruction_and(self, instruction: Instruction) -> int:
+        return push_bool
+
+    def instruction_and(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, And)
-        x: bool = self.pop().value
-        y: bool = self.pop().value
-        self.push(bool_var(x and y))
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+
+        def and_(ip: int) -> int:
+            x: bool = stack.pop()
+            stack[-1] = stack[-1] and x
+            return ip + 1
 
-    def instruction_or(self, instruction: Instruction) -> int:
+        return and_
+
+    def instruction_or(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Or)
-        x: bool = self.pop().value
-        y: bool = self.pop().value
-        self.push(bool_var(x or y))
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+
+        def or_(ip: int) -> int:
+            x: bool = stack.pop()
+            stack[-1] = stack[-1] or x
+            return ip + 1
+
+        return or_
 
-    def instruction_not(self, instruction: Instruction) -> int:
+    def instruction_not(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Not)
-        x: bool = self.pop().value
-        self.push(bool_var(not x))
-        return self.get_instruction_pointer() + 1
-
-    def instruction_equals(self, instruction: Instruction) -> int:
-        assert isinstance(instruction, Equals)
-        x = self.pop().value
-        y = self.pop().value
-        self.push(bool_var(x == y))
-        return self.get_instruction_pointer() + 1
-
-    def instruction_int_less_than(self, instruction: Instruction) -> int:
+        stack = self.stack
+
+        def not_(ip: int) -> int:
+            stack[-1] = not stack[-1]
+            return ip + 1
+
+        return not_
+
+    def instruction_int_equals(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, IntEquals)
+        stack = self.stack
+
+        def int_equals(ip: int) -> int:
+            x: int = stack.pop()
+            stack[-1] = stack[-1] == x
+            return ip + 1
+
+        return int_equals
+
+    def instruction_str_equals(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, StrEquals)
+        stack = self.stack
+
+        def str_equals(ip: int) -> int:
+            x: str = stack.pop()
+            stack[-1] = stack[-1] == x
+            return ip + 1
+
+        return str_equals
+
+    def instruction_int_less_than(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, IntLessThan)
-        x: int = self.pop().value
-        y: int = self.pop().value
-        self.push(bool_var(y < x))
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+
+        def int_less_than(ip: int) -> int:
+            x: int = stack.pop()
+            stack[-1] = stack[-1] < x
+            return ip + 1
+
+        return int_less_than
 
-    def instruction_int_less_equals(self, instruction: Instruction) -> int:
+    def instruction_int_less_equals(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, IntLessEquals)
-        x: int = self.pop().value
-        y: int = self.pop().value
-        self.push(bool_var(y <= x))
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
 
-    def instruction_int_greater_than(self, instruction: Instruction) -> int:
+        def int_less_equals(ip: int) -> int:
+            x: int = stack.pop()
+            stack[-1] = stack[-1] <= x
+            return ip + 1
+
+        return int_less_equals
+
+    def instruction_int_greater_than(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, IntGreaterThan)
-        x: int = self.pop().value
-        y: int = self.pop().value
-        self.push(bool_var(y > x))
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+
+        def int_greater_than(ip: int) -> int:
+            x: int = stack.pop()
+            stack[-1] = stack[-1] > x
+            return ip + 1
 
-    def instruction_int_greater_equals(self, instruction: Instruction) -> int:
+        return int_greater_than
+
+    def instruction_int_greater_equals(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, IntGreaterEquals)
-        x: int = self.pop().value
-        y: int = self.pop().value
-        self.push(bool_var(y >= x))
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+
+        def int_greater_equals(ip: int) -> int:
+            x: int = stack.pop()
+            stack[-1] = stack[-1] >= x
+            return ip + 1
 
-    def instruction_int_not_equal(self, instruction: Instruction) -> int:
+        return int_greater_equals
+
+    def instruction_int_not_equal(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, IntNotEqual)
-        x = self.pop().value
-        y = self.pop().value
-        self.push(bool_var(y != x))
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+
+        def int_not_equal(ip: int) -> int:
+            x = stack.pop()
+            stack[-1] = stack[-1] != x
+            return ip + 1
 
-    def instruction_drop(self, instruction: Instruction) -> int:
+        return int_not_equal
+
+    def instruction_drop(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Drop)
-        self.pop()
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+
+        def drop(ip: int) -> int:
+            stack.pop()
+            return ip + 1
+
+        return drop
 
-    def instruction_dup(self, instruction: Instruction) -> int:
+    def instruction_dup(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Dup)
-        x = self.top()
-        self.push(x)
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
 
-    def instruction_swap(self, instruction: Instruction) -> int:
+        def dup(ip: int) -> int:
+            stack.append(stack[-1])
+            return ip + 1
+
+        return dup
+
+    def instruction_swap(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Swap)
-        x = self.pop()
-        y = self.pop()
-        self.push(x)
-        self.push(y)
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+
+        def swap(ip: int) -> int:
+            stack[-2], stack[-1] = stack[-1], stack[-2]
+            return ip + 1
+
+        return swap
 
-    def instruction_over(self, instruction: Instruction) -> int:
+    def instruction_over(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Over)
-        x = self.pop()
-        y = self.top()
-        self.push(x)
-        self.push(y)
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
 
-    def instruction_rot(self, instruction: Instruction) -> int:
+        def over(ip: int) -> int:
+            stack.append(stack[-2])
+            return ip + 1
+
+        return over
+
+    def instruction_rot(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Rot)
-        x = self.pop()
-        y = self.pop()
-        z = self.pop()
-        self.push(y)
-        self.push(x)
-        self.push(z)
-        return self.get_instruction_pointer() + 1
-
-    def instruction_print(self, instruction: Instruction) -> int:
+        stack = self.stack
+
+        def rot(ip: int) -> int:
+            stack.append(stack.pop(-3))
+            return ip + 1
+
+        return rot
+
+    def instruction_print(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Print)
-        x_var = self.pop()
-        print(x_var, end="")
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+        write = self.output.write
+
+        def print_(ip: int) -> int:
+            value = stack.pop()
+
+            # Skip format_value() for the most printed types
+            if type(value) is str:
+                write(value)
+            elif type(value) is int:
+                write(str(value))
+            else:
+                write(format_value(value))
 
-    def instruction_push_string(self, instruction: Instruction) -> int:
+            return ip + 1
+
+        return print_
+
+    def instruction_push_string(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, PushString)
-        self.push(str_var(instruction.value))
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+        value = instruction.value
 
-    def instruction_call_function(self, instruction: Instruction) -> int:
-        assert isinstance(instruction, CallFunction)
-        self.call_function(instruction.file, instruction.func_name)
-        return self.get_instruction_pointer() + 1
+        def push_string(ip: int) -> int:
+            stack.append(value)
+            return ip + 1
 
-    def instruction_push_function_argument(self, instruction: Instruction) -> int:
+        return push_string
+
+    def instruction_call_function(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, CallFunction)
+        stack = self.stack
+        call_stack = self.call_stack
+        function = instruction.function
+        file = instruction.file
+        code = self.decoded_functions[file][instruction.func_name]
+        arg_count = len(function.arguments)
+
+        def call(ip: int) -> int:
+            # Continue after this instruction once the called function returns
+            call_stack[-1].instruction_pointer = ip + 1
+
+            split = len(stack) - arg_count
+            argument_values = stack[split:]
+            del stack[split:]
+
+            call_stack.append(CallStackItem(function, file, code, argument_values))
+            return -1
+
+        return call
+
+    def instruction_tail_call(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, TailCall)
+        stack = self.stack
+        call_stack = self.call_stack
+        arg_count = len(instruction.function.arguments)
+
+        def tail_call(ip: int) -> int:
+            # The stack only holds the arguments, everything else was consumed
+            split = len(stack) - arg_count
+            call_stack[-1].argument_values = stack[split:]
+            del stack[split:]
+            return 0
+
+        return tail_call
+
+    def instruction_push_function_argument(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, PushFunctionArgument)
+        stack = self.stack
+        call_stack = self.call_stack
+        arg_index = instruction.arg_index
 
-        arg_value = self.get_function_argument(instruction.arg_name)
-        self.push(arg_value)
-        return self.get_instruction_pointer() + 1
+        def push_function_argument(ip: int) -> int:
+            stack.append(call_stack[-1].argument_values[arg_index])
+            return ip + 1
 
-    def instruction_jump_if_not(self, instruction: Instruction) -> int:
+        return push_function_argument
+
+    def instruction_jump_if_not(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, JumpIfNot)
+        stack = self.stack
+        target = instruction.instruction_offset
+
+        def jump_if_not(ip: int) -> int:
+            if stack.pop():
+                return ip + 1
+            return target
 
-        x: bool = self.pop().value
-        if x:
-            return self.get_instruction_pointer() + 1
-        else:
-            return instruction.instruction_offset
+        return jump_if_not
 
-    def instruction_jump(self, instruction: Instruction) -> int:
+    def instruction_jump(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Jump)
-        return instruction.instruction_offset
+        target = instruction.instruction_offset
 
-    def instruction_nop(self, instruction: Instruction) -> int:
+        def jump(ip: int) -> int:
+            return target
+
+        return jump
+
+    def instruction_nop(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Nop)
-        return self.get_instruction_pointer() + 1
 
-    def instruction_assert(self, instruction: Instruction) -> int:
+        def nop(ip: int) -> int:
+            return ip + 1
+
+        return nop
+
+    def instruction_assert(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, Assert)
-        x: bool = self.pop().value
+        stack = self.stack
+        call_stack = self.call_stack
+
+        def assert_(ip: int) -> int:
+            if not stack.pop():
+                call_stack_copy = deepcopy(call_stack)
+                raise AaaAssertionFailure(call_stack_copy)
 
-        if not x:
-            call_stack_copy = deepcopy(self.call_stack)
-            raise AaaAssertionFailure(call_stack_copy)
+            return ip + 1
 
-        return self.get_instruction_pointer() + 1
+        return assert_
 
-    def instruction_map_push(self, instruction: Instruction) -> int:
+    def instruction_map_push(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, PushMap)
-        map_var = Variable(
-            RootType.MAPPING,
-            {},
-            type_params=[instruction.key_type, instruction.value_type],
-        )
-        self.push(map_var)
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+        type_params: List[SignatureItem] = [
+            instruction.key_type,
+            instruction.value_type,
+        ]
+
+        def push_map(ip: int) -> int:
+            stack.append(Variable(RootType.MAPPING, {}, type_params=type_params))
+            return ip + 1
 
-    def instruction_push_vec(self, instruction: Instruction) -> int:
+        return push_map
+
+    def instruction_push_vec(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, PushVec)
-        map_var = Variable(
-            RootType.VECTOR,
-            [],
-            type_params=[instruction.item_type],
-        )
-        self.push(map_var)
-        return self.get_instruction_pointer() + 1
+        stack = self.stack
+        type_params: List[SignatureItem] = [instruction.item_type]
+
+        def push_vec(ip: int) -> int:
+            items = vec_items(instruction.item_type)
+            stack.append(Variable(RootType.VECTOR, items, type_params=type_params))
+            return ip + 1
 
-    def instruction_vec_push(self, instruction: Instruction) -> int:
+        return push_vec
+
+    def instruction_push_set(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, PushSet)
+        stack = self.stack
+        type_params: List[SignatureItem] = [instruction.item_type]
+
+        def push_set(ip: int) -> int:
+            stack.append(Variable(RootType.SET, {}, type_params=type_params))
+            return ip + 1
+
+        return push_set
+
+    def instruction_vec_push(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, VecPush)
-        x = self.pop()
-        vec: List[Variable] = self.top().value
+        stack = self.stack
+
+        def vec_push(ip: int) -> int:
+            x = stack.pop()
+            vec: List[Any] = stack[-1].writable()
+            vec.append(x)
+            return ip + 1
+
+        def vec_push_int(ip: int) -> int:
+            x = stack.pop()
+            vec: List[Any] = stack[-1].writable()
+
+            try:
+                vec.append(x)
+            except OverflowError:
+                unpack_vec(stack[-1]).append(x)
+
+            return ip + 1
 
-        vec.append(x)
-        return self.get_instruction_pointer() + 1
+        # Vecs with a placeholder item type can be arrays of ints too
+        if instruction.item_type == Int or isinstance(
+            instruction.item_type, TypePlaceholder
+        ):
+            return vec_push_int
+        return vec_push
 
-    def instruction_vec_pop(self, instruction: Instruction) -> int:
+    def instruction_vec_pop(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, VecPop)
-        vec: List[Variable] = self.top().value
+        stack = self.stack
 
-        x = vec.pop()
-        self.push(x)
+        def vec_pop(ip: int) -> int:
+            vec: List[Any] = stack[-1].writable()
+            stack.append(vec.pop())
+            return ip + 1
 
-        return self.get_instruction_pointer() + 1
+        def vec_pop_bool(ip: int) -> int:
+            vec: List[Any] = stack[-1].writable()
+            stack.append(bool(vec.pop()))
+            return ip + 1
 
-    def instruction_vec_get(self, instruction: Instruction) -> int:
-        assert isinstance(instruction, VecGet)
-        x: int = self.pop().value
-        vec: List[Variable] = self.top().value
+        def vec_pop_any(ip: int) -> int:
+            stack.append(pop_vec_item(stack[-1]))
+            return ip + 1
 
-        self.push(vec[x])
-        return self.get_instruction_pointer() + 1
+        if instruction.item_type == Bool:
+            return vec_pop_bool
+        if isinstance(instruction.item_type, TypePlaceholder):
+            return vec_pop_any
+        return vec_pop
 
-    def instruction_vec_set(self, instruction: Instruction) -> int:
+    def instruction_vec_get(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, VecGet)
+        stack = self.stack
+
+        def vec_get(ip: int) -> int:
+            x: int = stack.pop()
+            vec: List[Any] = stack[-1].value
+            stack.append(vec[x])
+            return ip + 1
+
+        def vec_get_bool(ip: int) -> int:
+            x: int = stack.pop()
+            vec: List[Any] = stack[-1].value
+            stack.append(bool(vec[x]))
+            return ip + 1
+
+        def vec_get_any(ip: int) -> int:
+            x: int = stack.pop()
+            stack.append(get_vec_item(stack[-1].value, x))
+            return ip + 1
+
+        if instruction.item_type == Bool:
+            return vec_get_bool
+        if isinstance(instruction.item_type, TypePlaceholder):
+            return vec_get_any
+        return vec_get
+
+    def instruction_vec_set(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, VecSet)
-        x: Any = self.pop()
-        index: int = self.pop().value
-        vec: List[Variable] = self.top().value
+        stack = self.stack
+
+        def vec_set(ip: int) -> int:
+            x = stack.pop()
+            index: int = stack.pop()
+            vec: List[Any] = stack[-1].writable()
+            vec[index] = x
+            return ip + 1
+
+        def vec_set_int(ip: int) -> int:
+            x = stack.pop()
+            index: int = stack.pop()
+            vec: List[Any] = stack[-1].writable()
+
+            try:
+                vec[index] = x
+            except OverflowError:
+                unpack_vec(stack[-1])[index] = x
+
+            return ip + 1
 
-        vec[index] = x
-        return self.get_instruction_pointer() + 1
+        if instruction.item_type == Int or isinstance(
+            instruction.item_type, TypePlaceholder
+        ):
+            return vec_set_int
+        return vec_set
 
-    def instruction_vec_size(self, instruction: Instruction) -> int:
+    def instruction_vec_size(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, VecSize)
-        vec: List[Variable] = self.top().value
+        stack = self.stack
 
-        self.push(int_var(len(vec)))
-        return self.get_instruction_pointer() + 1
+        def vec_size(ip: int) -> int:
+            vec: List[Any] = stack[-1].value
+            stack.append(len(vec))
+            return ip + 1
 
-    def instruction_vec_empty(self, instruction: Instruction) -> int:
+        return vec_size
+
+    def instruction_vec_empty(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, VecEmpty)
-        vec: List[Variable] = self.top().value
+        stack = self.stack
+
+        def vec_empty(ip: int) -> int:
+            vec: List[Any] = stack[-1].value
+            stack.append(not bool(vec))
+            return ip + 1
 
-        self.push(bool_var(not bool(vec)))
-        return self.get_instruction_pointer() + 1
+        return vec_empty
 
-    def instruction_vec_clear(self, instruction: Instruction) -> int:
+    def instruction_vec_clear(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, VecClear)
-        vec: List[Variable] = self.top().value
+        stack = self.stack
 
-        vec.clear()
-        return self.get_instruction_pointer() + 1
+        def vec_clear(ip: int) -> int:
+            vec: List[Any] = stack[-1].writable()
+            vec.clear()
+            return ip + 1
 
-    def instruction_vec_copy(self, instruction: Instruction) -> int:
+        return vec_clear
+
+    def instruction_vec_copy(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, VecCopy)
-        vec_var = self.top()
+        stack = self.stack
 
-        copied = Variable(
-            vec_var.root_type(),
-            deepcopy(vec_var.value),
-            deepcopy(vec_var.type.type_params),
-        )
+        def vec_copy(ip: int) -> int:
+            stack.append(stack[-1].copy())
+            return ip + 1
+
+        return vec_copy
 
-        self.push(copied)
-        return self.get_instruction_pointer() + 1
+    def instruction_vec_extend(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, VecExtend)
+        stack = self.stack
 
-    def instruction_map_get(self, instruction: Instruction) -> int:
+        def vec_extend(ip: int) -> int:
+            other = stack.pop()
+            extend_vec(stack[-1], other)
+            return ip + 1
+
+        return vec_extend
+
+    def instruction_vec_slice(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, VecSlice)
+        stack = self.stack
+
+        def vec_slice(ip: int) -> int:
+            end: int = stack.pop()
+            start: int = stack.pop()
+            stack.append(slice_vec(stack[-1], start, end))
+            return ip + 1
+
+        return vec_slice
+
+    def instruction_vec_fill(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, VecFill)
+        stack = self.stack
+
+        def vec_fill(ip: int) -> int:
+            item = stack.pop()
+            count: int = stack.pop()
+            fill_vec(stack[-1], count, item)
+            return ip + 1
+
+        return vec_fill
+
+    def instruction_vec_reserve(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, VecReserve)
+        stack = self.stack
+
+        def vec_reserve(ip: int) -> int:
+            # Python lists grow by themselves, only the C runtime uses this
+            stack.pop()
+            return ip + 1
+
+        return vec_reserve
+
+    def instruction_map_get(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, MapGet)
-        key = self.pop()
-        map: Dict[Variable, Variable] = self.top().value
+        stack = self.stack
 
-        self.push(map[key])
-        return self.get_instruction_pointer() + 1
+        def map_get(ip: int) -> int:
+            key = stack.pop()
+            map: Dict[Any, Any] = stack[-1].value
+            stack.append(map[key])
+            return ip + 1
 
-    def instruction_map_set(self, instruction: Instruction) -> int:
+        return map_get
+
+    def instruction_map_set(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, MapSet)
-        value = self.pop()
-        key = self.pop()
-        map: Dict[Variable, Variable] = self.top().value
+        stack = self.stack
+
+        def map_set(ip: int) -> int:
+            value = stack.pop()
+            key = stack.pop()
+            map: Dict[Any, Any] = stack[-1].writable()
+            map[key] = value
+            return ip + 1
 
-        map[key] = value
-        return self.get_instruction_pointer() + 1
+        return map_set
 
-    def instruction_map_has_key(self, instruction: Instruction) -> int:
+    def instruction_map_has_key(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, MapHasKey)
-        key = self.pop()
-        map: Dict[Variable, Variable] = self.top().value
+        stack = self.stack
+
+        def map_has_key(ip: int) -> int:
+            key = stack.pop()
+            map: Dict[Any, Any] = stack[-1].value
+            stack.append(key in map)
+            return ip + 1
 
-        self.push(bool_var(key in map))
-        return self.get_instruction_pointer() + 1
+        return map_has_key
 
-    def instruction_map_size(self, instruction: Instruction) -> int:
+    def instruction_map_size(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, MapSize)
-        map: Dict[Variable, Variable] = self.top().value
+        stack = self.stack
 
-        self.push(int_var(len(map)))
-        return self.get_instruction_pointer() + 1
+        def map_size(ip: int) -> int:
+            map: Dict[Any, Any] = stack[-1].value
+            stack.append(len(map))
+            return ip + 1
 
-    def instruction_map_empty(self, instruction: Instruction) -> int:
+        return map_size
+
+    def instruction_map_empty(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, MapEmpty)
-        map: Dict[Variable, Variable] = self.top().value
+        stack = self.stack
+
+        def map_empty(ip: int) -> int:
+            map: Dict[Any, Any] = stack[-1].value
+            stack.append(not bool(map))
+            return ip + 1
 
-        self.push(bool_var(not bool(map)))
-        return self.get_instruction_pointer() + 1
+        return map_empty
 
-    def instruction_map_pop(self, instruction: Instruction) -> int:
+    def instruction_map_pop(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, MapPop)
-        key = self.pop()
-        map: Dict[Variable, Variable] = self.top().value
+        stack = self.stack
 
-        self.push(map.pop(key))
-        return self.get_instruction_pointer() + 1
+        def map_pop(ip: int) -> int:
+            key = stack.pop()
+            map: Dict[Any, Any] = stack[-1].writable()
+            stack.append(map.pop(key))
+            return ip + 1
 
-    def instruction_map_drop(self, instruction: Instruction) -> int:
+        return map_pop
+
+    def instruction_map_drop(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, MapDrop)
-        key = self.pop()
-        map: Dict[Variable, Variable] = self.top().value
+        stack = self.stack
+
+        def map_drop(ip: int) -> int:
+            key = stack.pop()
+            map: Dict[Any, Any] = stack[-1].writable()
+            del map[key]
+            return ip + 1
 
-        del map[key]
-        return self.get_instruction_pointer() + 1
+        return map_drop
 
-    def instruction_map_clear(self, instruction: Instruction) -> int:
+    def instruction_map_clear(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, MapClear)
-        map: Dict[Variable, Variable] = self.top().value
+        stack = self.stack
 
-        map.clear()
-        return self.get_instruction_pointer() + 1
+        def map_clear(ip: int) -> int:
+            map: Dict[Any, Any] = stack[-1].writable()
+            map.clear()
+            return ip + 1
 
-    def instruction_map_copy(self, instruction: Instruction) -> int:
+        return map_clear
+
+    def instruction_map_copy(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, MapCopy)
-        map_var = self.top()
+        stack = self.stack
 
-        copied = Variable(
-            map_var.root_type(),
-            deepcopy(map_var.value),
-            deepcopy(map_var.type.type_params),
-        )
+        def map_copy(ip: int) -> int:
+            stack.append(stack[-1].copy())
+            return ip + 1
 
-        self.push(copied)
-        return self.get_instruction_pointer() + 1
+        return map_copy
 
-    def instruction_map_keys(self, instruction: Instruction) -> int:  # pragma: nocover
-        raise NotImplementedError
+    def instruction_map_keys(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, MapKeys)
+        stack = self.stack
 
-    def instruction_map_values(
-        self, instruction: Instruction
-    ) -> int:  # pragma: nocover
-        raise NotImplementedError
+        def map_keys(ip: int) -> int:
+            stack.append(iterate_map_keys(stack[-1]))
+            return ip + 1
 
-    def instruction_push_struct(self, instruction: Instruction) -> int:
-        assert isinstance(instruction, PushStruct)
+        return map_keys
 
-        struct_fields: Dict[str, Variable] = {}
+    def instruction_map_values(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, MapValues)
+        stack = self.stack
 
-        for field in instruction.type.fields:
-            assert isinstance(field.type.type, TypeLiteral)
-            var_type = VariableType.from_type_literal(field.type.type)
-            struct_fields[field.name] = Variable.zero_value(var_type)
+        def map_values(ip: int) -> int:
+            stack.append(iterate_map_values(stack[-1]))
+            return ip + 1
 
-        struct_var = Variable(
-            RootType.STRUCT, struct_fields, struct_name=instruction.type.name
-        )
-        self.push(struct_var)
+        return map_values
+
+    def instruction_map_items(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, MapItems)
+        stack = self.stack
+
+        def map_items(ip: int) -> int:
+            stack.append(iterate_map_items(stack[-1]))
+            return ip + 1
+
+        return map_items
+
+    def instruction_strbuf_append(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, StrbufAppend)
+        stack = self.stack
+
+        def strbuf_append(ip: int) -> int:
+            x: str = stack.pop()
+            chunks: List[str] = stack[-1].writable()
+            chunks.append(x)
+            return ip + 1
+
+        return strbuf_append
+
+    def instruction_strbuf_to_str(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, StrbufToStr)
+        stack = self.stack
+
+        def strbuf_to_str_(ip: int) -> int:
+            stack.append(strbuf_to_str(stack[-1]))
+            return ip + 1
+
+        return strbuf_to_str_
+
+    def instruction_strbuf_size(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, StrbufSize)
+        stack = self.stack
+
+        def strbuf_size_(ip: int) -> int:
+            stack.append(strbuf_size(stack[-1]))
+            return ip + 1
+
+        return strbuf_size_
+
+    def instruction_iter_next(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, IterNext)
+        stack = self.stack
+
+        def iter_next(ip: int) -> int:
+            stack.extend(next_item(stack[-1]))
+            return ip + 1
+
+        return iter_next
+
+    def instruction_map_iter_next(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, MapIterNext)
+        stack = self.stack
+
+        def map_iter_next(ip: int) -> int:
+            stack.extend(next_map_item(stack[-1]))
+            return ip + 1
+
+        return map_iter_next
+
+    def instruction_set_add(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, SetAdd)
+        stack = self.stack
 
-        return self.get_instruction_pointer() + 1
+        def set_add(ip: int) -> int:
+            item = stack.pop()
+            set: Dict[Any, None] = stack[-1].writable()
+            set[item] = None
+            return ip + 1
 
-    def instruction_get_struct_field(self, instruction: Instruction) -> int:
+        return set_add
+
+    def instruction_set_has(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, SetHas)
+        stack = self.stack
+
+        def set_has(ip: int) -> int:
+            item = stack.pop()
+            set: Dict[Any, None] = stack[-1].value
+            stack.append(item in set)
+            return ip + 1
+
+        return set_has
+
+    def instruction_set_drop(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, SetDrop)
+        stack = self.stack
+
+        def set_drop(ip: int) -> int:
+            item = stack.pop()
+
+            # Dropping an item that is not in the set does nothing
+            if item in stack[-1].value:
+                set: Dict[Any, None] = stack[-1].writable()
+                del set[item]
+
+            return ip + 1
+
+        return set_drop
+
+    def instruction_set_size(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, SetSize)
+        stack = self.stack
+
+        def set_size(ip: int) -> int:
+            set: Dict[Any, None] = stack[-1].value
+            stack.append(len(set))
+            return ip + 1
+
+        return set_size
+
+    def instruction_set_clear(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, SetClear)
+        stack = self.stack
+
+        def set_clear(ip: int) -> int:
+            set: Dict[Any, None] = stack[-1].writable()
+            set.clear()
+            return ip + 1
+
+        return set_clear
+
+    def instruction_push_strbuf(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, PushStrbuf)
+        stack = self.stack
+
+        def push_strbuf(ip: int) -> int:
+            stack.append(Variable(RootType.STRING_BUFFER, []))
+            return ip + 1
+
+        return push_strbuf
+
+    def instruction_push_iterator(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, PushIterator)
+        stack = self.stack
+
+        # Empty iterators never change, so they can be shared
+        iterator = Variable.zero_value(instruction.type)
+
+        def push_iterator(ip: int) -> int:
+            stack.append(iterator)
+            return ip + 1
+
+        return push_iterator
+
+    def instruction_push_struct(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, PushStruct)
+        stack = self.stack
+        zero = zero_struct(instruction.type)
+
+        def push_struct(ip: int) -> int:
+            stack.append(zero.copy())
+            return ip + 1
+
+        return push_struct
+
+    def instruction_get_struct_field(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, GetStructField)
+        stack = self.stack
+        slot = instruction.slot
 
-        field_name: str = self.pop().value
-        struct_fields: Dict[str, Variable] = self.top().value
-        self.push(struct_fields[field_name])
+        def get_struct_field(ip: int) -> int:
+            stack.append(stack[-1].value[slot])
+            return ip + 1
 
-        return self.get_instruction_pointer() + 1
+        return get_struct_field
 
-    def instruction_set_struct_field(self, instruction: Instruction) -> int:
+    def instruction_set_struct_field(self, instruction: Instruction) -> Handler:
         assert isinstance(instruction, SetStructField)
+        stack = self.stack
+        slot = instruction.slot
+
+        def set_struct_field(ip: int) -> int:
+            new_value = stack.pop()
+            stack[-1].writable()[slot] = new_value
+            return ip + 1
+
+        return set_struct_field
 
-        new_value: Variable = self.pop()
-        field_name: str = self.pop().value
-        struct_fields: Dict[str, Variable] = self.top().value
-        struct_fields[field_name] = new_value
+    def instruction_sys_call(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, SysCall)
+        stack = self.stack
+        sys_call = getattr(self.sys_calls, instruction.kind.name.lower())
+        arg_count, _ = SYS_CALL_STACK_EFFECTS[instruction.kind]
 
-        return self.get_instruction_pointer() + 1
+        def sys_call_(ip: int) -> int:
+            args = stack[-arg_count:]
+            del stack[-arg_count:]
+            stack.extend(sys_call(*args))
+            return ip + 1
+
+        return sys_call_
+
+    def instruction_int_plus_immediate(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, IntPlusImmediate)
+        stack = self.stack
+        value = instruction.value
+
+        def int_plus_immediate(ip: int) -> int:
+            stack[-1] = stack[-1] + value
+            return ip + 1
+
+        return int_plus_immediate
+
+    def instruction_dup2(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, Dup2)
+        stack = self.stack
+
+        def dup2(ip: int) -> int:
+            stack.extend(stack[-2:])
+            return ip + 1
+
+        return dup2
+
+    def instruction_jump_if_not_int_equals(self, instruction: Instruction) -> Handler:
+        assert isinstance(instruction, JumpIfNotIntEquals)
+        stack = self.stack
+        target = instruction.instruction_offset
+
+        def jump_if_not_int_equals(ip: int) -> int:
+            x: int = stack.pop()
+            if stack.pop() == x:
+                return ip + 1
+            return target
+
+        return jump_if_not_int_equals
+
+    def instruction_jump_if_not_int_not_equal(
+        self, instruction: Instruction
+    ) -> Handler:
+        assert isinstance(instruction, JumpIfNotIntNotEqual)
+        stack = self.stack
+        target = instruction.instruction_offset
+
+        def jump_if_not_int_not_equal(ip: int) -> int:
+            x: int = stack.pop()
+            if stack.pop() != x:
+                return ip + 1
+            return target
+
+        return jump_if_not_int_not_equal
+
+    def instruction_jump_if_not_int_less_than(
+        self, instruction: Instruction
+    ) -> Handler:
+        assert isinstance(instruction, JumpIfNotIntLessThan)
+        stack = self.stack
+        target = instruction.instruction_offset
+
+        def jump_if_not_int_less_than(ip: int) -> int:
+            x: int = stack.pop()
+            if stack.pop() < x:
+                return ip + 1
+            return target
+
+        return jump_if_not_int_less_than
+
+    def instruction_jump_if_not_int_less_equals(
+        self, instruction: Instruction
+    ) -> Handler:
+        assert isinstance(instruction, JumpIfNotIntLessEquals)
+        stack = self.stack
+        target = instruction.instruction_offset
+
+        def jump_if_not_int_less_equals(ip: int) -> int:
+            x: int = stack.pop()
+            if stack.pop() <= x:
+                return ip + 1
+            return target
+
+        return jump_if_not_int_less_equals
+
+    def instruction_jump_if_not_int_greater_than(
+        self, instruction: Instruction
+    ) -> Handler:
+        assert isinstance(instruction, JumpIfNotIntGreaterThan)
+        stack = self.stack
+        target = instruction.instruction_offset
+
+        def jump_if_not_int_greater_than(ip: int) -> int:
+            x: int = stack.pop()
+            if stack.pop() > x:
+                return ip + 1
+            return target
+
+        return jump_if_not_int_greater_than
+
+    def instruction_jump_if_not_int_greater_equals(
+        self, instruction: Instruction
+    ) -> Handler:
+        assert isinstance(instruction, JumpIfNotIntGreaterEquals)
+        stack = self.stack
+        target = instruction.instruction_offset
+
+        def jump_if_not_int_greater_equals(ip: int) -> int:
+            x: int = stack.pop()
+            if stack.pop() >= x:
+                return ip + 1
+            return target
+
+        return jump_if_not_int_greater_equals
@@ -0,0 +1,137 @@
+import mmap
+import os
+import sys
+from typing import Callable, Dict, Optional, TextIO, Tuple
+
+from lang.exceptions.runtime import AaaInvalidArgument
+
+# File handle of standard input
+STDIN = 0
+
+# Handles of opened files start after the ones of stdin, stdout and stderr
+FIRST_FILE_HANDLE = 3
+
+
+class SysCalls:
+    """
+    Implements the SysCall instruction for the Simulator and the PyCompiler. Each
+    method gets the arguments of the builtin function and returns a tuple with its
+    return values.
+
+    Files are identified by handles, which look like file descriptors but never
+    collide with stdin, even when its descriptor was closed and reused by the
+    operating system. They are read through Python's buffered readers, so reading
+    line by line or in chunks never loads a whole file into memory. Failures return
+    a bool that is false, like `/` does. Arguments that can never work raise
+    AaaInvalidArgument instead.
+    """
+
+    __slots__ = ("input", "files", "before_stdin_read")
+
+    def __init__(
+        self,
+        input: Optional[TextIO] = None,
+        before_stdin_read: Optional[Callable[[], None]] = None,
+    ) -> None:
+        # None means sys.stdin at the time of reading, so redirecting it works
+        self.input = input
+
+        # Files opened by the running program, by handle
+        self.files: Dict[int, TextIO] = {}
+
+        # Used to show buffered output, such as a prompt, before waiting for input
+        self.before_stdin_read = before_stdin_read
+
+    def read_line(self, fd: int) -> Tuple[str, bool]:
+        """
+        Returns next line without line ending, and false at the end of the file.
+        """
+
+        file = self._file(fd)
+
+        if not file:
+            return "", False
+
+        line = file.readline()
+
+        if not line:
+            return "", False
+
+        if line.endswith("\n"):
+            line = line[:-1]
+
+        return line, True
+
+    def read_chunk(self, fd: int, size: int) -> Tuple[str, bool]:
+        """
+        Returns at most size characters, and false at the end of the file.
+        """
+
+        if size <= 0:
+            raise AaaInvalidArgument("read_chunk", f"size {size} is not positive")
+
+        file = self._file(fd)
+
+        if not file:
+            return "", False
+
+        chunk = file.read(size)
+        return chunk, chunk != ""
+
+    def open_file(self, path: str) -> Tuple[int, bool]:
+        try:
+            file = open(path, encoding="utf-8", errors="replace")
+        except OSError:
+            return -1, False
+
+        # Lowest free handle, like the operating system does for file descriptors
+        handle = FIRST_FILE_HANDLE
+        while handle in self.files:
+            handle += 1
+
+        self.files[handle] = file
+        return handle, True
+
+    def close_file(self, fd: int) -> Tuple[bool]:
+        file = self.files.pop(fd, None)
+
+        if not file:
+            return (False,)
+
+        file.close()
+        return (True,)
+
+    def read_file(self, path: str) -> Tuple[str, bool]:
+        """
+        Returns content of file. The file is memory-mapped instead of read, so it
+        is not copied into a buffer before decoding.
+        """
+
+        try:
+            with open(path, "rb") as file:
+                if os.fstat(file.fileno()).st_size == 0:
+                    return "", True
+
+                with mmap.mmap(file.fileno(), 0, access=mmap.ACCESS_READ) as mapped:
+                    return str(mapped, encoding="utf-8", errors="replace"), True
+        except (OSError, ValueError):
+            return "", False
+
+    def close(self) -> None:
+        """
+        Closes all files the program left open. Called when the program stops.
+        """
+
+        for file in self.files.values():
+            file.close()
+
+        self.files.clear()
+
+    def _file(self, fd: int) -> Optional[TextIO]:
+        if fd != STDIN:
+            return self.files.get(fd)
+
+        if self.before_stdin_read:
+            self.before_stdin_read()
+
+        return self.input or sys.stdin
@@ -0,0 +1,274 @@
+from pathlib import Path
+from typing import Any, Dict, List, Optional, Set, Tuple
+
+from lang.exceptions import AaaLoadException
+from lang.instructions.types import Instruction
+from lang.models.parse import (
+    AaaTreeNode,
+    Argument,
+    Function,
+    Identifier,
+    MemberFunctionName,
+    ParsedFile,
+    Struct,
+    TypeLiteral,
+)
+from lang.models.program import ProgramImport
+from lang.runtime.cache import content_hash
+from lang.runtime.program import Identifiable, Program
+from lang.typing.checker import TypeChecker
+
+
+class CheckedFunction:
+    """
+    Function that passed type checking, with the key of everything that result
+    depends on.
+    """
+
+    __slots__ = ("key", "instructions", "stack_height")
+
+    def __init__(self, key: str) -> None:
+        self.key = key
+
+        # Generated once the whole file passed type checking
+        self.instructions: Optional[List[Instruction]] = None
+        self.stack_height = 0
+
+
+class Workspace(Program):
+    """
+    Program that stays loaded, for editors and other long running tools.
+
+    Checking a file loads it like Program does, but files are only parsed again
+    when their code changed. Functions are only type checked again when their own
+    code or the signature of something they refer to changed, otherwise their
+    type checking result and instructions are reused. Unsaved code of files open in
+    an editor is used instead of what is on disk.
+    """
+
+    def __init__(self, file: Path, optimize: bool = False) -> None:
+        # Last parse of each file, with the code it was parsed from
+        self.parsed_files: Dict[Path, Tuple[str, ParsedFile | AaaLoadException]] = {}
+
+        # Code without positions and referenced names of parsed functions, by id()
+        self.function_code: Dict[int, Tuple[Function, str, Set[str]]] = {}
+
+        # Functions without type errors, by file and name
+        self.checked_functions: Dict[Tuple[Path, str], CheckedFunction] = {}
+
+        # Functions that were type checked by the last check(), by file and name
+        self.last_checked: List[Tuple[Path, str]] = []
+
+        # Unchanged code is never loaded from the cache, it is already loaded. Code of
+        # files open in an editor is put in self.sources.
+        super().__init__(file, optimize=optimize, use_cache=False)
+
+        # Loading builtins happens once, errors are reported by every check()
+        self.builtins_errors = [] if self._builtins.functions else self.file_load_errors
+        self._clear_node_info()
+
+    def open(self, file: Path, code: str) -> None:
+        """
+        Uses code instead of the content of file, until it is closed.
+        """
+
+        self.sources[file.resolve()] = code
+
+    def close(self, file: Path) -> None:
+        self.sources.pop(file.resolve(), None)
+
+    def check(self, file: Path) -> List[AaaLoadException]:
+        """
+        Loads file and everything it imports, returns all errors found.
+        """
+
+        if self.builtins_errors:
+            return self.builtins_errors
+
+        self.entry_point_file = file.resolve()
+        self.identifiers = {}
+        self.function_instructions = {}
+        self.function_stack_heights = {}
+        self.loaded_files = {}
+        self.file_hashes = {}
+        self.last_checked = []
+
+        self.file_load_errors = self._load_file(self.entry_point_file)
+        self._clear_node_info()
+        return self.file_load_errors
+
+    def _clear_node_info(self) -> None:
+        # Only needed to generate instructions of functions type checked just now
+        self.operator_signatures = {}
+        self.member_function_types = {}
+        self.struct_field_slots = {}
+        self.stack_heights = {}
+
+    def _parse_regular_file(self, file: Path, code: str) -> ParsedFile:
+        if file in self.parsed_files and self.parsed_files[file][0] == code:
+            parsed = self.parsed_files[file][1]
+        else:
+            self._forget_functions(file)
+
+            try:
+                parsed = super()._parse_regular_file(file, code)
+            except AaaLoadException as e:
+                parsed = e
+
+            self.parsed_files[file] = (code, parsed)
+
+        if isinstance(parsed, AaaLoadException):
+            raise parsed
+
+        return parsed
+
+    def _forget_functions(self, file: Path) -> None:
+        if file not in self.parsed_files:
+            return
+
+        parsed = self.parsed_files[file][1]
+
+        if isinstance(parsed, ParsedFile):
+            for function in parsed.functions:
+                self.function_code.pop(id(function), None)
+
+    def _check_main_function(
+        self, file: Path, parsed_file: ParsedFile
+    ) -> List[AaaLoadException]:
+        # Any file can be checked, not just ones that can run
+        return []
+
+    def _type_check_functions(
+        self, file: Path, functions: List[Function]
+    ) -> List[AaaLoadException]:
+        exceptions: List[AaaLoadException] = []
+
+        # Struct fields can be used without naming the struct, so all are depended on
+        struct_names = {
+            name
+            for name in self.identifiers[file]
+            if isinstance(self.get_identifier(file, name), Struct)
+        }
+
+        for function in functions:
+            name = function.identify()
+            key = self._function_key(file, function, struct_names)
+            checked = self.checked_functions.get((file, name))
+
+            if checked and checked.key == key and checked.instructions is not None:
+                continue
+
+            self.checked_functions.pop((file, name), None)
+            self.last_checked.append((file, name))
+
+            try:
+                TypeChecker(file, function, self).check()
+            except AaaLoadException as e:
+                exceptions.append(e)
+                continue
+
+            self.checked_functions[(file, name)] = CheckedFunction(key)
+
+        return exceptions
+
+    def _generate_file_instructions(
+        self, file: Path, functions: List[Function]
+    ) -> Dict[str, List[Instruction]]:
+        file_instructions: Dict[str, List[Instruction]] = {}
+        stack_heights = self.function_stack_heights.setdefault(file, {})
+
+        for function in functions:
+            name = function.identify()
+            checked = self.checked_functions[(file, name)]
+
+            if checked.instructions is None:
+                generated = super()._generate_file_instructions(file, [function])
+                checked.instructions = generated[name]
+                checked.stack_height = stack_heights[name]
+
+            file_instructions[name] = checked.instructions
+            stack_heights[name] = checked.stack_height
+
+        return file_instructions
+
+    def _function_key(
+        self, file: Path, function: Function, struct_names: Set[str]
+    ) -> str:
+        """
+        Returns hash of the code of function and of the signatures and source files
+        of everything it can depend on. Code is compared without positions, so
+        moving a function within its file does not change its key.
+        """
+
+        if id(function) not in self.function_code:
+            names = _referenced_names(function)
+            self.function_code[id(function)] = (function, repr(function), names)
+
+        _, code, names = self.function_code[id(function)]
+        parts = [code]
+
+        for name in sorted(names | struct_names):
+            source_file, identified = self._resolve_identifier(file, name)
+            parts += [name, str(source_file), _signature(identified)]
+
+        return content_hash(*parts)
+
+    def _resolve_identifier(
+        self, file: Path, name: str
+    ) -> Tuple[Optional[Path], Optional[Identifiable]]:
+        """
+        Returns the file that defines what name refers to in file, and what that is.
+        Generated calls refer to that file, so callers depend on it.
+        """
+
+        identified = self.identifiers.get(file, {}).get(name)
+
+        while isinstance(identified, ProgramImport):
+            file = identified.source_file
+            identified = self.identifiers.get(file, {}).get(identified.original_name)
+
+        if identified is None:
+            return None, None
+
+        return file, identified
+
+
+def _referenced_names(node: Any) -> Set[str]:
+    """
+    Returns names used in node that could refer to a function or struct.
+    """
+
+    names: Set[str] = set()
+
+    if isinstance(node, list):
+        for item in node:
+            names |= _referenced_names(item)
+        return names
+
+    if not isinstance(node, AaaTreeNode):
+        return names
+
+    if isinstance(node, (Identifier, Argument)):
+        names.add(node.name)
+    elif isinstance(node, TypeLiteral):
+        names.add(node.type_name)
+    elif isinstance(node, MemberFunctionName):
+        names |= {node.type_name, str(node)}
+    elif isinstance(node, Function):
+        names.add(node.identify())
+
+    for _, value in node:
+        names |= _referenced_names(value)
+
+    return names
+
+
+def _signature(identified: Optional[Identifiable]) -> str:
+    if isinstance(identified, Function):
+        arguments = [(arg.name, arg.type) for arg in identified.arguments]
+        return f"fn {arguments!r} {identified.return_types!r}"
+
+    if isinstance(identified, Struct):
+        return f"struct {identified.fields!r}"
+
+    return ""
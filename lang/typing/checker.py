@@ -71,6 +71,9 @@ class TypeChecker:
         self.program = program
         self.file = file
 
+        # Highest number of values on the stack at any point in the function
+        self.max_stack_height = 0
+
     def check(self) -> None:
         self._check_argument_types()
         computed_return_types = self._check_function(self.function, [])
@@ -85,6 +88,8 @@ class TypeChecker:
                 computed_return_types=computed_return_types,
             )
 
+        self.program.stack_heights[id(self.function)] = self.max_stack_height
+
     def _check_argument_types(self) -> None:
 
         known_identifiers = self.program.identifiers[self.file]
@@ -96,7 +101,17 @@ class TypeChecker:
             arg_type_name = argument.type.type.type_name
 
             # TODO load list from builtin types from builtins.aaa
-            if arg_type_name in ["bool", "int", "map", "str", "vec"]:
+            if arg_type_name in [
+                "bool",
+                "int",
+                "iter",
+                "map",
+                "map_iter",
+                "set",
+                "str",
+                "strbuf",
+                "vec",
+            ]:
                 return
 
             if arg_type_name not in known_identifiers:
@@ -293,6 +308,7 @@ class TypeChecker:
                 stack = self._check_and_apply_signature(
                     copy(type_stack), signature, node
                 )
+                self.program.operator_signatures[id(node)] = signature
                 break
             except StackTypesError as e:
                 last_stack_type_error = e
@@ -438,6 +454,8 @@ class TypeChecker:
             else:  # pragma nocover
                 assert False
 
+            self.max_stack_height = max(self.max_stack_height, len(stack))
+
         return stack
 
     def _check_member_function_call(
@@ -470,7 +488,14 @@ class TypeChecker:
             assert isinstance(function, Function)
             signature = self._get_function_signature(function)
 
-        return self._check_and_apply_signature(type_stack, signature, node)
+        stack = self._check_and_apply_signature(type_stack, signature, node)
+
+        if key in self.program._builtins.functions:
+            return_count = len(signature.return_types)
+            return_types = stack[len(stack) - return_count :]
+            self.program.member_function_types[id(node)] = return_types
+
+        return stack
 
     def _check_function(self, node: AaaTreeNode, type_stack: TypeStack) -> TypeStack:
         assert isinstance(node, Function)
@@ -540,14 +565,13 @@ class TypeChecker:
     def _get_struct_field_type(
         self, node: StructFieldQuery | StructFieldUpdate, struct: Struct
     ) -> VariableType:
-        # TODO consider moving this out since it doesn't use self
-
         field_type: Optional[ParsedType] = None
         field_name = node.field_name.value
 
-        for field in struct.fields:
+        for slot, field in enumerate(struct.fields):
             if field.name == field_name:
                 field_type = field.type
+                self.program.struct_field_slots[id(node)] = slot
                 break
 
         if not field_type:
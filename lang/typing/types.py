@@ -1,8 +1,10 @@
+from array import array
+from copy import copy as shallow_copy
 from enum import IntEnum, auto
-from typing import Any, Final, List, Optional, Union
+from typing import Any, Final, List, Optional, Tuple, Union
 
 from lang.models import AaaModel
-from lang.models.parse import Function, ParsedTypePlaceholder, TypeLiteral
+from lang.models.parse import Function, ParsedTypePlaceholder, Struct, TypeLiteral
 
 
 class RootType(IntEnum):
@@ -11,6 +13,10 @@ class RootType(IntEnum):
     STRING = auto()
     VECTOR = auto()
     MAPPING = auto()
+    SET = auto()
+    ITERATOR = auto()
+    MAP_ITERATOR = auto()
+    STRING_BUFFER = auto()
     STRUCT = auto()
 
     @classmethod
@@ -25,6 +31,14 @@ class RootType(IntEnum):
             return RootType.VECTOR
         elif name == "map":
             return RootType.MAPPING
+        elif name == "set":
+            return RootType.SET
+        elif name == "iter":
+            return RootType.ITERATOR
+        elif name == "map_iter":
+            return RootType.MAP_ITERATOR
+        elif name == "strbuf":
+            return RootType.STRING_BUFFER
         else:
             return RootType.STRUCT
 
@@ -39,6 +53,14 @@ class RootType(IntEnum):
             return "vec"
         elif self == RootType.MAPPING:
             return "map"
+        elif self == RootType.SET:
+            return "set"
+        elif self == RootType.ITERATOR:
+            return "iter"
+        elif self == RootType.MAP_ITERATOR:
+            return "map_iter"
+        elif self == RootType.STRING_BUFFER:
+            return "strbuf"
         else:
             return "struct"
 
@@ -62,9 +84,9 @@ class VariableType:
         else:
             self.struct_name = ""
 
-        if root_type == RootType.VECTOR:
+        if root_type in [RootType.VECTOR, RootType.SET, RootType.ITERATOR]:
             assert len(self.type_params) == 1
-        elif root_type == RootType.MAPPING:
+        elif root_type in [RootType.MAPPING, RootType.MAP_ITERATOR]:
             assert len(self.type_params) == 2
         else:
             assert len(self.type_params) == 0
@@ -118,8 +140,42 @@ Bool: Final[VariableType] = VariableType(RootType.BOOL)
 Int: Final[VariableType] = VariableType(RootType.INTEGER)
 Str: Final[VariableType] = VariableType(RootType.STRING)
 
+PRIMITIVE_ROOT_TYPES: Final = {RootType.BOOL, RootType.INTEGER, RootType.STRING}
+
+ITERATOR_ROOT_TYPES: Final = {RootType.ITERATOR, RootType.MAP_ITERATOR}
+
+# Items of vecs with these item types are packed in an array with this type code
+VEC_ARRAY_TYPECODES: Final = {RootType.INTEGER: "q", RootType.BOOL: "b"}
+
 
 class Variable:
+    """
+    Runtime value of a container or struct.
+
+    Values of type int, bool and str are not wrapped in a Variable: they live on the
+    stack and inside containers as plain Python int, bool and str objects. The type
+    checker already guarantees they are used correctly.
+
+    Vecs of int and bool are stored as packed arrays of 64 and 8 bit integers, other
+    vecs as lists. Arrays don't keep an object per item, so they take 8 bytes or 1
+    byte per item instead of about 36. Items read from a vec[bool] array are ints,
+    so instructions reading them convert them back to bool. An int too big for 64
+    bits turns the array into a list, see unpack_vec().
+
+    Sets are stored as dicts with None values, so like maps they keep insertion
+    order. That way printing them gives the same output in every engine.
+
+    Structs are stored as lists of field values, in the order the fields are
+    declared. The InstructionGenerator turns field names into indexes in that list.
+
+    String buffers are lists of appended strings, which are only joined when the
+    result is needed. That makes building a string out of many parts O(n).
+
+    Iterators hold a Python iterator over a map which is shared with copy-on-write.
+    They go over the map as it was when they were created: the first change to the
+    map after that copies it. Copies of an iterator share its position.
+    """
+
     def __init__(
         self,
         root_type: RootType,
@@ -131,66 +187,104 @@ class Variable:
             root_type, type_params, struct_name=struct_name
         )
         self.value = value
-        self.check()
+
+        # Number of Variables sharing value, this list is shared between them too.
+        self.ref_count = [1]
 
     @classmethod
-    def zero_value(cls, type: VariableType) -> "Variable":
+    def zero_value(cls, type: VariableType) -> Any:
+        root_type = type.root_type
+
+        if root_type == RootType.BOOL:
+            return False
+        elif root_type == RootType.INTEGER:
+            return 0
+        elif root_type == RootType.STRING:
+            return ""
+
         zero_val: Any
 
-        if type.root_type == RootType.BOOL:
-            zero_val = False
-        elif type.root_type == RootType.INTEGER:
-            zero_val = 0
-        elif type.root_type == RootType.STRING:
-            zero_val = ""
-        elif type.root_type == RootType.VECTOR:
+        if root_type == RootType.VECTOR:
+            zero_val = vec_items(type.type_params[0])
+        elif root_type in [RootType.STRING_BUFFER, RootType.STRUCT]:
             zero_val = []
-        elif type.root_type in [RootType.MAPPING, RootType.STRUCT]:
+        elif root_type in [RootType.MAPPING, RootType.SET]:
             zero_val = {}
+        elif root_type in ITERATOR_ROOT_TYPES:
+            zero_val = iter(())
         else:  # pragma: nocover
             assert False
 
         return Variable(
-            root_type=type.root_type, type_params=type.type_params, value=zero_val
+            root_type=root_type,
+            type_params=type.type_params,
+            value=zero_val,
+            struct_name=type.struct_name,
         )
 
-    def check(self) -> None:
-        # TODO this is slow, remove when Variable is stable
-        root_type = self.type.root_type
-        type_params = self.type.type_params
+    def root_type(self) -> RootType:
+        return self.type.root_type
 
-        if root_type == RootType.BOOL:
-            assert type(self.value) == bool
+    def copy(self) -> "Variable":
+        """
+        Returns a Variable that behaves like a deep copy.
 
-        elif root_type == RootType.INTEGER:
-            assert type(self.value) == int
+        If value contains no Variables, the copy shares it until one of them calls
+        writable(), which makes copying O(1). Otherwise nested Variables are copied
+        the same way.
+        """
 
-        elif root_type == RootType.STRING:
-            assert type(self.value) == str
+        if self.type.root_type in ITERATOR_ROOT_TYPES:
+            return self
 
-        elif root_type == RootType.VECTOR:
-            assert type(self.value) == list
-            assert len(type_params) == 1
-            for item in self.value:
-                assert item.type == type_params[0]
-                item.check()
+        copied = shallow_copy(self)
 
-        elif root_type == RootType.MAPPING:
-            assert type(self.value) == dict
-            assert len(type_params) == 2
-            for key, value in self.value.items():
-                assert key.type == type_params[0]
-                assert value.type == type_params[1]
-                key.check()
-                value.check()
-        elif root_type == RootType.STRUCT:
-            assert type(self.value) == dict
-            assert len(type_params) == 0
-        else:  # pragma: nocover
-            assert False
+        if self._contains_variables():
+            copied.ref_count = [1]
+            if isinstance(self.value, list):
+                copied.value = [_copy_item(item) for item in self.value]
+            else:
+                copied.value = {
+                    key: _copy_item(item) for key, item in self.value.items()
+                }
+        else:
+            self.ref_count[0] += 1
 
-    def root_type(self) -> RootType:
-        return self.type.root_type
+        return copied
+
+    def writable(self) -> Any:
+        """
+        Returns value, which can be changed without affecting copies of this Variable.
+        Must be called by all instructions that change a container or struct.
+        """
+
+        if self.ref_count[0] > 1:
+            self.ref_count[0] -= 1
+            self.ref_count = [1]
+
+            # Shallow copy is enough, because value contains no Variables
+            self.value = shallow_copy(self.value)
+
+        return self.value
+
+    def share(self) -> Any:
+        """
+        Returns value, which is never changed afterwards: the next call to writable()
+        copies it first.
+        """
+
+        self.ref_count[0] += 1
+        return self.value
+
+    def _contains_variables(self) -> bool:
+        if self.type.root_type == RootType.STRUCT:
+            return any(isinstance(field, Variable) for field in self.value)
+
+        return not all(
+            isinstance(type_param, VariableType)
+            and type_param.root_type in PRIMITIVE_ROOT_TYPES
+            for type_param in self.type.type_params
+        )
 
     def has_root_type(self, root_type: RootType) -> bool:  # pragma: nocover
         return self.root_type() == root_type
@@ -198,54 +292,228 @@ class Variable:
     def __str__(self) -> str:
         root_type = self.root_type()
 
-        if root_type in [RootType.INTEGER, RootType.STRING]:
-            return str(self.value)
-
-        elif root_type == RootType.BOOL:
-            return str(self.value).lower()
-
-        elif root_type == RootType.VECTOR:
-            return "[" + ", ".join(repr(item) for item in self.value) + "]"
+        if root_type == RootType.VECTOR:
+            items = self.value
+            if self.type.type_params[0] == Bool:
+                items = map(bool, items)
+            return "[" + ", ".join(repr_value(item) for item in items) + "]"
 
         elif root_type == RootType.MAPPING:
             return (
                 "{"
                 + ", ".join(
-                    repr(key) + ": " + repr(value) for key, value in self.value.items()
+                    repr_value(key) + ": " + repr_value(value)
+                    for key, value in self.value.items()
                 )
                 + "}"
             )
 
+        elif root_type == RootType.SET:
+            return "{" + ", ".join(repr_value(item) for item in self.value) + "}"
+
+        elif root_type == RootType.STRING_BUFFER:
+            return strbuf_to_str(self)
+
+        elif root_type in ITERATOR_ROOT_TYPES:
+            return repr(root_type)
+
         else:  # pragma: nocover
             assert False
 
     def __repr__(self) -> str:
-        if self.root_type() == RootType.STRING:
-            return '"' + str(self.value) + '"'
-
         return str(self)
 
-    def __hash__(self) -> int:
-        # NOTE: this will fail for VECTOR and MAPPING
-        return hash(self.value)
 
-    def __eq__(self, other: object) -> bool:
-        if not isinstance(other, Variable):
-            return False  # pragma: nocover
+def zero_struct(struct: Struct) -> Variable:
+    """
+    Returns struct with zero values for all fields. Copying it is the cheapest way
+    to create a new struct, because copies share values until they are changed.
+    """
+
+    fields: List[Any] = []
+
+    for field in struct.fields:
+        assert isinstance(field.type.type, TypeLiteral)
+        field_type = VariableType.from_type_literal(field.type.type)
+        fields.append(Variable.zero_value(field_type))
+
+    return Variable(RootType.STRUCT, fields, struct_name=struct.name)
+
+
+def strbuf_to_str(buffer: Variable) -> str:
+    chunks: List[str] = buffer.value
+
+    if len(chunks) != 1:
+        # Joining doesn't change the content, so copies sharing chunks still work
+        chunks[:] = ["".join(chunks)]
+
+    return chunks[0]
+
+
+def strbuf_size(buffer: Variable) -> int:
+    return sum(map(len, buffer.value))
+
+
+def vec_items(item_type: "SignatureItem") -> Any:
+    """
+    Returns empty storage for items of a vec, see Variable.
+    """
+
+    if isinstance(item_type, VariableType):
+        typecode = VEC_ARRAY_TYPECODES.get(item_type.root_type)
+        if typecode:
+            return array(typecode)
+
+    return []
+
+
+def get_vec_item(items: Any, index: int) -> Any:
+    """
+    Returns item of a vec of which the item type is only known at runtime.
+    """
+
+    item = items[index]
+
+    if type(items) is array and items.typecode == "b":
+        return bool(item)
+    return item
+
+
+def pop_vec_item(vec: Variable) -> Any:
+    """
+    Removes and returns last item of a vec, like get_vec_item().
+    """
+
+    items = vec.writable()
+    item = items.pop()
+
+    if type(items) is array and items.typecode == "b":
+        return bool(item)
+    return item
+
+
+def unpack_vec(vec: Variable) -> List[Any]:
+    """
+    Replaces array storing the items of vec by a list, which can hold ints of any
+    size. Returns the list, so the failed change can be done again.
+    """
+
+    items = list(vec.writable())
+    vec.value = items
+    return items
+
+
+def _extend_items(vec: Variable, items: List[Any]) -> None:
+    stored = vec.writable()
+    size = len(stored)
+
+    try:
+        stored.extend(items)
+    except OverflowError:
+        # Arrays keep the items added before the one that didn't fit
+        del stored[size:]
+        unpack_vec(vec).extend(items)
+
+
+def extend_vec(vec: Variable, other: Variable) -> None:
+    # Materialize items first, other can be vec itself
+    _extend_items(vec, [_copy_item(item) for item in other.value])
+
+
+def slice_vec(vec: Variable, start: int, end: int) -> Variable:
+    """
+    Returns copy of items from start up to end. Both are clamped to the vec, so
+    this never fails.
+    """
+
+    start = max(start, 0)
+    end = max(end, start)
+    items = vec.value[start:end]
+
+    if not isinstance(items, array):
+        items = [_copy_item(item) for item in items]
+
+    return Variable(RootType.VECTOR, items, type_params=vec.type.type_params)
+
+
+def fill_vec(vec: Variable, count: int, item: Any) -> None:
+    # Every item gets its own copy, so changing one doesn't change the others
+    _extend_items(vec, [_copy_item(item) for _ in range(count)])
+
+
+def iterate_map_keys(map: Variable) -> Variable:
+    key_type = map.type.type_params[0]
+    return Variable(RootType.ITERATOR, iter(map.share()), type_params=[key_type])
+
+
+def iterate_map_values(map: Variable) -> Variable:
+    value_type = map.type.type_params[1]
+    values = map.share().values()
+    return Variable(RootType.ITERATOR, iter(values), type_params=[value_type])
+
+
+def iterate_map_items(map: Variable) -> Variable:
+    items = map.share().items()
+    type_params = map.type.type_params
+    return Variable(RootType.MAP_ITERATOR, iter(items), type_params=type_params)
+
+
+# Returned by next() on iterators that reached the end
+ITERATOR_END: Final = object()
+
+
+def next_item(iterator: Variable) -> Tuple[Any, bool]:
+    item = next(iterator.value, ITERATOR_END)
+
+    if item is ITERATOR_END:
+        # Types of runtime values never contain placeholders
+        item_type = iterator.type.get_variable_type_param(0)
+        return Variable.zero_value(item_type), False
+
+    return item, True
+
+
+def next_map_item(iterator: Variable) -> Tuple[Any, Any, bool]:
+    item = next(iterator.value, ITERATOR_END)
+
+    if item is ITERATOR_END:
+        key_type = iterator.type.get_variable_type_param(0)
+        value_type = iterator.type.get_variable_type_param(1)
+        return Variable.zero_value(key_type), Variable.zero_value(value_type), False
+
+    key, value = item
+    return key, value, True
+
+
+def _copy_item(item: Any) -> Any:
+    if isinstance(item, Variable):
+        return item.copy()
+    return item
+
+
+def format_value(value: Any) -> str:
+    """
+    Formats any runtime value the way the `.` instruction prints it.
+    """
 
-        return self.value == other.value  # type: ignore
+    if type(value) is bool:
+        return "true" if value else "false"
 
+    return str(value)
 
-def int_var(value: int) -> Variable:
-    return Variable(RootType.INTEGER, value)
 
+def repr_value(value: Any) -> str:
+    """
+    Like format_value(), but quotes strings. Used for items of containers.
+    """
 
-def str_var(value: str) -> Variable:
-    return Variable(RootType.STRING, value)
+    if type(value) is str:
+        return '"' + value + '"'
 
+    if isinstance(value, Variable) and value.type.root_type == RootType.STRING_BUFFER:
+        return '"' + str(value) + '"'
 
-def bool_var(value: bool) -> Variable:
-    return Variable(RootType.BOOL, value)
+    return format_value(value)
 
 
 class TypePlaceholder(AaaModel):
@@ -1,13 +1,16 @@
 from contextlib import redirect_stderr, redirect_stdout
 from io import StringIO
 from pathlib import Path
-from tempfile import TemporaryDirectory
 from typing import Dict, List, Tuple, Type
 
 from lang.exceptions import AaaException, AaaRuntimeException
 from lang.runtime.program import Program
+from lang.runtime.pycompiler import PyCompiler
 from lang.runtime.simulator import Simulator
 
+# Directory that source files of tests pretend to be in, they are never written
+SOURCE_DIRECTORY = Path("/nonexistent/aaa")
+
 
 def check_aaa_main(
     code: str, expected_output: str, expected_exception_types: List[Type[Exception]]
@@ -30,25 +33,47 @@ def check_aaa_full_source_multi_file(
     expected_output: str,
     expected_exception_types: List[Type[Exception]],
 ) -> Tuple[str, List[AaaException]]:
+    sources = {SOURCE_DIRECTORY / file: code for file, code in files.items()}
+    main_path = SOURCE_DIRECTORY / "main.aaa"
+
+    exceptions = _check_aaa_program(
+        Program(main_path, sources=sources),
+        Simulator,
+        expected_output,
+        expected_exception_types,
+    )
+
+    # The PeepholeOptimizer and PyCompiler should never change behaviour
+    for optimize in [False, True]:
+        for engine in [Simulator, PyCompiler]:
+            other_exceptions = _check_aaa_program(
+                Program(main_path, optimize=optimize, sources=sources),
+                engine,
+                expected_output,
+                expected_exception_types,
+            )
 
-    with TemporaryDirectory() as directory:
-        dir_path = Path(directory)
-        for file, code in files.items():
-            (dir_path / file).write_text(code)
+            assert list(map(type, exceptions)) == list(map(type, other_exceptions))
 
-        main_path = dir_path / "main.aaa"
-        program = Program(main_path)
+    return str(SOURCE_DIRECTORY), exceptions
 
-        exceptions: List[AaaException] = []
-        exceptions += program.file_load_errors
 
-        if not exceptions:
-            with redirect_stdout(StringIO()) as stdout:
-                with redirect_stderr(StringIO()) as stderr:
-                    try:
-                        Simulator(program).run(raise_=True)
-                    except AaaRuntimeException as e:
-                        exceptions = [e]
+def _check_aaa_program(
+    program: Program,
+    engine: Type[Simulator | PyCompiler],
+    expected_output: str,
+    expected_exception_types: List[Type[Exception]],
+) -> List[AaaException]:
+    exceptions: List[AaaException] = []
+    exceptions += program.file_load_errors
+
+    if not exceptions:
+        with redirect_stdout(StringIO()) as stdout:
+            with redirect_stderr(StringIO()) as stderr:
+                try:
+                    engine(program).run(raise_=True)
+                except AaaRuntimeException as e:
+                    exceptions = [e]
 
     exception_types = list(map(type, program.file_load_errors))
 
@@ -58,4 +83,4 @@ def check_aaa_full_source_multi_file(
         assert expected_output == stdout.getvalue()
         assert "" == stderr.getvalue()
 
-    return directory, exceptions
+    return exceptions
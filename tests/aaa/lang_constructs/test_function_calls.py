@@ -22,6 +22,13 @@ from tests.aaa import check_aaa_full_source
             [],
             id="three-params",
         ),
+        pytest.param(
+            "fn main { 1 2 sub . }\n"
+            + "fn sub args a as int, b as int return int { b a - }",
+            "1",
+            [],
+            id="argument-order",
+        ),
         pytest.param(
             "fn main { foo }\n"
             + "fn foo { bar }\n"
@@ -40,6 +47,33 @@ from tests.aaa import check_aaa_full_source
             [],
             id="forwarding-three-params",
         ),
+        pytest.param(
+            "fn main { 10000 count_down . }\n"
+            + "fn count_down args n as int return int {\n"
+            + "    if n 0 = { 0 } else { n 1 - count_down 1 + }\n"
+            + "}",
+            "10000",
+            [],
+            id="deep-recursion",
+        ),
+        pytest.param(
+            "fn main { 0 1000000 sum . }\n"
+            + "fn sum args total as int, n as int return int {\n"
+            + "    if n 0 = { total } else { total n + n 1 - sum }\n"
+            + "}",
+            "500000500000",
+            [],
+            id="tail-recursion",
+        ),
+        pytest.param(
+            "fn main { 5 count }\n"
+            + "fn count args n as int {\n"
+            + "    if n 0 = { nop } else { n . n 1 - count }\n"
+            + "}",
+            "54321",
+            [],
+            id="tail-recursion-no-return-values",
+        ),
         pytest.param(
             "fn foo { nop }",
             "",
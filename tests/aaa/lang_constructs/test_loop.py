@@ -10,6 +10,16 @@ from tests.aaa import check_aaa_main
         pytest.param(
             "1 . 2 while dup 4 <= { dup . 1 + } drop 5 .", "12345", id="true-false"
         ),
+        pytest.param(
+            "0 while dup 5 < { if dup 2 = { 7 . } 1 + } drop",
+            "7",
+            id="branch-in-body",
+        ),
+        pytest.param(
+            '0 while dup 2 < { 0 while dup 2 < { over . 1 + } drop 1 + "," . } drop',
+            "00,11,",
+            id="nested",
+        ),
     ],
 )
 def test_loop(code: str, expected_output: str) -> None:
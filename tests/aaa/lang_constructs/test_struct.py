@@ -69,6 +69,20 @@ from tests.aaa import check_aaa_full_source
             [],
             id="set-get-map",
         ),
+        pytest.param(
+            "struct foo { x as int, y as int } fn main { foo "
+            + '"y" { if true { 3 } else { 4 } } ! "x" { 2 } ! "y" ? . "x" ? . drop }',
+            "32",
+            [],
+            id="set-get-multiple-fields",
+        ),
+        pytest.param(
+            'struct foo { x as vec[int] } fn main { foo "x" ? 5 vec:push drop drop '
+            + 'foo "x" ? . drop }',
+            "[]",
+            [],
+            id="fields-not-shared",
+        ),
         pytest.param(
             'fn main { "x" ? }',
             "",
@@ -12,6 +12,7 @@ AAA_KEYWORDS = [
     "assert",
     "bool",
     "builtin_fn",
+    "close_file",
     "drop",
     "dup",
     "else",
@@ -21,14 +22,22 @@ AAA_KEYWORDS = [
     "if",
     "import",
     "int",
+    "iter",
     "map",
+    "map_iter",
     "nop",
     "not",
+    "open_file",
     "or",
     "over",
+    "read_chunk",
+    "read_file",
+    "read_line",
     "return",
     "rot",
+    "set",
     "str",
+    "strbuf",
     "struct",
     "swap",
     "true",
@@ -0,0 +1,99 @@
+from typing import List, Type
+
+import pytest
+
+from tests.aaa import check_aaa_full_source, check_aaa_main
+
+
+@pytest.mark.parametrize(
+    ["code", "expected_output", "expected_exception_types"],
+    [
+        pytest.param(
+            "map[str, int] map:keys . drop", "iter", [], id="print-iter"
+        ),
+        pytest.param(
+            "map[str, int] map:items . drop", "map_iter", [], id="print-map-iter"
+        ),
+        pytest.param(
+            'map[str, int] "a" 1 map:set "b" 2 map:set map:keys '
+            + "iter:next while dup { drop . iter:next } drop drop drop drop",
+            "ab",
+            [],
+            id="keys",
+        ),
+        pytest.param(
+            'map[str, int] "a" 1 map:set "b" 2 map:set map:values '
+            + "iter:next while dup { drop . iter:next } drop drop drop drop",
+            "12",
+            [],
+            id="values",
+        ),
+        pytest.param(
+            'map[str, int] "a" 1 map:set "b" 2 map:set map:items map_iter:next '
+            + "while dup { drop swap . . map_iter:next } drop drop drop drop drop",
+            "a1b2",
+            [],
+            id="items",
+        ),
+        pytest.param(
+            "map[int, str] map:values iter:next . . drop drop",
+            "false",
+            [],
+            id="empty-zero-values",
+        ),
+        pytest.param(
+            'map[int, str] 1 "a" map:set map:items map_iter:next drop drop drop '
+            + "map_iter:next . . . drop drop",
+            "false0",
+            [],
+            id="exhausted-zero-values",
+        ),
+        pytest.param(
+            "map[int, int] 1 1 map:set 2 2 map:set map:keys swap 3 3 map:set "
+            + "2 map:drop swap iter:next while dup { drop . iter:next } "
+            + "drop drop drop .",
+            "12{1: 1, 3: 3}",
+            [],
+            id="change-map-while-iterating",
+        ),
+        pytest.param(
+            "map[int, int] 1 1 map:set map:keys dup iter:next drop . "
+            + "iter:next . . drop drop drop",
+            "1false0",
+            [],
+            id="dup-shares-position",
+        ),
+    ],
+)
+def test_iter(
+    code: str, expected_output: str, expected_exception_types: List[Type[Exception]]
+) -> None:
+    check_aaa_main(code, expected_output, expected_exception_types)
+
+
+GENERIC_ITER_FUNCTIONS = (
+    "fn print_values args m as map[*k, *v] { m map:values swap drop iter:next "
+    + 'while dup { drop . " " . iter:next } drop . drop }\n'
+    + "fn print_items args m as map[*k, *v] { m map:items swap drop "
+    + 'map_iter:next while dup { drop . "=" . . " " . map_iter:next } drop . . '
+    + "drop }\n"
+)
+
+
+@pytest.mark.parametrize(
+    ["code", "expected_output"],
+    [
+        pytest.param(
+            "map[str, vec[int]] dup print_values print_items", "[][]", id="empty"
+        ),
+        pytest.param(
+            'map[bool, int] true 3 map:set dup print_values "|" . print_items',
+            "3 0|3=true 0false",
+            id="items",
+        ),
+    ],
+)
+def test_iter_generic_functions(code: str, expected_output: str) -> None:
+    # Zero values at the end come from the type of the map at runtime
+    code = GENERIC_ITER_FUNCTIONS + "fn main { " + code + " }"
+    check_aaa_full_source(code, expected_output, [])
@@ -64,6 +64,19 @@ from tests.aaa import check_aaa_main
             [],
             id="copy",
         ),
+        pytest.param(
+            'map[str, int] "one" 1 map:set map:copy "two" 2 map:set . .',
+            '{"one": 1, "two": 2}{"one": 1}',
+            [],
+            id="copy-set-copy",
+        ),
+        pytest.param(
+            'map[str, vec[int]] "one" vec[int] map:set '
+            + 'map:copy "one" map:get 5 vec:push drop . .',
+            '{"one": [5]}{"one": []}',
+            [],
+            id="copy-nested",
+        ),
         pytest.param(
             'map[str, int] "one" 1 map:set dup map:clear map:size . drop map:size . drop',
             "00",
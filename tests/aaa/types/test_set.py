@@ -0,0 +1,58 @@
+from typing import List, Type
+
+import pytest
+
+from tests.aaa import check_aaa_main
+
+
+@pytest.mark.parametrize(
+    ["code", "expected_output", "expected_exception_types"],
+    [
+        pytest.param("set[int] .", "{}", [], id="print-zero-items"),
+        pytest.param('set[str] "one" set:add .', '{"one"}', [], id="print-one-item"),
+        pytest.param(
+            "set[int] 3 set:add 1 set:add 2 set:add .",
+            "{3, 1, 2}",
+            [],
+            id="print-insertion-order",
+        ),
+        pytest.param(
+            "set[int] 1 set:add 1 set:add set:size . drop",
+            "1",
+            [],
+            id="add-twice",
+        ),
+        pytest.param(
+            "set[int] 1 set:add 1 set:has . drop", "true", [], id="has-true"
+        ),
+        pytest.param(
+            "set[int] 1 set:add 2 set:has . drop", "false", [], id="has-false"
+        ),
+        pytest.param("set[bool] set:size . drop", "0", [], id="size-zero-items"),
+        pytest.param(
+            "set[int] 1 set:add 2 set:add 1 set:drop .", "{2}", [], id="drop-ok"
+        ),
+        pytest.param(
+            "set[int] 1 set:add 2 set:drop .", "{1}", [], id="drop-missing"
+        ),
+        pytest.param(
+            "set[int] 1 set:add 2 set:add 1 set:drop 1 set:add .",
+            "{2, 1}",
+            [],
+            id="drop-add-again",
+        ),
+        pytest.param(
+            "set[int] 1 set:add set:clear set:size . drop", "0", [], id="clear"
+        ),
+        pytest.param(
+            "set[int] 1 set:add dup 2 set:add . .",
+            "{1, 2}{1, 2}",
+            [],
+            id="dup",
+        ),
+    ],
+)
+def test_set(
+    code: str, expected_output: str, expected_exception_types: List[Type[Exception]]
+) -> None:
+    check_aaa_main(code, expected_output, expected_exception_types)
@@ -0,0 +1,57 @@
+from typing import List, Type
+
+import pytest
+
+from lang.exceptions.typing import StackTypesError
+from tests.aaa import check_aaa_main
+
+
+@pytest.mark.parametrize(
+    ["code", "expected_output", "expected_exception_types"],
+    [
+        pytest.param("strbuf .", "", [], id="print-empty"),
+        pytest.param(
+            'strbuf "a" strbuf:append "bc" strbuf:append .', "abc", [], id="append"
+        ),
+        pytest.param(
+            'strbuf "a" strbuf:append strbuf:to_str . "b" strbuf:append .',
+            "aab",
+            [],
+            id="to-str-then-append",
+        ),
+        pytest.param(
+            'strbuf "ab" strbuf:append "é" strbuf:append strbuf:size . drop',
+            "3",
+            [],
+            id="size",
+        ),
+        pytest.param(
+            'strbuf "a" strbuf:append strbuf:to_str "b" + . drop',
+            "ab",
+            [],
+            id="to-str-is-str",
+        ),
+        pytest.param(
+            "strbuf 0 while dup 3 < { swap \"x\" strbuf:append swap 1 + } drop .",
+            "xxx",
+            [],
+            id="loop",
+        ),
+        pytest.param(
+            'vec[strbuf] strbuf "a" strbuf:append vec:push .',
+            '["a"]',
+            [],
+            id="print-in-container",
+        ),
+        pytest.param(
+            'strbuf "a" strbuf:append strbuf:size . 1 strbuf:append',
+            "",
+            [StackTypesError],
+            id="append-int",
+        ),
+    ],
+)
+def test_strbuf(
+    code: str, expected_output: str, expected_exception_types: List[Type[Exception]]
+) -> None:
+    check_aaa_main(code, expected_output, expected_exception_types)
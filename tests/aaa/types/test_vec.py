@@ -1,8 +1,10 @@
+import sys
 from typing import List, Type
 
 import pytest
 
-from tests.aaa import check_aaa_main
+from lang.typing.types import Int, RootType, Variable, VariableType, fill_vec
+from tests.aaa import check_aaa_full_source, check_aaa_main
 
 
 @pytest.mark.parametrize(
@@ -13,6 +15,8 @@ from tests.aaa import check_aaa_main
         pytest.param(
             "vec[int] 1 vec:push 2 vec:push .", "[1, 2]", [], id="print-two-items"
         ),
+        pytest.param("vec[bool] true vec:push .", "[true]", [], id="print-bool-item"),
+        pytest.param('vec[str] "a" vec:push .', '["a"]', [], id="print-str-item"),
         pytest.param("vec[vec[int]] .", "[]", [], id="print-nested-zero-items"),
         pytest.param(
             "vec[vec[int]] vec[int] vec:push .", "[[]]", [], id="print-nested-one-item"
@@ -60,6 +64,32 @@ from tests.aaa import check_aaa_main
             [],
             id="copy",
         ),
+        pytest.param(
+            "vec[int] 5 vec:push vec:copy swap 6 vec:push . .",
+            "[5, 6][5]",
+            [],
+            id="copy-push-original",
+        ),
+        pytest.param(
+            "vec[int] 5 vec:push vec:copy 0 7 vec:set . .",
+            "[7][5]",
+            [],
+            id="copy-set-copy",
+        ),
+        pytest.param(
+            "vec[vec[int]] vec[int] 5 vec:push vec:push "
+            + "vec:copy 0 vec:get 6 vec:push drop . .",
+            "[[5, 6]][[5]]",
+            [],
+            id="copy-nested",
+        ),
+        pytest.param(
+            "vec[vec[int]] vec[int] 5 vec:push vec:push "
+            + "0 vec:get swap vec:copy rot 6 vec:push drop . .",
+            "[[5]][[5, 6]]",
+            [],
+            id="copy-nested-after-get",
+        ),
         pytest.param(
             "vec[int] 5 vec:push dup vec:clear vec:size . drop vec:size . drop",
             "00",
@@ -72,9 +102,137 @@ from tests.aaa import check_aaa_main
             [],
             id="nested-one-item",
         ),
+        pytest.param(
+            "vec[int] 1 vec:push vec[int] 2 vec:push 3 vec:push vec:extend .",
+            "[1, 2, 3]",
+            [],
+            id="extend",
+        ),
+        pytest.param(
+            "vec[int] 1 vec:push 2 vec:push dup vec:extend .",
+            "[1, 2, 1, 2]",
+            [],
+            id="extend-itself",
+        ),
+        pytest.param(
+            "vec[int] 1 vec:push 2 vec:push 3 vec:push 1 3 vec:slice . .",
+            "[2, 3][1, 2, 3]",
+            [],
+            id="slice",
+        ),
+        pytest.param(
+            "vec[int] 1 vec:push 2 vec:push 1 5 vec:slice . 2 1 vec:slice . drop",
+            "[2][]",
+            [],
+            id="slice-clamped",
+        ),
+        pytest.param(
+            "vec[vec[int]] vec[int] vec:push 0 1 vec:slice 0 vec:get 5 vec:push "
+            + "drop drop .",
+            "[[]]",
+            [],
+            id="slice-copies-items",
+        ),
+        pytest.param(
+            'vec[str] 3 "a" vec:fill 0 "b" vec:fill .',
+            '["a", "a", "a"]',
+            [],
+            id="fill",
+        ),
+        pytest.param(
+            "vec[vec[int]] 2 vec[int] vec:fill 0 vec:get 5 vec:push drop .",
+            "[[5], []]",
+            [],
+            id="fill-copies-item",
+        ),
+        pytest.param(
+            "vec[int] 100 vec:reserve vec:size . drop",
+            "0",
+            [],
+            id="reserve",
+        ),
+        pytest.param(
+            'vec[bool] true vec:push false vec:push 0 vec:get . " " . .',
+            "true [true, false]",
+            [],
+            id="bool-get",
+        ),
+        pytest.param(
+            "vec[bool] true vec:push vec:pop . drop", "true", [], id="bool-pop"
+        ),
+        pytest.param(
+            "vec[bool] false vec:push 0 true vec:set .", "[true]", [], id="bool-set"
+        ),
+        pytest.param(
+            "vec[bool] 2 true vec:fill 1 2 vec:slice . drop",
+            "[true]",
+            [],
+            id="bool-fill-slice",
+        ),
+        pytest.param(
+            "vec[int] 1 vec:push 9223372036854775807 1 + vec:push .",
+            "[1, 9223372036854775808]",
+            [],
+            id="push-big-int",
+        ),
+        pytest.param(
+            "vec[int] 1 vec:push 0 9223372036854775808 vec:set .",
+            "[9223372036854775808]",
+            [],
+            id="set-big-int",
+        ),
+        pytest.param(
+            "vec[int] 1 vec:push 2 9223372036854775808 vec:fill .",
+            "[1, 9223372036854775808, 9223372036854775808]",
+            [],
+            id="fill-big-int",
+        ),
     ],
 )
 def test_vec(
     code: str, expected_output: str, expected_exception_types: List[Type[Exception]]
 ) -> None:
     check_aaa_main(code, expected_output, expected_exception_types)
+
+
+GENERIC_VEC_FUNCTIONS = (
+    "fn first args v as vec[*a], a as *a return *a { v 0 vec:get swap drop }\n"
+    + "fn last args v as vec[*a], a as *a return *a { v vec:pop swap drop }\n"
+    + "fn push_twice args v as vec[*a], a as *a return vec[*a] "
+    + "{ v a vec:push a vec:push }\n"
+    + "fn set_first args v as vec[*a], a as *a return vec[*a] { v 0 a vec:set }\n"
+)
+
+
+@pytest.mark.parametrize(
+    ["code", "expected_output"],
+    [
+        pytest.param(
+            "vec[bool] true push_twice false set_first dup false first . "
+            + "dup false last . .",
+            "falsetrue[false]",
+            id="bool",
+        ),
+        pytest.param(
+            "vec[int] 1 push_twice 9223372036854775808 set_first dup 0 first . "
+            + "9223372036854775808 push_twice .",
+            "9223372036854775808"
+            + "[9223372036854775808, 1, 9223372036854775808, 9223372036854775808]",
+            id="int",
+        ),
+        pytest.param(
+            'vec[str] "a" push_twice dup "" last . .', 'a["a"]', id="str"
+        ),
+    ],
+)
+def test_vec_generic_functions(code: str, expected_output: str) -> None:
+    code = GENERIC_VEC_FUNCTIONS + "fn main { " + code + " }"
+    check_aaa_full_source(code, expected_output, [])
+
+
+def test_vec_int_items_are_packed() -> None:
+    vec = Variable.zero_value(VariableType(RootType.VECTOR, [Int]))
+    fill_vec(vec, 1_000_000, 5)
+
+    # Python ints in a list would take about 36 MB
+    assert sys.getsizeof(vec.value) < 10_000_000
@@ -8,7 +8,19 @@ from lang.exceptions import AaaLoadException
 from lang.runtime.program import Builtins, Program
 
 
-@pytest.fixture(scope="module", autouse=True)
+@pytest.fixture(scope="session")
+def program_builtins(setup_test_environment: None) -> Builtins:
+    """
+    Builtins loaded once per test session, or once per worker process when tests run
+    in parallel.
+    """
+
+    program = Program.without_file("fn main { nop }")
+    assert not program.file_load_errors
+    return program.builtins
+
+
+@pytest.fixture(autouse=True)
 def cache_program_builtins(request: SubRequest) -> Generator[None, None, None]:
     """
     Prevents that every test that runs Aaa code loads the builtins file.
@@ -20,13 +32,14 @@ def cache_program_builtins(request: SubRequest) -> Generator[None, None, None]:
         yield
         return
 
-    program = Program.without_file("fn main { nop }")
+    # Requested here, so tests breaking the builtins file never load them first
+    builtins: Builtins = request.getfixturevalue("program_builtins")
 
     def cached_builtins(
         *args: Any,
         **kwargs: Any,
     ) -> Tuple[Builtins, List[AaaLoadException]]:
-        return program._builtins, program.file_load_errors
+        return builtins, []
 
     with patch.object(Program, "_load_builtins", cached_builtins):
         yield
@@ -0,0 +1,29 @@
+from pathlib import Path
+
+import pytest
+
+from lang.runtime.benchmark import count_instructions, find_benchmarks, run_benchmark
+from lang.runtime.program import Program
+
+
+@pytest.mark.parametrize("file", find_benchmarks(), ids=lambda file: file.stem)
+def test_benchmark_loads(file: Path) -> None:
+    assert Program(file).file_load_errors == []
+
+
+def test_count_instructions() -> None:
+    program = Program.without_file("fn main { 1 2 + drop foo }\nfn foo { nop }")
+
+    # Both functions also run their implicit return
+    assert count_instructions(program) == 8
+
+
+def test_run_benchmark() -> None:
+    file = next(file for file in find_benchmarks() if file.stem == "recursion")
+    result = run_benchmark(file, warmup=1, repeat=2)
+
+    assert set(result["load"]) == {"total", "parse", "type_check", "generate", "decode"}
+    assert len(result["run"]["times"]) == 2
+    assert result["run"]["min"] <= result["run"]["median"]
+    assert result["instructions"] > 0
+    assert result["instructions_per_second"] > 0
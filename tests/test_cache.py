@@ -0,0 +1,150 @@
+import shutil
+from contextlib import redirect_stdout
+from io import StringIO
+from pathlib import Path
+from typing import Dict
+
+from pytest import CaptureFixture
+
+from aaa import main
+from lang.exceptions.misc import MainFunctionNotFound
+from lang.runtime.cache import (
+    CACHE_DIR_NAME,
+    CACHE_VERSION,
+    cache_file,
+    load_cache,
+    save_cache,
+)
+from lang.runtime.program import Program
+from lang.runtime.simulator import Simulator
+
+
+def write_files(directory: Path, files: Dict[str, str]) -> None:
+    for name, code in files.items():
+        (directory / name).write_text(code)
+
+
+def run(program: Program) -> str:
+    assert program.file_load_errors == []
+
+    with redirect_stdout(StringIO()) as stdout:
+        Simulator(program).run(raise_=True)
+
+    return stdout.getvalue()
+
+
+def test_cache_skips_loading(tmp_path: Path) -> None:
+    files = {
+        "main.aaa": 'from "five" import five\nfn main { five . }',
+        "five.aaa": "fn five return int { 5 }",
+    }
+    write_files(tmp_path, files)
+
+    assert run(Program(tmp_path / "main.aaa")) == "5"
+    assert (tmp_path / CACHE_DIR_NAME / "main.aaa.pickle").exists()
+    assert (tmp_path / CACHE_DIR_NAME / "five.aaa.pickle").exists()
+
+    program = Program(tmp_path / "main.aaa")
+    assert program.load_times == {"parse": 0.0, "type_check": 0.0, "generate": 0.0}
+    assert run(program) == "5"
+
+
+def test_cache_invalidated_by_import(tmp_path: Path) -> None:
+    files = {
+        "main.aaa": 'from "five" import five\nfn main { five 1 + . }',
+        "five.aaa": "fn five return int { 5 }",
+    }
+    write_files(tmp_path, files)
+    assert run(Program(tmp_path / "main.aaa")) == "6"
+
+    write_files(tmp_path, {"five.aaa": "fn five return int { 6 }"})
+    assert run(Program(tmp_path / "main.aaa")) == "7"
+
+    # Importing file has to be type checked again
+    write_files(tmp_path, {"five.aaa": 'fn five return str { "five" }'})
+    assert Program(tmp_path / "main.aaa").file_load_errors
+
+
+def test_cache_of_copied_directory(tmp_path: Path) -> None:
+    original = tmp_path / "original"
+    original.mkdir()
+    files = {
+        "main.aaa": 'from "five" import five\nfn main { five . }',
+        "five.aaa": "fn five return int { 5 }",
+    }
+    write_files(original, files)
+    assert run(Program(original / "main.aaa")) == "5"
+
+    copy = tmp_path / "copy"
+    shutil.copytree(original, copy)
+    write_files(copy, {"five.aaa": "fn five return int { 6 }"})
+
+    assert run(Program(copy / "main.aaa")) == "6"
+    assert run(Program(original / "main.aaa")) == "5"
+
+
+def test_cache_separate_for_optimize(tmp_path: Path) -> None:
+    write_files(tmp_path, {"main.aaa": "fn main { 1 2 + . }"})
+
+    Program(tmp_path / "main.aaa")
+    Program(tmp_path / "main.aaa", optimize=True)
+
+    assert cache_file(tmp_path / "main.aaa", optimize=False).exists()
+    assert cache_file(tmp_path / "main.aaa", optimize=True).exists()
+
+    optimized = Program(tmp_path / "main.aaa", optimize=True)
+    assert run(optimized) == "3"
+
+
+def test_cache_imported_file_without_main(tmp_path: Path) -> None:
+    files = {
+        "main.aaa": 'from "five" import five\nfn main { five . }',
+        "five.aaa": "fn five return int { 5 }",
+    }
+    write_files(tmp_path, files)
+    Program(tmp_path / "main.aaa")
+
+    program = Program(tmp_path / "five.aaa")
+    assert list(map(type, program.file_load_errors)) == [MainFunctionNotFound]
+
+
+def test_cache_corrupted(tmp_path: Path) -> None:
+    write_files(tmp_path, {"main.aaa": "fn main { 3 . }"})
+    Program(tmp_path / "main.aaa")
+
+    cache_file(tmp_path / "main.aaa", optimize=False).write_bytes(b"garbage")
+    assert run(Program(tmp_path / "main.aaa")) == "3"
+
+
+def test_cache_payload_checked_before_unpickling(tmp_path: Path) -> None:
+    file = tmp_path / "value.pickle"
+    save_cache(file, "key", [1, 2, 3])
+    assert load_cache(file, "key") == [1, 2, 3]
+    assert load_cache(file, "other") is None
+
+    header, payload = file.read_bytes().split(b"\n", 1)
+    assert header.split()[0] == CACHE_VERSION.encode()
+
+    file.write_bytes(header + b"\n" + payload.replace(b"\x03", b"\x04"))
+    assert load_cache(file, "key") is None
+
+    file.write_bytes(b"0 " + header.split(b" ", 1)[1] + b"\n" + payload)
+    assert load_cache(file, "key") is None
+
+
+def test_cache_disabled(tmp_path: Path) -> None:
+    write_files(tmp_path, {"main.aaa": "fn main { 3 . }"})
+
+    assert run(Program(tmp_path / "main.aaa", use_cache=False)) == "3"
+    assert not (tmp_path / CACHE_DIR_NAME).exists()
+
+
+def test_cache_disabled_from_command_line(
+    tmp_path: Path, capfd: CaptureFixture[str]
+) -> None:
+    write_files(tmp_path, {"main.aaa": "fn main { 3 . }"})
+
+    assert main(["aaa", "run", str(tmp_path / "main.aaa"), "--no-cache"]) == 0
+    stdout, _ = capfd.readouterr()
+    assert stdout == "3"
+    assert not (tmp_path / CACHE_DIR_NAME).exists()
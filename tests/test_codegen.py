@@ -0,0 +1,261 @@
+import os
+import shutil
+import subprocess
+from contextlib import redirect_stdout
+from io import StringIO
+from pathlib import Path
+from tempfile import TemporaryDirectory
+
+import pytest
+
+from lang.codegen.c import CGenerator
+from lang.exceptions.misc import IntegerOutOfRange, StackHeightExceeded
+from lang.runtime.program import Program
+from lang.runtime.simulator import Simulator
+
+pytestmark = pytest.mark.skipif(
+    shutil.which("cc") is None, reason="No C compiler available"
+)
+
+
+def run_compiled(program: Program) -> subprocess.CompletedProcess[str]:
+    with TemporaryDirectory() as directory:
+        binary = Path(directory) / "main"
+        CGenerator(program).compile(binary)
+        return subprocess.run([str(binary)], capture_output=True, text=True)
+
+
+@pytest.mark.parametrize("optimize", [False, True])
+@pytest.mark.parametrize(
+    "code",
+    [
+        pytest.param(
+            'fn main { 1 while dup 16 < { if dup 15 % drop 0 = { "fizzbuzz" . } '
+            + 'else { dup . } " " . 1 + } drop }',
+            id="loop",
+        ),
+        pytest.param(
+            "fn main { 7 2 / . . 7 0 2 - / . . 0 7 - 2 % . . 7 0 / . . 7 0 % . . }",
+            id="divide-modulo",
+        ),
+        pytest.param(
+            'fn main { "a\\"b\\\\c\\n" dup . "d" + . }', id="string"
+        ),
+        pytest.param(
+            "fn main { vec[int] 3 vec:push 4 vec:push dup . vec:copy 5 vec:push . "
+            + "vec:size . drop }",
+            id="vec",
+        ),
+        pytest.param(
+            "fn main { vec[int] 100 vec:reserve 3 7 vec:fill dup vec:extend 1 4 "
+            + "vec:slice . 9 vec:push vec[int] 1 vec:push vec:extend . }",
+            id="vec-bulk",
+        ),
+        pytest.param(
+            "fn main { vec[bool] true push_twice dup false first . false last . "
+            + "vec[int] 1 push_twice 2 set_first dup 0 first . 0 last . }\n"
+            + "fn first args v as vec[*a], a as *a return *a "
+            + "{ v 0 vec:get swap drop }\n"
+            + "fn last args v as vec[*a], a as *a return *a "
+            + "{ v vec:pop swap drop }\n"
+            + "fn push_twice args v as vec[*a], a as *a return vec[*a] "
+            + "{ v a vec:push a vec:push }\n"
+            + "fn set_first args v as vec[*a], a as *a return vec[*a] "
+            + "{ v 0 a vec:set }",
+            id="vec-generic",
+        ),
+        pytest.param(
+            'fn main { map[str, vec[int]] "a" vec[int] 1 vec:push map:set "b" '
+            + 'vec[int] map:set "a" map:drop "a" vec[int] map:set dup . "b" '
+            + "map:has_key . map:size . drop }",
+            id="map",
+        ),
+        pytest.param(
+            "fn main { map[int, int] 0 while dup 100 < { dup rot swap set_square "
+            + "swap 1 + } drop 99 map:get . map:size . drop }\n"
+            + "fn set_square args m as map[int, int], i as int return map[int, int] "
+            + "{ m i i i * map:set }",
+            id="map-resize",
+        ),
+        pytest.param(
+            'fn main { set[str] "a" set:add "b" set:add "a" set:add "c" set:drop '
+            + 'dup . "a" set:drop "a" set:has . "a" set:add dup . set:size . set:clear '
+            + "set:size . drop }",
+            id="set",
+        ),
+        pytest.param(
+            'fn main { map[str, int] "a" 1 map:set "b" 2 map:set map:items swap '
+            + '"c" 3 map:set "a" map:drop swap map_iter:next while dup { drop . . '
+            + "map_iter:next } drop . . drop map:values iter:next drop . iter:next "
+            + ". . drop . }",
+            id="iterators",
+        ),
+        pytest.param(
+            'fn main { map[str, vec[int]] dup print_values "|" . print_items "|" . '
+            + 'map[bool, int] true 3 map:set dup print_values "|" . print_items }\n'
+            + "fn print_values args m as map[*k, *v] { m map:values swap drop "
+            + 'iter:next while dup { drop . " " . iter:next } drop . drop }\n'
+            + "fn print_items args m as map[*k, *v] { m map:items swap drop "
+            + 'map_iter:next while dup { drop . "=" . . " " . map_iter:next } '
+            + "drop . . drop }",
+            id="iterators-generic",
+        ),
+        pytest.param(
+            'fn main { strbuf "a" strbuf:append "é" strbuf:append dup . strbuf:size . '
+            + "strbuf:to_str swap vec[strbuf] swap vec:push vec:copy . . . "
+            + "iter[int] iter:next . . drop }",
+            id="strbuf",
+        ),
+        pytest.param(
+            "struct point {\n    x as int,\n    name as str,\n}\n"
+            + 'fn main { point "x" { 3 } ! "x" ? . "name" { "p" } ! "name" ? . '
+            + "drop }",
+            id="struct",
+        ),
+        pytest.param(
+            "fn main { 3 5 swap . . 1 2 3 rot . . . 4 5 over . . . }",
+            id="stack-operations",
+        ),
+        pytest.param(
+            "fn main { 30 fib . }\n"
+            + "fn fib args n as int return int {\n"
+            + "    if n 2 < { n } else { n 1 - fib n 2 - fib + }\n"
+            + "}",
+            id="recursion",
+        ),
+        pytest.param(
+            "fn main { 0 1000000 sum . }\n"
+            + "fn sum args total as int, n as int return int {\n"
+            + "    if n 0 = { total } else { total n + n 1 - sum }\n"
+            + "}",
+            id="tail-recursion",
+        ),
+    ],
+)
+def test_codegen_matches_simulator(code: str, optimize: bool) -> None:
+    program = Program.without_file(code, optimize=optimize)
+    assert program.file_load_errors == []
+
+    with redirect_stdout(StringIO()) as stdout:
+        Simulator(program).run(raise_=True)
+
+    process = run_compiled(program)
+
+    assert process.returncode == 0
+    assert process.stdout == stdout.getvalue()
+
+
+def test_codegen_assertion_failure() -> None:
+    code = (
+        'fn main { "a" print 3 foo }\n'
+        + "fn foo args n as int { n 1 - bar }\n"
+        + 'fn bar args n as int { n 3 = assert "b" print }\n'
+        + "fn print args s as str { s . }"
+    )
+    process = run_compiled(Program.without_file(code))
+
+    assert process.returncode == 1
+    assert process.stdout == "a"
+    assert process.stderr == (
+        "Assertion failure, stacktrace:\n"
+        + "- main- foo, arguments: n=3- bar, arguments: n=2\n"
+    )
+
+
+@pytest.mark.parametrize(
+    ["code", "optimize", "value"],
+    [
+        pytest.param("9223372036854775808 .", False, 2**63, id="literal"),
+        pytest.param("0 9223372036854775809 - .", False, 2**63 + 1, id="negative"),
+        pytest.param("9223372036854775807 1 + .", True, 2**63, id="folded"),
+        pytest.param("n 9223372036854775808 + .", True, 2**63, id="immediate"),
+    ],
+)
+def test_codegen_integer_out_of_range(code: str, optimize: bool, value: int) -> None:
+    code = "fn main { 1 f }\nfn f args n as int { " + code + " }"
+    program = Program.without_file(code, optimize=optimize)
+    assert program.file_load_errors == []
+
+    with pytest.raises(IntegerOutOfRange) as e:
+        CGenerator(program).generate()
+
+    assert e.value.value == value
+    assert str(e.value).endswith(
+        f":2:1: Function f uses integer {value}, which does not fit in the 64 bits "
+        + "of compiled code"
+    )
+
+
+def test_codegen_lowest_integer() -> None:
+    # Folded into a literal that C can't write directly
+    code = "fn main { 0 9223372036854775808 - . }"
+    program = Program.without_file(code, optimize=True)
+    assert "INT64_MIN" in CGenerator(program).generate()
+
+    process = run_compiled(program)
+    assert process.returncode == 0
+    assert process.stdout == "-9223372036854775808"
+
+
+def test_codegen_open_file_with_stdin_closed(tmp_path: Path) -> None:
+    (tmp_path / "lines.txt").write_text("one\n")
+    code = f'fn main {{ "{tmp_path / "lines.txt"}" open_file . dup . read_line . . }}'
+
+    with TemporaryDirectory() as directory:
+        binary = Path(directory) / "main"
+        CGenerator(Program.without_file(code)).compile(binary)
+        process = subprocess.run(
+            [str(binary)],
+            capture_output=True,
+            text=True,
+            preexec_fn=lambda: os.close(0),
+        )
+
+    assert process.stdout == "true3trueone"
+
+
+def test_codegen_read_chunk_invalid_size() -> None:
+    process = run_compiled(Program.without_file("fn main { 0 0 read_chunk . . }"))
+
+    assert process.returncode == 1
+    assert process.stderr == "Invalid argument for read_chunk: size 0 is not positive\n"
+
+
+def test_codegen_stack_height_exceeded() -> None:
+    program = Program.without_file("fn main { 1 2 3 drop drop drop }")
+    program.function_stack_heights[program.entry_point_file]["main"] = 2
+
+    with pytest.raises(StackHeightExceeded) as e:
+        CGenerator(program).generate()
+
+    assert str(e.value).endswith(
+        ":1:1: Function main uses 3 stack slots, but only 2 were reserved in "
+        + "compiled code"
+    )
+
+
+def test_codegen_input(tmp_path: Path) -> None:
+    (tmp_path / "input.txt").write_text("one\r\ntwo\n")
+    (tmp_path / "full.txt").write_text("x\ny")
+    code = f"""
+    fn main {{
+        0 0 read_line while dup {{ drop . "|" . 1 + 0 read_line }} drop drop .
+        0 2 read_chunk . . 0 close_file .
+        "{tmp_path / "input.txt"}" open_file assert
+        dup read_line assert . dup 9 read_chunk . . close_file .
+        "{tmp_path / "full.txt"}" read_file . .
+        "{tmp_path / "missing"}" read_file . . "{tmp_path / "missing"}" open_file . .
+    }}
+    """
+    program = Program.without_file(code)
+    assert program.file_load_errors == []
+
+    with TemporaryDirectory() as directory:
+        binary = Path(directory) / "main"
+        CGenerator(program).compile(binary)
+        process = subprocess.run(
+            [str(binary)], input="a\nbé\n", capture_output=True, text=True
+        )
+
+    assert process.returncode == 0
+    assert process.stdout == "a|bé|2falsefalseonetruetwo\ntruetruex\nyfalsefalse-1"
@@ -0,0 +1,198 @@
+import json
+from contextlib import redirect_stderr
+from io import BytesIO, StringIO
+from pathlib import Path
+from typing import Any, Dict, List
+
+from lang.runtime.language_server import (
+    INTERNAL_ERROR,
+    PARSE_ERROR,
+    LanguageServer,
+)
+
+
+def encode(messages: List[Dict[str, Any]]) -> BytesIO:
+    data = b""
+
+    for message in messages:
+        body = json.dumps({"jsonrpc": "2.0", **message}).encode()
+        data += f"Content-Length: {len(body)}\r\n\r\n".encode() + body
+
+    return BytesIO(data)
+
+
+def decode(data: bytes) -> List[Dict[str, Any]]:
+    messages: List[Dict[str, Any]] = []
+
+    while data:
+        header, _, data = data.partition(b"\r\n\r\n")
+        length = int(header.decode().split(":")[1])
+        messages.append(json.loads(data[:length]))
+        data = data[length:]
+
+    return messages
+
+
+def run_server(messages: List[Dict[str, Any]]) -> List[Dict[str, Any]]:
+    output = BytesIO()
+    exit_code = LanguageServer(encode(messages), output).run()
+
+    assert exit_code == 0
+    return decode(output.getvalue())
+
+
+def text_document(file: Path, code: str) -> Dict[str, Any]:
+    return {"uri": file.as_uri(), "languageId": "aaa", "version": 1, "text": code}
+
+
+def test_language_server_diagnostics(tmp_path: Path) -> None:
+    file = (tmp_path / "main.aaa").resolve()
+    file.write_text("fn main { nop }")
+
+    changed = {"uri": file.as_uri(), "version": 2}
+    responses = run_server(
+        [
+            {"id": 1, "method": "initialize", "params": {}},
+            {"method": "initialized", "params": {}},
+            {
+                "method": "textDocument/didOpen",
+                "params": {"textDocument": text_document(file, "fn main { 1 }")},
+            },
+            {
+                "method": "textDocument/didChange",
+                "params": {
+                    "textDocument": changed,
+                    "contentChanges": [{"text": "fn main { nop }"}],
+                },
+            },
+            {"id": 2, "method": "unknown/request", "params": {}},
+            {"id": 3, "method": "shutdown"},
+            {"method": "exit"},
+        ]
+    )
+
+    initialize, opened, changed, unknown, shutdown = responses
+
+    assert initialize["id"] == 1
+    assert initialize["result"]["capabilities"]["textDocumentSync"] == 1
+
+    assert opened["method"] == "textDocument/publishDiagnostics"
+    assert opened["params"]["uri"] == file.as_uri()
+
+    [diagnostic] = opened["params"]["diagnostics"]
+    assert diagnostic["range"]["start"] == {"line": 0, "character": 0}
+    assert diagnostic["message"].startswith("Function main returns wrong type(s)")
+
+    assert changed["params"] == {"uri": file.as_uri(), "diagnostics": []}
+
+    assert unknown["id"] == 2
+    assert unknown["error"]["code"] == -32601
+
+    assert shutdown == {"jsonrpc": "2.0", "id": 3, "result": None}
+
+
+def test_language_server_stack_types_error(tmp_path: Path) -> None:
+    file = (tmp_path / "main.aaa").resolve()
+    code = "fn main { nop }\n\n  fn foo { 1 true + drop }"
+
+    responses = run_server(
+        [
+            {"id": 1, "method": "initialize", "params": {}},
+            {
+                "method": "textDocument/didOpen",
+                "params": {"textDocument": text_document(file, code)},
+            },
+            {"id": 2, "method": "shutdown"},
+            {"method": "exit"},
+        ]
+    )
+
+    [diagnostic] = responses[1]["params"]["diagnostics"]
+    assert diagnostic["range"]["start"] == {"line": 2, "character": 2}
+    assert diagnostic["message"].startswith(
+        "Function foo has invalid stack types when calling +"
+    )
+
+
+def test_language_server_errors_in_imported_file(tmp_path: Path) -> None:
+    main_file = (tmp_path / "main.aaa").resolve()
+    lib_file = (tmp_path / "lib.aaa").resolve()
+
+    main_file.write_text('from "lib" import five\nfn main { five . }')
+    lib_file.write_text('fn five return int { "five" }')
+
+    responses = run_server(
+        [
+            {
+                "method": "textDocument/didOpen",
+                "params": {"textDocument": text_document(main_file, "fn main { nop }")},
+            },
+            {
+                "method": "textDocument/didChange",
+                "params": {
+                    "textDocument": {"uri": main_file.as_uri(), "version": 2},
+                    "contentChanges": [{"text": main_file.read_text()}],
+                },
+            },
+            {
+                "method": "textDocument/didClose",
+                "params": {"textDocument": {"uri": main_file.as_uri()}},
+            },
+            {"id": 1, "method": "shutdown"},
+            {"method": "exit"},
+        ]
+    )
+
+    published = [
+        (Path(response["params"]["uri"]).name, response["params"]["diagnostics"])
+        for response in responses
+        if response.get("method") == "textDocument/publishDiagnostics"
+    ]
+
+    assert [(name, len(diagnostics)) for name, diagnostics in published] == [
+        ("main.aaa", 0),
+        ("main.aaa", 0),
+        ("lib.aaa", 1),
+        ("main.aaa", 0),
+    ]
+
+
+def test_language_server_exit_without_shutdown() -> None:
+    output = BytesIO()
+    assert LanguageServer(encode([{"method": "exit"}]), output).run() == 1
+    assert output.getvalue() == b""
+
+
+def test_language_server_survives_malformed_messages(tmp_path: Path) -> None:
+    file = (tmp_path / "main.aaa").resolve()
+    messages = [
+        {"method": "textDocument/didOpen", "params": {}},
+        {"id": 1, "method": "textDocument/didChange", "params": {}},
+        {
+            "method": "textDocument/didOpen",
+            "params": {"textDocument": text_document(file, "fn main { nop }")},
+        },
+        {"id": 2, "method": "shutdown"},
+        {"method": "exit"},
+    ]
+
+    with redirect_stderr(StringIO()) as stderr:
+        responses = run_server(messages)
+
+    assert "KeyError" in stderr.getvalue()
+    assert responses[0]["id"] == 1
+    assert responses[0]["error"]["code"] == INTERNAL_ERROR
+    assert responses[1]["params"]["diagnostics"] == []
+    assert responses[2] == {"jsonrpc": "2.0", "id": 2, "result": None}
+
+
+def test_language_server_invalid_header() -> None:
+    data = b"Content-Length: many\r\n\r\n"
+    data += encode([{"id": 1, "method": "shutdown"}, {"method": "exit"}]).getvalue()
+    output = BytesIO()
+
+    assert LanguageServer(BytesIO(data), output).run() == 0
+
+    [error, response] = decode(output.getvalue())
+    assert error["error"]["code"] == PARSE_ERROR
+    assert response["id"] == 1
@@ -0,0 +1,125 @@
+from contextlib import redirect_stderr, redirect_stdout
+from io import StringIO
+
+import pytest
+
+from lang.exceptions.runtime import AaaLimitExceeded
+from lang.runtime.limits import Limits, count_container_items
+from lang.runtime.observer import MetricsObserver
+from lang.runtime.program import Program
+from lang.runtime.simulator import Simulator
+from lang.typing.types import Int, RootType, Variable, VariableType, fill_vec
+
+CODE = (
+    "fn main { 0 while dup 100 < { 1 + } drop 5 sum . }\n"
+    + "fn sum args n as int return int { if n 0 = { 0 } else { n 1 - sum n + } }"
+)
+
+
+def run(code: str, limits: Limits) -> str:
+    simulator = Simulator(Program.without_file(code), limits=limits)
+    output = StringIO()
+
+    with redirect_stdout(output), redirect_stderr(StringIO()):
+        simulator.run(raise_=True)
+
+    return output.getvalue()
+
+
+@pytest.mark.parametrize(
+    ["code", "limits", "expected_message"],
+    [
+        pytest.param(
+            "while true { nop }",
+            Limits(max_instructions=1000),
+            "Instruction limit of 1000 exceeded",
+            id="instructions-loop",
+        ),
+        pytest.param(
+            CODE,
+            Limits(max_instructions=100),
+            "Instruction limit of 100 exceeded",
+            id="instructions-program",
+        ),
+        pytest.param(
+            "fn main { 0 f . } fn f args n as int return int { n 1 + f 1 + }",
+            Limits(max_call_depth=10),
+            "Call depth limit of 10 exceeded",
+            id="call-depth",
+        ),
+        pytest.param(
+            "fn main { 0 f . } fn f args n as int return int { n n 1 + f + }",
+            Limits(max_stack_size=10),
+            "Stack size limit of 10 exceeded",
+            id="stack-size",
+        ),
+        pytest.param(
+            "vec[int] while true { 1 vec:push } drop",
+            Limits(max_container_items=1000, check_interval=100),
+            "Container item limit of 1000 exceeded",
+            id="container-items-push",
+        ),
+        pytest.param(
+            "vec[int] 1000000000000 0 vec:fill drop",
+            Limits(max_container_items=1000),
+            "Container item limit of 1000 exceeded",
+            id="container-items-fill",
+        ),
+        pytest.param(
+            "vec[int] 0 vec:push while true { dup vec:extend } drop",
+            Limits(max_container_items=1000),
+            "Container item limit of 1000 exceeded",
+            id="container-items-extend",
+        ),
+    ],
+)
+def test_limit_exceeded(code: str, limits: Limits, expected_message: str) -> None:
+    if not code.startswith("fn "):
+        code = "fn main { " + code + " }"
+
+    with pytest.raises(AaaLimitExceeded) as e:
+        run(code, limits)
+
+    assert str(e.value).startswith(expected_message + ", stacktrace:\n- main")
+
+
+def test_limits_not_exceeded() -> None:
+    limits = Limits(
+        max_instructions=10_000,
+        max_call_depth=10,
+        max_stack_size=10,
+        max_container_items=10,
+    )
+
+    assert run(CODE, limits) == "15"
+
+
+def test_limits_charge_upper_bound() -> None:
+    simulator = Simulator(Program.without_file(CODE), limits=Limits(max_call_depth=10))
+    observer = MetricsObserver()
+    simulator.add_observer(observer)
+
+    with redirect_stdout(StringIO()):
+        simulator.run(raise_=True)
+
+    assert simulator.limit_checker
+    executed = observer.metrics()["executed_instructions"]
+    assert executed <= simulator.limit_checker.charged[0]
+
+
+def test_limits_unset() -> None:
+    simulator = Simulator(Program.without_file(CODE), limits=Limits())
+    assert simulator.limit_checker is None
+
+
+def test_count_container_items() -> None:
+    vec = Variable.zero_value(VariableType(RootType.VECTOR, [Int]))
+    fill_vec(vec, 5, 0)
+
+    nested_type = VariableType(RootType.VECTOR, [vec.type])
+    nested = Variable.zero_value(nested_type)
+    fill_vec(nested, 3, vec)
+
+    # Copies share their items until they are changed
+    assert count_container_items([vec, vec.copy(), 7]) == 5
+    assert count_container_items([nested]) == 3 + 5
@@ -0,0 +1,136 @@
+import json
+from contextlib import redirect_stderr, redirect_stdout
+from io import StringIO
+from typing import List, Tuple
+
+import pytest
+
+from lang.exceptions.runtime import AaaAssertionFailure
+from lang.runtime.observer import MetricsObserver, Observer
+from lang.runtime.profiler import Profiler
+from lang.runtime.program import Program
+from lang.runtime.simulator import Simulator
+from lang.typing.types import Variable
+
+CODE = (
+    "fn main { 3 count_down 1 foo vec[int] 1 vec:push vec:copy drop drop "
+    + "map[int, int] drop }\n"
+    + "fn count_down args n as int { if n 0 = not { n 1 - count_down } }\n"
+    + "fn foo args n as int { n . }"
+)
+
+
+class RecordingObserver(Observer):
+    def __init__(self, sample_interval: int = 0) -> None:
+        self.sample_interval = sample_interval
+        self.events: List[Tuple[str, str]] = []
+        self.samples: List[int] = []
+
+    def started(self, simulator: Simulator) -> None:
+        self.events.append(("started", ""))
+
+    def function_entered(self, simulator: Simulator) -> None:
+        self.events.append(("entered", simulator.call_stack[-1].function.identify()))
+
+    def function_left(self, simulator: Simulator) -> None:
+        self.events.append(("left", simulator.call_stack[-1].function.identify()))
+
+    def sample(self, simulator: Simulator) -> None:
+        self.samples.append(simulator.executed_instructions())
+
+    def allocated(self, simulator: Simulator, variable: Variable) -> None:
+        self.events.append(("allocated", str(variable)))
+
+    def finished(self, simulator: Simulator) -> None:
+        self.events.append(("finished", ""))
+
+
+def run(code: str, *observers: Observer) -> Simulator:
+    simulator = Simulator(Program.without_file(code))
+
+    for observer in observers:
+        simulator.add_observer(observer)
+
+    with redirect_stdout(StringIO()):
+        simulator.run(raise_=True)
+
+    return simulator
+
+
+def test_observer_events() -> None:
+    observer = RecordingObserver()
+    run(CODE, observer)
+
+    assert observer.events == [
+        ("started", ""),
+        ("entered", "main"),
+        ("entered", "count_down"),
+        # Recursive calls of count_down are tail calls
+        ("left", "count_down"),
+        ("entered", "count_down"),
+        ("left", "count_down"),
+        ("entered", "count_down"),
+        ("left", "count_down"),
+        ("entered", "count_down"),
+        ("left", "count_down"),
+        ("entered", "foo"),
+        ("left", "foo"),
+        ("allocated", "[]"),
+        ("allocated", "[1]"),
+        ("allocated", "{}"),
+        ("left", "main"),
+        ("finished", ""),
+    ]
+    assert observer.samples == []
+
+
+def test_observer_samples() -> None:
+    first = RecordingObserver(sample_interval=2)
+    second = RecordingObserver(sample_interval=3)
+    simulator = run(CODE, first, second)
+
+    executed = simulator.executed_instructions()
+    assert first.samples == list(range(2, executed + 1, 2))
+    assert second.samples == list(range(3, executed + 1, 3))
+
+
+def test_observer_not_attached() -> None:
+    simulator = Simulator(Program.without_file(CODE))
+    main = list(simulator.decoded_functions.values())[0]["main"]
+
+    # Handlers are not wrapped without observers
+    assert main[0].__name__ == "push_int"
+    assert simulator.executed_instructions() == 0
+
+
+def test_metrics_observer() -> None:
+    observer = MetricsObserver(sample_interval=1)
+    simulator = run(CODE, observer)
+
+    profiler = Profiler(Simulator(Program.without_file(CODE)))
+    with redirect_stdout(StringIO()):
+        profiler.run(raise_=True)
+
+    counts = profiler.instruction_counts()
+    executed = sum(counts.values()) - counts["Return"]
+
+    metrics = observer.metrics()
+    assert metrics["executed_instructions"] == executed
+    assert metrics["executed_instructions"] == simulator.executed_instructions()
+    assert metrics["max_stack_depth"] == 2
+    assert metrics["max_call_depth"] == 2
+    assert metrics["allocations"] == {"map": 1, "vec": 2}
+    assert metrics["seconds"] > 0
+
+    assert json.loads(observer.json()) == metrics
+
+
+def test_metrics_observer_assertion_failure() -> None:
+    observer = MetricsObserver()
+
+    with redirect_stderr(StringIO()):
+        with pytest.raises(AaaAssertionFailure):
+            run("fn main { false assert }", observer)
+
+    assert observer.metrics()["executed_instructions"] == 2
+    assert observer.metrics()["max_call_depth"] == 1
@@ -0,0 +1,153 @@
+from typing import List
+
+import pytest
+
+from lang.instructions.optimizer import PeepholeOptimizer
+from lang.instructions.types import (
+    Drop,
+    Dup,
+    Dup2,
+    Instruction,
+    IntLessThan,
+    IntPlus,
+    IntPlusImmediate,
+    Jump,
+    JumpIfNot,
+    JumpIfNotIntLessThan,
+    Minus,
+    Multiply,
+    Nop,
+    Over,
+    Print,
+    PushBool,
+    PushInt,
+    PushString,
+    Swap,
+)
+from lang.runtime.program import Program
+
+
+@pytest.mark.parametrize(
+    ["instructions", "expected_optimized"],
+    [
+        pytest.param([Nop(), Print()], [Print()], id="nop"),
+        pytest.param([Swap(), Swap(), Print()], [Print()], id="swap-swap"),
+        pytest.param([Dup(), Drop(), Print()], [Print()], id="dup-drop"),
+        pytest.param([PushInt(value=3), Drop()], [], id="push-int-drop"),
+        pytest.param([PushBool(value=True), Drop()], [], id="push-bool-drop"),
+        pytest.param([PushString(value="a"), Drop()], [], id="push-str-drop"),
+        pytest.param([Over(), Over()], [Dup2()], id="over-over"),
+        pytest.param(
+            [PushInt(value=3), IntPlus()], [IntPlusImmediate(value=3)], id="plus"
+        ),
+        pytest.param(
+            [PushInt(value=3), Minus()], [IntPlusImmediate(value=-3)], id="minus"
+        ),
+        pytest.param(
+            [PushInt(value=3), IntPlus(), PushInt(value=4), IntPlus()],
+            [IntPlusImmediate(value=7)],
+            id="plus-plus",
+        ),
+        pytest.param(
+            [PushInt(value=3), IntPlus(), PushInt(value=3), Minus(), Print()],
+            [Print()],
+            id="plus-minus-cancels",
+        ),
+        pytest.param(
+            [PushInt(value=3), PushInt(value=4), Multiply()],
+            [PushInt(value=12)],
+            id="fold-multiply",
+        ),
+        pytest.param(
+            [PushInt(value=3), PushInt(value=4), IntLessThan()],
+            [PushBool(value=True)],
+            id="fold-compare",
+        ),
+        pytest.param(
+            [IntLessThan(), JumpIfNot(instruction_offset=3), Print(), Print()],
+            [JumpIfNotIntLessThan(instruction_offset=2), Print(), Print()],
+            id="fused-jump",
+        ),
+        pytest.param(
+            [JumpIfNot(instruction_offset=1), Print()],
+            [Drop(), Print()],
+            id="jump-if-not-to-next",
+        ),
+        pytest.param(
+            [Jump(instruction_offset=1), Print()], [Print()], id="jump-to-next"
+        ),
+        pytest.param(
+            [
+                JumpIfNot(instruction_offset=3),
+                Print(),
+                Print(),
+                Jump(instruction_offset=5),
+                Print(),
+                Print(),
+            ],
+            [
+                JumpIfNot(instruction_offset=5),
+                Print(),
+                Print(),
+                Jump(instruction_offset=5),
+                Print(),
+                Print(),
+            ],
+            id="thread-jumps",
+        ),
+        pytest.param(
+            [Jump(instruction_offset=1), Jump(instruction_offset=0)],
+            [Jump(instruction_offset=0)],
+            id="jump-cycle",
+        ),
+        pytest.param(
+            [PushInt(value=3), Jump(instruction_offset=3), Print(), Drop()],
+            [PushInt(value=3), Jump(instruction_offset=3), Print(), Drop()],
+            id="jump-target-blocks-rewrite",
+        ),
+        pytest.param(
+            [Jump(instruction_offset=3), Nop(), Print(), Print()],
+            [Jump(instruction_offset=2), Print(), Print()],
+            id="relocate-jump",
+        ),
+    ],
+)
+def test_peephole_optimizer(
+    instructions: List[Instruction], expected_optimized: List[Instruction]
+) -> None:
+    optimized = PeepholeOptimizer(instructions).optimize()
+
+    # Instructions of different type with the same fields compare equal
+    assert list(map(repr, optimized)) == list(map(repr, expected_optimized))
+
+
+def test_peephole_optimizer_does_not_modify_input() -> None:
+    instructions: List[Instruction] = [
+        Jump(instruction_offset=1),
+        Jump(instruction_offset=2),
+        Print(),
+    ]
+    PeepholeOptimizer(instructions).optimize()
+
+    assert instructions == [
+        Jump(instruction_offset=1),
+        Jump(instruction_offset=2),
+        Print(),
+    ]
+
+
+def test_program_optimizes_loop() -> None:
+    code = "fn main { 0 while dup 10 < { 1 + } drop }"
+
+    program = Program.without_file(code)
+    optimized_program = Program.without_file(code, optimize=True)
+
+    assert program.file_load_errors == []
+    assert optimized_program.file_load_errors == []
+
+    instructions = list(program.function_instructions.values())[0]["main"]
+    optimized = list(optimized_program.function_instructions.values())[0]["main"]
+
+    assert len(optimized) < len(instructions)
+    assert repr(IntPlusImmediate(value=1)) in map(repr, optimized)
+    assert JumpIfNotIntLessThan in map(type, optimized)
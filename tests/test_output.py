@@ -0,0 +1,84 @@
+from contextlib import redirect_stderr
+from io import StringIO
+from typing import Type
+
+import pytest
+
+from lang.exceptions.runtime import AaaAssertionFailure
+from lang.runtime.output import OutputBuffer
+from lang.runtime.program import Program
+from lang.runtime.pycompiler import PyCompiler
+from lang.runtime.simulator import Simulator
+
+
+class TerminalIO(StringIO):
+    def isatty(self) -> bool:
+        return True
+
+
+def test_output_buffer_flushes_when_full() -> None:
+    sink = StringIO()
+    output = OutputBuffer(sink, buffer_size=4)
+    output.start()
+
+    output.write("ab")
+    assert sink.getvalue() == ""
+
+    output.write("cd")
+    assert sink.getvalue() == "abcd"
+
+    output.write("e")
+    output.flush()
+    assert sink.getvalue() == "abcde"
+
+
+def test_output_buffer_line_buffered_for_terminal() -> None:
+    sink = TerminalIO()
+    output = OutputBuffer(sink)
+    output.start()
+
+    output.write("a")
+    assert sink.getvalue() == ""
+
+    output.write("b\n")
+    assert sink.getvalue() == "ab\n"
+
+
+@pytest.mark.parametrize("engine", [Simulator, PyCompiler])
+def test_output_sink(engine: Type[Simulator | PyCompiler]) -> None:
+    program = Program.without_file('fn main { 1 . " " . true . " " . "a" . }')
+    sink = StringIO()
+
+    engine(program, output=sink).run(raise_=True)
+    assert sink.getvalue() == "1 true a"
+
+
+@pytest.mark.parametrize("engine", [Simulator, PyCompiler])
+def test_output_flushed_on_assertion_failure(
+    engine: Type[Simulator | PyCompiler],
+) -> None:
+    program = Program.without_file('fn main { "before" . false assert "after" . }')
+    sink = StringIO()
+
+    with redirect_stderr(StringIO()):
+        with pytest.raises(AaaAssertionFailure):
+            engine(program, output=sink).run(raise_=True)
+
+    assert sink.getvalue() == "before"
+
+
+@pytest.mark.parametrize("engine", [Simulator, PyCompiler])
+def test_output_flushed_before_reading_from_terminal(
+    engine: Type[Simulator | PyCompiler],
+) -> None:
+    program = Program.without_file('fn main { "name? " . 0 read_line drop . }')
+    sink = TerminalIO()
+
+    class Input(StringIO):
+        def readline(self, size: int = -1) -> str:
+            # The prompt was shown before waiting for input
+            assert sink.getvalue() == "name? "
+            return super().readline(size)
+
+    engine(program, output=sink, input=Input("aaa\n")).run(raise_=True)
+    assert sink.getvalue() == "name? aaa"
@@ -0,0 +1,80 @@
+from contextlib import redirect_stderr, redirect_stdout
+from io import StringIO
+
+import pytest
+
+from lang.exceptions.runtime import AaaAssertionFailure
+from lang.runtime.profiler import Profiler
+from lang.runtime.program import Program
+from lang.runtime.simulator import Simulator
+
+CODE = (
+    "fn main { 3 count_down 1 foo }\n"
+    + "fn count_down args n as int { if n 0 = not { n 1 - count_down } }\n"
+    + "fn foo args n as int { n . }"
+)
+
+
+def profile(code: str) -> Profiler:
+    profiler = Profiler(Simulator(Program.without_file(code)))
+
+    with redirect_stdout(StringIO()):
+        profiler.run(raise_=True)
+
+    return profiler
+
+
+def test_profiler_counts() -> None:
+    profiler = profile(CODE)
+
+    assert profiler.call_counts == {"main": 1, "count_down": 4, "foo": 1}
+
+    instruction_counts = profiler.instruction_counts()
+    # Recursive calls of count_down are tail calls, which reuse the frame
+    assert instruction_counts["CallFunction"] == 2
+    assert instruction_counts["TailCall"] == 3
+    assert instruction_counts["Return"] == 3
+    assert instruction_counts["Print"] == 1
+
+    main_counts = list(profiler.location_counts.values())[0]["main"]
+    assert main_counts == [1, 1, 1, 1, 1]
+
+
+def test_profiler_times() -> None:
+    profiler = profile(CODE)
+
+    assert set(profiler.collapsed_stacks) == {"main", "main;count_down", "main;foo"}
+
+    # Recursive calls are only counted once in inclusive time
+    assert profiler.inclusive_times["count_down"] <= profiler.inclusive_times["main"]
+
+    for name, exclusive_time in profiler.exclusive_times.items():
+        assert 0 <= exclusive_time <= profiler.inclusive_times[name]
+
+
+def test_profiler_report() -> None:
+    profiler = profile(CODE)
+
+    report = StringIO()
+    profiler.print_report(report)
+    assert "count_down" in report.getvalue()
+    assert "CallFunction" in report.getvalue()
+
+    collapsed = StringIO()
+    profiler.write_collapsed_stacks(collapsed)
+
+    for line in collapsed.getvalue().splitlines():
+        stack, microseconds = line.rsplit(" ", 1)
+        assert stack in profiler.collapsed_stacks
+        assert int(microseconds) > 0
+
+
+def test_profiler_assertion_failure() -> None:
+    profiler = Profiler(Simulator(Program.without_file("fn main { false assert }")))
+
+    with redirect_stderr(StringIO()):
+        with pytest.raises(AaaAssertionFailure):
+            profiler.run(raise_=True)
+
+    assert profiler.frames == []
+    assert profiler.call_counts == {"main": 1}
@@ -1,14 +1,26 @@
 import inspect
 import sys
 from pathlib import Path
+from typing import List
 from unittest.mock import patch
 
 import pytest
 from pytest import MonkeyPatch
 
 from lang.exceptions.import_ import FileReadError
+from lang.exceptions.naming import UnknownIdentifier
+from lang.exceptions.typing import StackTypesError
 from lang.exceptions.misc import MissingEnvironmentVariable
-from lang.instructions.types import Instruction
+from lang.instructions.types import (
+    CallFunction,
+    Instruction,
+    IntEquals,
+    IntPlus,
+    StrConcat,
+    StrEquals,
+    TailCall,
+)
+from lang.models.parse import ParsedFile
 from lang.runtime.program import Program
 from lang.runtime.simulator import Simulator
 
@@ -57,3 +69,177 @@ def test_program_implements_all_instructions() -> None:
     simulator = Simulator(Program.without_file("fn main { nop }"))
     implemented_instructions = set(simulator.instruction_funcs.keys())
     assert instruction_types == implemented_instructions
+
+
+def test_program_generates_type_specialized_operators() -> None:
+    program = Program.without_file('fn main { 1 2 + 3 = drop "a" "b" + "c" = drop }')
+    assert not program.file_load_errors
+
+    instructions = program.get_instructions(program.entry_point_file, "main")
+    instruction_types = [type(instruction) for instruction in instructions]
+
+    assert IntPlus in instruction_types
+    assert IntEquals in instruction_types
+    assert StrConcat in instruction_types
+    assert StrEquals in instruction_types
+
+
+@pytest.mark.parametrize(
+    ["body", "expected_tail_calls", "expected_calls"],
+    [
+        pytest.param("n 1 - foo", 1, 0, id="last-instruction"),
+        pytest.param("if n 0 = { nop } else { n 1 - foo }", 1, 0, id="else-body"),
+        pytest.param("if n 0 = { n 1 - foo } else { nop }", 1, 0, id="if-body"),
+        pytest.param("n 1 - foo n drop", 0, 1, id="not-last"),
+        pytest.param("n bar", 0, 1, id="other-function"),
+        pytest.param("while n 0 = { n 1 + foo } n drop", 0, 1, id="inside-loop"),
+    ],
+)
+def test_program_generates_tail_calls(
+    body: str, expected_tail_calls: int, expected_calls: int
+) -> None:
+    code = "fn main { 3 foo }\n"
+    code += "fn foo args n as int { " + body + " }\n"
+    code += "fn bar args n as int { nop }"
+    program = Program.without_file(code)
+    assert not program.file_load_errors
+
+    instructions = program.get_instructions(program.entry_point_file, "foo")
+    instruction_types = [type(instruction) for instruction in instructions]
+
+    assert instruction_types.count(TailCall) == expected_tail_calls
+    assert instruction_types.count(CallFunction) == expected_calls
+
+
+DIAMOND_FILES = {
+    "main.aaa": 'from "left" import left\nfrom "right" import right\n'
+    + "fn main { left right + . }",
+    "left.aaa": 'from "shared" import one\nfn left return int { one }',
+    "right.aaa": 'from "shared" import one\nfn right return int { one 1 + }',
+    "shared.aaa": "fn one return int { 1 }",
+}
+
+
+def test_program_loads_imported_file_once(
+    tmp_path: Path, monkeypatch: MonkeyPatch
+) -> None:
+    for name, code in DIAMOND_FILES.items():
+        (tmp_path / name).write_text(code)
+
+    parsed_files: List[Path] = []
+    original_parse = Program._parse_regular_file
+
+    def parse(self: Program, file: Path, code: str) -> ParsedFile:
+        parsed_files.append(file)
+        return original_parse(self, file, code)
+
+    monkeypatch.setattr(Program, "_parse_regular_file", parse)
+    program = Program(tmp_path / "main.aaa", use_cache=False)
+
+    assert program.file_load_errors == []
+    assert sorted(file.name for file in parsed_files) == sorted(DIAMOND_FILES)
+
+
+def test_program_imported_file_errors_reported_once(tmp_path: Path) -> None:
+    files = DIAMOND_FILES | {"shared.aaa": "fn one return int { two }"}
+
+    for name, code in files.items():
+        (tmp_path / name).write_text(code)
+
+    program = Program(tmp_path / "main.aaa", use_cache=False)
+    assert list(map(type, program.file_load_errors)) == [UnknownIdentifier]
+
+
+def test_program_sources_without_files(tmp_path: Path) -> None:
+    sources = {tmp_path / name: code for name, code in DIAMOND_FILES.items()}
+    program = Program(tmp_path / "main.aaa", sources=sources)
+
+    assert program.file_load_errors == []
+    assert list(tmp_path.iterdir()) == []
+
+
+def test_program_without_file_writes_nothing(tmp_path: Path) -> None:
+    with patch.object(Path, "write_text") as write_text:
+        program = Program.without_file("fn main { nop }")
+
+    assert program.file_load_errors == []
+    assert program.entry_point_file.name == "<string>"
+    assert not program.entry_point_file.exists()
+    write_text.assert_not_called()
+
+
+def test_program_shared_builtins() -> None:
+    builtins = Program.without_file("fn main { nop }").builtins
+
+    with patch.object(Program, "_load_builtins") as load_builtins:
+        program = Program.without_file("fn main { 3 . }", builtins=builtins)
+
+    load_builtins.assert_not_called()
+    assert program.file_load_errors == []
+    assert program.builtins is builtins
+    assert program.builtins_hash == builtins.hash != ""
+
+
+def test_program_parallel_load_same_as_sequential() -> None:
+    code = "fn main { 1 foo . }\n" + "".join(
+        f"fn func_{name} args a as int return int {{ a {value} + }}\n"
+        for value, name in enumerate("abcdefgh")
+    )
+    code += "fn foo args a as int return int { a 1 + }"
+
+    sequential = Program.without_file(code)
+    parallel = Program.without_file(code, jobs=3)
+    assert parallel.file_load_errors == []
+
+    sequential_instructions = sequential.function_instructions[
+        sequential.entry_point_file
+    ]
+    parallel_instructions = parallel.function_instructions[parallel.entry_point_file]
+
+    # Functions are kept in source order
+    assert list(parallel_instructions) == list(sequential_instructions)
+    assert repr(parallel_instructions) == repr(sequential_instructions)
+
+    file = sequential.entry_point_file
+    assert (
+        parallel.function_stack_heights[file]
+        == sequential.function_stack_heights[file]
+    )
+
+
+def test_program_parallel_load_errors_in_order() -> None:
+    code = "fn main { nop }\n" + "".join(
+        f'fn func_{name} {{ "{name}" {value} + drop }}\n'
+        for value, name in enumerate("abcdef")
+    )
+
+    sequential = Program.without_file(code)
+    parallel = Program.without_file(code, jobs=4)
+
+    def function_names(program: Program) -> List[str]:
+        names: List[str] = []
+
+        for error in program.file_load_errors:
+            assert isinstance(error, StackTypesError)
+            names.append(error.function.name)
+
+        return names
+
+    assert function_names(parallel) == [f"func_{name}" for name in "abcdef"]
+    assert function_names(parallel) == function_names(sequential)
+
+
+@pytest.mark.parametrize(
+    ["code", "expected_height"],
+    [
+        pytest.param("nop", 0, id="empty"),
+        pytest.param("1 2 3 + + drop", 3, id="operators"),
+        pytest.param("1 if true { 2 } else { 3 4 5 + + } drop drop", 4, id="branch"),
+        pytest.param("0 while dup 5 < { 1 + } drop", 3, id="loop"),
+    ],
+)
+def test_program_records_stack_height(code: str, expected_height: int) -> None:
+    program = Program.without_file("fn main { " + code + " }")
+    assert program.file_load_errors == []
+
+    assert program.get_stack_height(program.entry_point_file, "main") == expected_height
@@ -0,0 +1,142 @@
+import sys
+import threading
+from contextlib import redirect_stderr, redirect_stdout
+from io import StringIO
+
+import pytest
+
+from lang.exceptions.runtime import AaaAssertionFailure
+from lang.runtime.program import Program
+from lang.runtime.pycompiler import PyCompiler
+from lang.runtime.simulator import Simulator
+
+LOOP_WITH_BRANCHES = """
+fn main {
+    0 while dup 10 < {
+        if dup 2 % drop 0 = { dup . " " . } 1 +
+        if dup 5 = { "five " . }
+    } drop
+}
+"""
+
+
+def test_pycompiler_generates_structured_code() -> None:
+    program = Program.without_file(LOOP_WITH_BRANCHES)
+    source = PyCompiler(program).generate()
+
+    assert "while True:" in source
+    assert "if s1:" in source
+    assert "pc = " not in source
+
+
+@pytest.mark.parametrize("optimize", [False, True])
+def test_pycompiler_loop_with_branches(optimize: bool) -> None:
+    program = Program.without_file(LOOP_WITH_BRANCHES, optimize=optimize)
+
+    with redirect_stdout(StringIO()) as stdout:
+        PyCompiler(program).run(raise_=True)
+
+    assert stdout.getvalue() == "0 2 4 five 6 8 "
+
+
+def test_pycompiler_dispatch_loop() -> None:
+    # The PeepholeOptimizer threads the jumps of the first branch to the loop end
+    program = Program.without_file(LOOP_WITH_BRANCHES, optimize=True)
+    source = PyCompiler(program).generate()
+
+    assert "pc = 0" in source
+
+
+def test_pycompiler_deep_recursion() -> None:
+    code = (
+        "fn main { 100000 count_down . }\n"
+        + "fn count_down args n as int return int {\n"
+        + "    if n 0 = { 0 } else { n 1 - count_down 1 + }\n"
+        + "}"
+    )
+    program = Program.without_file(code)
+
+    with redirect_stdout(StringIO()) as stdout:
+        PyCompiler(program).run(raise_=True)
+
+    assert stdout.getvalue() == "100000"
+
+
+@pytest.mark.parametrize(
+    "code",
+    [
+        pytest.param("fn main { 3 . }", id="success"),
+        pytest.param("fn main { false assert }", id="failure"),
+    ],
+)
+def test_pycompiler_restores_process_limits(code: str) -> None:
+    recursion_limit = sys.getrecursionlimit()
+    stack_size = threading.stack_size()
+
+    with redirect_stdout(StringIO()), redirect_stderr(StringIO()):
+        try:
+            PyCompiler(Program.without_file(code)).run(raise_=True)
+        except AaaAssertionFailure:
+            pass
+
+    assert sys.getrecursionlimit() == recursion_limit
+    assert threading.stack_size() == stack_size
+
+
+def test_pycompiler_assertion_failure() -> None:
+    code = (
+        "fn main { 3 foo }\n"
+        + "fn foo args n as int { n 1 - bar }\n"
+        + "fn bar args n as int { n 3 = assert }"
+    )
+    program = Program.without_file(code)
+
+    messages = []
+
+    for engine in [Simulator, PyCompiler]:
+        with redirect_stderr(StringIO()):
+            with pytest.raises(AaaAssertionFailure) as e:
+                engine(program).run(raise_=True)
+
+        messages.append(str(e.value))
+
+    assert messages[0] == messages[1]
+    assert messages[1] == (
+        "Assertion failure, stacktrace:\n"
+        + "- main- foo, arguments: n=3- bar, arguments: n=2"
+    )
+
+
+TAIL_RECURSIVE_LOOP = """
+fn main { 2 repeat }
+fn repeat args n as int {
+    if n 0 = { nop } else {
+        0 while dup 10 < {
+            if dup 2 % drop 0 = { dup . " " . } 1 +
+            if dup 5 = { "five " . }
+        } drop
+        n 1 - repeat
+    }
+}
+"""
+
+
+@pytest.mark.parametrize(
+    ["optimize", "expected_code", "expected_count"],
+    [
+        pytest.param(False, "continue", 1, id="structured"),
+        # Once to start the dispatch loop and once for the tail call
+        pytest.param(True, "pc = 0", 2, id="dispatch-loop"),
+    ],
+)
+def test_pycompiler_tail_call(
+    optimize: bool, expected_code: str, expected_count: int
+) -> None:
+    program = Program.without_file(TAIL_RECURSIVE_LOOP, optimize=optimize)
+    source = PyCompiler(program).generate()
+    assert source.count(expected_code) == expected_count
+
+    with redirect_stdout(StringIO()) as stdout:
+        PyCompiler(program).run(raise_=True)
+
+    assert stdout.getvalue() == "0 2 4 five 6 8 " * 2
@@ -0,0 +1,145 @@
+import os
+from contextlib import redirect_stderr, redirect_stdout
+from io import StringIO
+from pathlib import Path
+from typing import Type
+
+import pytest
+
+from lang.exceptions.runtime import AaaInvalidArgument
+from lang.runtime.program import Program
+from lang.runtime.pycompiler import PyCompiler
+from lang.runtime.simulator import Simulator
+from lang.runtime.syscalls import STDIN, SysCalls
+
+ENGINES = [Simulator, PyCompiler]
+
+COUNT_LINES = """
+fn main {
+    0 0 read_line while dup { drop drop 1 + 0 read_line } drop drop .
+}
+"""
+
+ECHO_CHUNKS = """
+fn main {
+    0 2 read_chunk while dup { drop "[" . . "]" . 0 2 read_chunk } drop drop
+}
+"""
+
+
+def run(
+    code: str, engine: Type[Simulator | PyCompiler], input: str = "", **kwargs: bool
+) -> str:
+    program = Program.without_file(code, **kwargs)
+    assert program.file_load_errors == []
+
+    with redirect_stdout(StringIO()) as stdout:
+        engine(program, input=StringIO(input)).run(raise_=True)
+
+    return stdout.getvalue()
+
+
+@pytest.mark.parametrize("optimize", [False, True])
+@pytest.mark.parametrize("engine", ENGINES)
+def test_read_line_stdin(engine: Type[Simulator | PyCompiler], optimize: bool) -> None:
+    assert run(COUNT_LINES, engine, "a\nb\n\nc", optimize=optimize) == "4"
+
+
+@pytest.mark.parametrize("engine", ENGINES)
+def test_read_line_strips_newline(engine: Type[Simulator | PyCompiler]) -> None:
+    code = 'fn main { 0 read_line . . "|" . 0 read_line . . }'
+    assert run(code, engine, "abc\n") == "trueabc|false"
+
+
+@pytest.mark.parametrize("engine", ENGINES)
+def test_read_chunk_stdin(engine: Type[Simulator | PyCompiler]) -> None:
+    assert run(ECHO_CHUNKS, engine, "abcdé") == "[ab][cd][é]"
+
+
+@pytest.mark.parametrize("size", [0, -1])
+@pytest.mark.parametrize("engine", ENGINES)
+def test_read_chunk_invalid_size(
+    engine: Type[Simulator | PyCompiler], size: int
+) -> None:
+    code = f"fn main {{ 0 0 {-size} - read_chunk . . }}"
+
+    with redirect_stderr(StringIO()), pytest.raises(AaaInvalidArgument) as e:
+        run(code, engine, "abc")
+
+    message = f"Invalid argument for read_chunk: size {size} is not positive"
+    assert str(e.value) == message
+
+
+@pytest.mark.parametrize("engine", ENGINES)
+def test_open_file(tmp_path: Path, engine: Type[Simulator | PyCompiler]) -> None:
+    file = tmp_path / "lines.txt"
+    file.write_text("one\ntwo\n")
+
+    code = f"""
+    fn main {{
+        "{file}" open_file assert
+        dup read_line assert .
+        dup read_line assert .
+        dup read_line . drop
+        close_file .
+    }}
+    """
+    assert run(code, engine) == "onetwofalsetrue"
+
+
+def test_open_file_with_stdin_closed(tmp_path: Path) -> None:
+    file = tmp_path / "lines.txt"
+    file.write_text("one\n")
+    sys_calls = SysCalls()
+    saved_stdin = os.dup(STDIN)
+    os.close(STDIN)
+
+    try:
+        handle, _ = sys_calls.open_file(str(file))
+
+        # The operating system reused file descriptor 0 of stdin
+        assert sys_calls.files[handle].fileno() == STDIN
+        assert handle != STDIN
+        assert sys_calls.read_line(handle) == ("one", True)
+    finally:
+        sys_calls.close()
+        os.dup2(saved_stdin, STDIN)
+        os.close(saved_stdin)
+
+
+@pytest.mark.parametrize("engine", ENGINES)
+def test_open_file_missing(
+    tmp_path: Path, engine: Type[Simulator | PyCompiler]
+) -> None:
+    code = f'fn main {{ "{tmp_path / "missing"}" open_file . . }}'
+    assert run(code, engine) == "false-1"
+
+
+@pytest.mark.parametrize("engine", ENGINES)
+def test_close_file_not_opened(engine: Type[Simulator | PyCompiler]) -> None:
+    assert run("fn main { 0 close_file . 7 close_file . }", engine) == "falsefalse"
+
+
+@pytest.mark.parametrize("engine", ENGINES)
+def test_read_file(tmp_path: Path, engine: Type[Simulator | PyCompiler]) -> None:
+    (tmp_path / "full.txt").write_text("a\nbé")
+    (tmp_path / "empty.txt").write_text("")
+
+    code = f"""
+    fn main {{
+        "{tmp_path / "full.txt"}" read_file . .
+        "{tmp_path / "empty.txt"}" read_file . .
+        "{tmp_path / "missing"}" read_file . .
+    }}
+    """
+    assert run(code, engine) == "truea\nbétruefalse"
+
+
+def test_sys_calls_flush_before_stdin_read() -> None:
+    flushed = []
+    sys_calls = SysCalls(StringIO("x\n"), before_stdin_read=lambda: flushed.append(1))
+
+    assert sys_calls.read_line(0) == ("x", True)
+    assert flushed == [1]
+
+    sys_calls.close()
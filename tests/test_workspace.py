@@ -0,0 +1,144 @@
+from contextlib import redirect_stdout
+from io import StringIO
+from pathlib import Path
+from typing import Dict, List
+
+from lang.exceptions.misc import AaaParseException
+from lang.exceptions.typing import FunctionTypeError, StackTypesError
+from lang.runtime.simulator import Simulator
+from lang.runtime.workspace import Workspace
+
+FILES = {
+    "main.aaa": 'from "lib" import double\n'
+    + "fn main { 3 double 1 + . }\n"
+    + "fn unrelated { 1 . }\n",
+    "lib.aaa": "fn double args n as int return int { n n + }\n",
+}
+
+
+def write_files(directory: Path, files: Dict[str, str]) -> None:
+    for name, code in files.items():
+        (directory / name).write_text(code)
+
+
+def checked_names(workspace: Workspace) -> List[str]:
+    return sorted(f"{file.name}:{name}" for file, name in workspace.last_checked)
+
+
+def test_workspace_checks_everything_once(tmp_path: Path) -> None:
+    write_files(tmp_path, FILES)
+    workspace = Workspace(tmp_path / "main.aaa")
+
+    assert workspace.file_load_errors == []
+    assert checked_names(workspace) == [
+        "lib.aaa:double",
+        "main.aaa:main",
+        "main.aaa:unrelated",
+    ]
+
+    assert workspace.check(tmp_path / "main.aaa") == []
+    assert checked_names(workspace) == []
+
+
+def test_workspace_rechecks_changed_function(tmp_path: Path) -> None:
+    write_files(tmp_path, FILES)
+    workspace = Workspace(tmp_path / "main.aaa")
+    parsed_lib = workspace.parsed_files[(tmp_path / "lib.aaa").resolve()]
+
+    # Moving unrelated down a line doesn't change it
+    code = 'from "lib" import double\n\nfn main { 4 double . }\nfn unrelated { 1 . }'
+    workspace.open(tmp_path / "main.aaa", code)
+
+    assert workspace.check(tmp_path / "main.aaa") == []
+    assert checked_names(workspace) == ["main.aaa:main"]
+
+    # Files that didn't change are not parsed again
+    assert workspace.parsed_files[(tmp_path / "lib.aaa").resolve()] is parsed_lib
+
+
+def test_workspace_rechecks_callers_of_changed_signature(tmp_path: Path) -> None:
+    write_files(tmp_path, FILES)
+    workspace = Workspace(tmp_path / "main.aaa")
+
+    # Only changing the body keeps callers as they are
+    workspace.open(tmp_path / "lib.aaa", "fn double args n as int return int { n 2 * }")
+    assert workspace.check(tmp_path / "main.aaa") == []
+    assert checked_names(workspace) == ["lib.aaa:double"]
+
+    workspace.open(tmp_path / "lib.aaa", 'fn double args n as int return str { "" }')
+    errors = workspace.check(tmp_path / "main.aaa")
+    assert checked_names(workspace) == ["lib.aaa:double", "main.aaa:main"]
+    assert list(map(type, errors)) == [StackTypesError]
+
+
+def test_workspace_rechecks_callers_of_renamed_arguments(tmp_path: Path) -> None:
+    write_files(tmp_path, FILES)
+    workspace = Workspace(tmp_path / "main.aaa")
+
+    workspace.open(tmp_path / "lib.aaa", "fn double args m as int return int { m m + }")
+    assert workspace.check(tmp_path / "main.aaa") == []
+    assert checked_names(workspace) == ["lib.aaa:double", "main.aaa:main"]
+
+
+def test_workspace_rechecks_callers_of_moved_function(tmp_path: Path) -> None:
+    write_files(tmp_path, FILES)
+    write_files(tmp_path, {"other.aaa": "fn double args n as int return int { n 3 * }"})
+    workspace = Workspace(tmp_path / "main.aaa")
+
+    # Only the import changes, main has to call the double in other.aaa now
+    code = FILES["main.aaa"].replace('"lib"', '"other"')
+    workspace.open(tmp_path / "main.aaa", code)
+    assert workspace.check(tmp_path / "main.aaa") == []
+    assert checked_names(workspace) == ["main.aaa:main", "other.aaa:double"]
+
+    with redirect_stdout(StringIO()) as stdout:
+        Simulator(workspace).run(raise_=True)
+
+    assert stdout.getvalue() == "10"
+
+
+def test_workspace_reports_fixed_errors(tmp_path: Path) -> None:
+    write_files(tmp_path, FILES)
+    workspace = Workspace(tmp_path / "main.aaa")
+
+    workspace.open(tmp_path / "lib.aaa", "fn double args n as int return int {")
+    errors = workspace.check(tmp_path / "main.aaa")
+    assert list(map(type, errors)) == [AaaParseException]
+
+    # Parse errors show unsaved code
+    assert isinstance(errors[0], AaaParseException)
+    assert errors[0].code == "fn double args n as int return int {"
+
+    workspace.open(tmp_path / "lib.aaa", 'fn double args n as int return int { "" }')
+    errors = workspace.check(tmp_path / "main.aaa")
+    assert list(map(type, errors)) == [FunctionTypeError]
+
+    # Functions with errors are checked again, even if they didn't change
+    errors = workspace.check(tmp_path / "main.aaa")
+    assert list(map(type, errors)) == [FunctionTypeError]
+    assert checked_names(workspace) == ["lib.aaa:double"]
+
+    workspace.close(tmp_path / "lib.aaa")
+    assert workspace.check(tmp_path / "main.aaa") == []
+
+
+def test_workspace_file_without_main(tmp_path: Path) -> None:
+    write_files(tmp_path, FILES)
+    workspace = Workspace(tmp_path / "lib.aaa")
+
+    assert workspace.file_load_errors == []
+    assert workspace.check(tmp_path / "lib.aaa") == []
+
+
+def test_workspace_runs_updated_code(tmp_path: Path) -> None:
+    write_files(tmp_path, FILES)
+    workspace = Workspace(tmp_path / "main.aaa")
+
+    workspace.open(tmp_path / "lib.aaa", "fn double args n as int return int { n 2 * }")
+    workspace.open(tmp_path / "main.aaa", FILES["main.aaa"].replace("3", "5"))
+    assert workspace.check(tmp_path / "main.aaa") == []
+
+    with redirect_stdout(StringIO()) as stdout:
+        Simulator(workspace).run(raise_=True)
+
+    assert stdout.getvalue() == "11"